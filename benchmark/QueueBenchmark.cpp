@@ -0,0 +1,72 @@
+/*
+ * Enqueue/dequeue latency & throughput of the Blocking ITPS message queue backends:
+ *  ConsumerProducerQueue (Locking) vs RingBufferQueue (LockFree)
+ *
+ * usage: ./QueueBenchmark.exe [num_msgs]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono.hpp>
+#include <boost/shared_ptr.hpp>
+#include "Misc/PubSubSystem/CpQueue.hpp"
+#include "Misc/PubSubSystem/RingBufferQueue.hpp"
+
+typedef boost::chrono::steady_clock bench_clock;
+
+static int64_t now_ns() {
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                bench_clock::now().time_since_epoch()).count();
+}
+
+static int64_t percentile(std::vector<int64_t>& sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, (std::size_t)(p * sorted.size()))];
+}
+
+/* 1 producer, 1 consumer, the message is the timestamp of produce(), 
+ * latency = time between produce() being called and consume() returning the message
+ */
+static void run(const std::string& name, boost::shared_ptr<MessageQueue<int64_t>> queue, unsigned int num_msgs) {
+    std::vector<int64_t> latencies(num_msgs);
+
+    boost::thread consumer([&]() {
+        for(unsigned int i = 0; i < num_msgs; i++) {
+            int64_t sent = queue->consume();
+            latencies[i] = now_ns() - sent;
+        }
+    });
+
+    int64_t t0 = now_ns();
+    for(unsigned int i = 0; i < num_msgs; i++) {
+        queue->produce(now_ns());
+    }
+    consumer.join();
+    int64_t t1 = now_ns();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::left << std::setw(28) << name
+              << " p50: " << std::setw(8) << percentile(latencies, 0.50)
+              << " p99: " << std::setw(8) << percentile(latencies, 0.99)
+              << " max: " << std::setw(10) << latencies.back()
+              << " (ns)  throughput: " << (uint64_t)(num_msgs * 1e9 / (t1 - t0)) << " msg/s"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int num_msgs = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    for(unsigned int queue_size : {1u, 10u, 100u}) {
+        std::string suffix = "(size " + std::to_string(queue_size) + ")";
+        run("Locking  " + suffix, boost::shared_ptr<MessageQueue<int64_t>>(
+                new ConsumerProducerQueue<int64_t>(queue_size)), num_msgs);
+        run("LockFree " + suffix, boost::shared_ptr<MessageQueue<int64_t>>(
+                new RingBufferQueue<int64_t>(queue_size)), num_msgs);
+    }
+    return 0;
+}
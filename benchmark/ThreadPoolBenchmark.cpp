@@ -0,0 +1,134 @@
+/*
+ * Throughput & latency of small tasks on the ThreadPool backends:
+ *  IoService (one shared queue) vs WorkStealing (a queue per thread)
+ *
+ *  * posters: several threads outside of the pool each post their share of the tasks (publishers' callbacks)
+ *  * fan-out: the tasks are posted from the pool's threads, each one posting the next of its chain
+ *
+ * latency = time between execute() being called and the task starting
+ *
+ * usage: ./ThreadPoolBenchmark.exe [num_tasks] [num_threads]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include "Misc/PubSubSystem/ThreadPool.hpp"
+
+typedef boost::chrono::steady_clock bench_clock;
+
+static int64_t now_ns() {
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                bench_clock::now().time_since_epoch()).count();
+}
+
+static int64_t percentile(std::vector<int64_t>& sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, (std::size_t)(p * sorted.size()))];
+}
+
+// the tasks' latencies, and the wait for the last one
+class Results {
+    public:
+        Results(unsigned int num_tasks) : latencies(num_tasks), num_done(0) {}
+
+        // a task posted at posted_ns starting now
+        void record(int64_t posted_ns) {
+            int64_t latency = now_ns() - posted_ns;
+            unsigned int i = num_done.fetch_add(1);
+            latencies[i] = latency;
+            if(i + 1 == latencies.size()) {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                cond.notify_all();
+            }
+        }
+
+        void wait() {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while(num_done.load() < latencies.size()) cond.wait(lock);
+        }
+
+        void print(const std::string& name, int64_t elapsed_ns) {
+            std::sort(latencies.begin(), latencies.end());
+            std::cout << std::left << std::setw(28) << name
+                      << " p50: " << std::setw(8) << percentile(latencies, 0.50)
+                      << " p99: " << std::setw(8) << percentile(latencies, 0.99)
+                      << " p99.9: " << std::setw(9) << percentile(latencies, 0.999)
+                      << " max: " << std::setw(10) << latencies.back()
+                      << " (ns)  throughput: " << (uint64_t)(latencies.size() * 1e9 / elapsed_ns) << " tasks/s"
+                      << std::endl;
+        }
+
+    private:
+        std::vector<int64_t> latencies;
+        boost::atomic<unsigned int> num_done;
+        boost::mutex mutex;
+        boost::condition_variable_any cond;
+};
+
+static void run_posters(const std::string& name, ThreadPool::Backend backend, unsigned int num_threads,
+                        unsigned int num_posters, unsigned int num_tasks) {
+    ThreadPool pool(num_threads, ThreadSched("pool"), backend);
+    Results results(num_tasks);
+    int64_t t0 = now_ns();
+    boost::thread_group posters;
+    for(unsigned int p = 0; p < num_posters; p++) {
+        unsigned int share = num_tasks / num_posters + (p < num_tasks % num_posters ? 1 : 0);
+        posters.create_thread([&pool, &results, share]() {
+            for(unsigned int i = 0; i < share; i++) {
+                int64_t posted = now_ns();
+                pool.execute([&results, posted]() { results.record(posted); });
+            }
+        });
+    }
+    posters.join_all();
+    results.wait();
+    results.print(name, now_ns() - t0);
+}
+
+// one link of a chain: records itself, then posts the next one from the pool
+static void chain(ThreadPool& pool, Results& results, int64_t posted, unsigned int remaining) {
+    results.record(posted);
+    if(remaining == 0) return;
+    int64_t next_posted = now_ns();
+    pool.execute([&pool, &results, next_posted, remaining]() { chain(pool, results, next_posted, remaining - 1); });
+}
+
+static void run_fan_out(const std::string& name, ThreadPool::Backend backend, unsigned int num_threads,
+                        unsigned int num_chains, unsigned int num_tasks) {
+    ThreadPool pool(num_threads, ThreadSched("pool"), backend);
+    Results results(num_tasks);
+    int64_t t0 = now_ns();
+    for(unsigned int c = 0; c < num_chains; c++) {
+        unsigned int length = num_tasks / num_chains + (c < num_tasks % num_chains ? 1 : 0);
+        if(length == 0) continue;
+        int64_t posted = now_ns();
+        pool.execute([&pool, &results, posted, length]() { chain(pool, results, posted, length - 1); });
+    }
+    results.wait();
+    results.print(name, now_ns() - t0);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int num_tasks = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    unsigned int num_threads = argc > 2 ? std::atoi(argv[2]) : std::max(2u, boost::thread::hardware_concurrency());
+
+    std::cout << num_tasks << " tasks on " << num_threads << " threads" << std::endl;
+    for(unsigned int num_posters : {1u, 4u}) {
+        std::string suffix = "(" + std::to_string(num_posters) + " posters)";
+        run_posters("IoService    " + suffix, ThreadPool::Backend::IoService, num_threads, num_posters, num_tasks);
+        run_posters("WorkStealing " + suffix, ThreadPool::Backend::WorkStealing, num_threads, num_posters, num_tasks);
+    }
+    std::string suffix = "(fan-out)";
+    run_fan_out("IoService    " + suffix, ThreadPool::Backend::IoService, num_threads, 4 * num_threads, num_tasks);
+    run_fan_out("WorkStealing " + suffix, ThreadPool::Backend::WorkStealing, num_threads, 4 * num_threads, num_tasks);
+    return 0;
+}
@@ -6,9 +6,14 @@ const std::size_t UDP_WBUF_SIZE = 1024;
 
 
 extern unsigned int THREAD_POOL_SIZE;
+extern unsigned int EXECUTOR_THREADS;
 
-extern unsigned int INIT_DELAY;
-extern unsigned int DEFAULT_SUBSCRIBER_TIMEOUT;
+extern int CTRL_CPU;
+extern int CTRL_RT_PRIORITY;
+extern int FIRM_IO_RT_PRIORITY;
+
+extern unsigned int STARTUP_LOG_PERIOD_MS;
+extern unsigned int MODULE_STOP_TIMEOUT_MS;
 
 extern std::string VFIRM_IP_ADDR;
 extern unsigned int VFIRM_IP_PORT;
@@ -16,6 +21,14 @@ extern unsigned int VFIRM_IP_PORT;
 extern int TCP_PORT;
 extern int UDP_PORT;
 
+extern unsigned int NUM_ROBOTS;
+extern unsigned int ROBOT_PORT_STRIDE;
+extern unsigned int THREADS_PER_ROBOT;
+// ports of the robot_id-th robot hosted by this process (robot 0 uses the ports above)
+int robot_tcp_port(unsigned int robot_id);
+int robot_udp_port(unsigned int robot_id);
+unsigned int robot_vfirm_port(unsigned int robot_id);
+
 extern int GRSIM_VISION_PORT;
 extern std::string GRSIM_VISION_IP; 
 
@@ -28,6 +41,14 @@ extern unsigned int SAFETY_EN_TIMEOUT;
 
 extern unsigned int CTRL_FREQUENCY;
 
+extern unsigned int MOTION_HISTORY_SIZE;
+extern unsigned int VISION_LATENCY_MS;
+
+extern unsigned int ITPS_STATS_LOG_PERIOD_MS;
+extern bool ITPS_TRACING;
+extern std::string ITPS_RECORD_PATH;
+extern unsigned int ITPS_RECORD_FILE_MB;
+
 
 extern float NS_PID_AMP;
 
@@ -11,10 +11,19 @@
 class BallCaptureModule : public Module {
 
     public:
+        // ITPS topics published by this module
+        ITPS_NONBLOCKING_TOPIC(MotionCMDTopic, Motion::MotionCMD, "Ball Capture Module", "MotionCMD");
+        ITPS_NONBLOCKING_TOPIC(IsDribbledTopic, bool, "Ball Capture Module", "isDribbled");
+        ITPS_NONBLOCKING_TOPIC(EnableDribblerTopic, bool, "BallCapture", "EnableDribbler");
+
         BallCaptureModule();
         virtual ~BallCaptureModule();
 
-    [[noreturn]] void task(ThreadPool& thread_pool) override;
+    void task(ThreadPool& thread_pool) override; // returns right away, the work is done by step()
+        bool schedule(Executor& executor) override; // same, as an event Task
+
+        // re-evaluates the capture state & command from the latest inputs
+        void step();
 
 
     protected:
@@ -28,6 +37,10 @@ class BallCaptureModule : public Module {
         ITPS::NonBlockingPublisher<bool> ballcap_status_pub;
         ITPS::NonBlockingPublisher<bool> drib_enable_pub;
         B_Log logger;
+        boost::shared_ptr<ThreadPool::Strand> strand; // serializes step() runs
+        Executor::Task* exec_task = nullptr;          // same, when scheduled on an executor
+        ITPS::Subscription bot_data_subscription;
+        ITPS::Subscription enable_subscription;
 
         /*
          *  Author: Haoen(Samuel) Luo
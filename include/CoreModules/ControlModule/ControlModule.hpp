@@ -1,10 +1,12 @@
 #pragma once
 
 #include "Misc/PubSubSystem/Module.hpp"
+#include "Misc/PubSubSystem/Snapshot.hpp"
 #include <armadillo>
 #include "ProtoGenerated/vFirmware_API.pb.h"
 #include "CoreModules/EKF-Module/MotionEkfModule.hpp"
 #include "ControlModule.hpp"
+#include "CoreModules/ControlModule/PidImplementation.hpp"
 
 
 
@@ -36,6 +38,9 @@ class ControlModule : public Module {
         void publish_output(VF_Commands& cmd);
         arma::mat headless_transform(double robot_orient);
         bool get_no_slowdown(void);
+        // the feedback and all setpoints, as one consistent view (instead of calling the getters above in turn)
+        void get_inputs(MotionEKF::MotionData& feedback, arma::vec& kicker_setpoint, bool& dribbler_set_on,
+                        SetPoint<arma::vec>& trans_setpoint, SetPoint<float>& rotat_setpoint, bool& no_slowdown);
 
     private:
         ITPS::NonBlockingSubscriber<bool> enable_signal_sub;
@@ -46,17 +51,38 @@ class ControlModule : public Module {
         ITPS::NonBlockingSubscriber< SetPoint<float> > rotat_setpoint_sub;
         ITPS::BlockingPublisher< VF_Commands > output_pub; 
         ITPS::NonBlockingSubscriber<bool> no_slowdown_sub;     
+        ITPS::Snapshot< MotionEKF::MotionData, arma::vec, bool, 
+                        SetPoint<arma::vec>, SetPoint<float>, bool > inputs_snapshot;
         
 };
 
 using CTRL = ControlModule;
 
+// how the ITPS recorder serializes the setpoints holding an arma::vec (the others are trivially copyable)
+namespace ITPS {
+    template <typename ValueType>
+    struct RecordCodec<CTRL::SetPoint<ValueType>, typename std::enable_if<!std::is_trivially_copyable<ValueType>::value>::type> {
+        static const bool supported = RecordCodec<ValueType>::supported;
+
+        static void encode(const CTRL::SetPoint<ValueType>& setpoint, RecordWriter& w) {
+            w.put(setpoint.value);
+            w.put(setpoint.type);
+        }
+
+        static void decode(RecordReader& r, CTRL::SetPoint<ValueType>& setpoint) {
+            r.get(setpoint.value);
+            r.get(setpoint.type);
+        }
+    };
+}
+
 class PID_System : public ControlModule {
 public:
     PID_System();
 
     virtual void task() {}
     virtual void task(ThreadPool& thread_pool);
+    bool schedule(Executor& executor) override; // step() every control period, as a periodic Task
 
     virtual void init_subscribers(void);
     struct PID_Constants {
@@ -67,7 +93,27 @@ public:
         // double DIR_Kp, DIR_Ki, DIR_Kd;
     };
 
+    // ITPS topics subscribed by this module, published by whoever configures the controller
+    ITPS_SHARED_NONBLOCKING_TOPIC(PID_ConstantsTopic, PID_Constants, "PID", "Constants"); // same for all the robots
+
+    /* one iteration of the control loop run by task(): while enabled, compute and publish the output
+     * command from the latest inputs, otherwise publish the halt command and restart the controllers.
+     * Return whether it was enabled, task() runs it once per control period (1/CTRL_FREQUENCY) either way
+     */
+    bool step();
+
 private:
     ITPS::NonBlockingSubscriber<PID_Constants> pid_consts_sub;
 
+    // control loop state, kept across step() calls
+    PID_Controller<float> rotat_disp_pid;
+    PID_Controller<arma::vec> trans_disp_pid;
+    VF_Commands output_cmd;
+    Vec_2D kicker_out;
+    Vec_2D trans_proto_out;
+    float rotat_disp_out = 0.0, rotat_vel_out = 0.0;
+    arma::vec trans_disp_out, trans_vel_out;
+
+    Executor::Task* exec_task = nullptr;
+
 };
\ No newline at end of file
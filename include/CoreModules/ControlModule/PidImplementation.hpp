@@ -4,6 +4,7 @@
 #define __PID_H_
 
 #include <iostream>
+#include "Misc/Utility/Clock.hpp"
 
 template <class T> // This PID code can handle (math)vector value
 class PID_Controller {
@@ -100,11 +101,18 @@ private:
     double period_ms; //unit: millisec 
     double prev_time_ms; // unit: millisec
     double (*millis_func)(void);
+    Clock* clock; // nullptr: millis_func measures the time
     
+    double curr_time_ms() {
+        if(this->clock != nullptr) return this->clock->now_ns() / 1000000.00;
+        return this->millis_func();
+    }
+
     T first_time_handle(T curr_error) {
         this->integral = curr_error - curr_error; // a workaround to get zero/zero_vector of a generic type
         this->prev_error = curr_error;
         this->is_first_time = false;
+        if(!this->is_fixed_time_interval) this->prev_time_ms = curr_time_ms();
         return Kp * curr_error;
     }
 
@@ -114,7 +122,7 @@ private:
             return this->period_ms;
         }
         else {
-            double curr_time_ms = this->millis_func(); 
+            double curr_time_ms = this->curr_time_ms();
             double dt = curr_time_ms - this->prev_time_ms;
             this->prev_time_ms = curr_time_ms;
             // std::cout << dt << std::endl; // debug
@@ -122,11 +130,18 @@ private:
         }
     }
 
+    /* (curr_error - prev_error) / period, zero if no time passed since the previous error, e.g. a simulated
+       clock not advanced between two calls: no rate can be measured, rather than dividing by 0 */
+    T error_rate(T curr_error, double period) {
+        if(period <= 0) return curr_error - curr_error;
+        return (curr_error - prev_error) / period;
+    }
+
 public:
     // proportional, integral and derivative constants
     double Kp, Ki, Kd;
     
-    PID_Controller(double Kp, double Ki, double Kd) {
+    PID_Controller(double Kp, double Ki, double Kd) : millis_func(nullptr), clock(nullptr) {
         this->Kp = Kp;
         this->Ki = Ki;
         this->Kd = Kd;
@@ -148,6 +163,15 @@ public:
     // Dynamic time interval mode, need to pass in a function handle to measure the curr time in millisec 
     void init(double (*millis)(void)) {
         this->millis_func = millis;
+        this->clock = nullptr;
+        this->is_first_time = true;
+        this->is_fixed_time_interval = false;
+    }
+
+    /* Dynamic time interval mode measured on a clock (check Clock.hpp), e.g. current_clock(),
+     * so the controller follows a simulated clock as well */
+    void init(Clock& clock) {
+        this->clock = &clock;
         this->is_first_time = true;
         this->is_fixed_time_interval = false;
     }
@@ -158,7 +182,7 @@ public:
     T calculate(T curr_error) {
         if(is_first_time) return first_time_handle(curr_error);
         double period = get_period();
-        T derivative = (curr_error - prev_error) / period; 
+        T derivative = error_rate(curr_error, period);
         this->integral += curr_error * period / 1000.000;
         T output = (Kp * curr_error) + (Kd * derivative) + (Ki * integral);
         prev_error = curr_error;
@@ -185,7 +209,7 @@ public:
     T calculate_s(T curr_error, T error_sum) {
         if(is_first_time) return first_time_handle(curr_error);
         double period = get_period();
-        T derivative = (curr_error - prev_error) / period; 
+        T derivative = error_rate(curr_error, period);
         T output = (Kp * curr_error) + (Kd * derivative) + (Ki * error_sum);
         return output;
     }
@@ -20,6 +20,9 @@ class BallEKF_Module : public Module {
             arma::vec vel;  // Velocity of ball in ball frame
         };
 
+        // ITPS topics published by this module
+        ITPS_NONBLOCKING_TOPIC(BallDataTopic, BallData, "BallEKF", "BallData");
+
         BallEKF_Module();
         virtual ~BallEKF_Module();
 
@@ -43,6 +46,24 @@ class BallEKF_Module : public Module {
 // alias
 using BallEKF = BallEKF_Module;
 
+// how the ITPS recorder serializes the BallData
+namespace ITPS {
+    template <>
+    struct RecordCodec<BallEKF::BallData> {
+        static const bool supported = true;
+
+        static void encode(const BallEKF::BallData& data, RecordWriter& w) {
+            w.put(data.disp);
+            w.put(data.vel);
+        }
+
+        static void decode(RecordReader& r, BallEKF::BallData& data) {
+            r.get(data.disp);
+            r.get(data.vel);
+        }
+    };
+}
+
 // Pseudo EKF
 class VirtualBallEKF : public BallEKF_Module {
 public:
@@ -50,12 +71,20 @@ public:
     ~VirtualBallEKF();
 
     void task() {}
-    void task(ThreadPool& thread_pool);
+    void task(ThreadPool& thread_pool); // returns right away, the work is done by on_ball_vel()
+    bool schedule(Executor& executor) override; // same, as an event Task
+
+    // process the latest ball location & velocity, what on_ball_vel() does for every new velocity
+    void step();
 
 private:
+    void on_ball_vel(const arma::vec& ball_vel);
 
     BallEKF::BallData ball_data;
     B_Log logger;
+    boost::shared_ptr<ThreadPool::Strand> strand;
+    Executor::Task* exec_task = nullptr;
+    ITPS::Subscription ball_vel_subscription;
 
 
 };
\ No newline at end of file
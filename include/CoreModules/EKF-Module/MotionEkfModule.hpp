@@ -2,6 +2,7 @@
 #include "Misc/PubSubSystem/Module.hpp"
 #include <armadillo>
 #include "ProtoGenerated/vFirmware_API.pb.h"
+#include "Misc/Utility/BoostLogger.hpp"
 
 
 /*  */
@@ -19,6 +20,9 @@ class MotionEKF_Module : public Module {
             float rotat_vel; 
         };
 
+        // ITPS topics published by this module
+        ITPS_NONBLOCKING_TOPIC(MotionDataTopic, MotionData, "MotionEKF", "MotionData");
+
         MotionEKF_Module();
         virtual ~MotionEKF_Module();
 
@@ -30,12 +34,15 @@ class MotionEKF_Module : public Module {
         virtual void init_subscribers();
 
         // To-do SSL_VisionData get_.....
-        VF_Data get_firmware_data();
+        ITPS::ConstMsgPtr<VF_Data> get_firmware_data();
+        // reactive alternative to get_firmware_data(): callback(frame) on exec_task for every firmware frame
+        ITPS::Subscription on_firmware_data(boost::function<void(const ITPS::ConstMsgPtr<VF_Data>&)> callback,
+                                            Executor::Task& exec_task);
         void publish_motion_data(MotionData data);
 
     private:
         ITPS::NonBlockingPublisher<MotionEKF_Module::MotionData> motion_data_pub;
-        ITPS::BlockingSubscriber<VF_Data> firm_data_sub; /* internal sensor data, which should be
+        ITPS::BlockingSubscriber<ITPS::ConstMsgPtr<VF_Data>> firm_data_sub; /* internal sensor data, which should be
                                                   * sampled faster than the ssl vision data
                                                   */ 
         // ITPS::Subscriber<SSL_VisionData>  (trivial mode) .... To-do 
@@ -46,6 +53,48 @@ class MotionEKF_Module : public Module {
 // alias
 using MotionEKF = MotionEKF_Module;
 
+// used by time-aligned lookups into the MotionData history (ITPS::NonBlockingSubscriber::msg_at_time)
+namespace ITPS {
+    template <>
+    struct Interpolator<MotionEKF::MotionData> {
+        static MotionEKF::MotionData apply(const MotionEKF::MotionData& a, const MotionEKF::MotionData& b, double alpha) {
+            MotionEKF::MotionData rtn;
+            rtn.trans_disp = a.trans_disp + (b.trans_disp - a.trans_disp) * alpha;
+            rtn.trans_vel = a.trans_vel + (b.trans_vel - a.trans_vel) * alpha;
+            rtn.rotat_vel = a.rotat_vel + (b.rotat_vel - a.rotat_vel) * alpha;
+
+            // orientation (in degree) takes the shorter way around, e.g. 170 => -170 passes through 180
+            float diff = b.rotat_disp - a.rotat_disp;
+            if(diff > 180.00) diff -= 360.00;
+            if(diff < -180.00) diff += 360.00;
+            rtn.rotat_disp = a.rotat_disp + diff * alpha;
+            if(rtn.rotat_disp > 180.00) rtn.rotat_disp -= 360.00;
+            if(rtn.rotat_disp < -180.00) rtn.rotat_disp += 360.00;
+            return rtn;
+        }
+    };
+
+    // field by field, the ITPS recorder can't copy the arma::vec members as raw bytes
+    template <>
+    struct RecordCodec<MotionEKF::MotionData> {
+        static const bool supported = true;
+
+        static void encode(const MotionEKF::MotionData& data, RecordWriter& w) {
+            w.put(data.trans_disp);
+            w.put(data.trans_vel);
+            w.put(data.rotat_disp);
+            w.put(data.rotat_vel);
+        }
+
+        static void decode(RecordReader& r, MotionEKF::MotionData& data) {
+            r.get(data.trans_disp);
+            r.get(data.trans_vel);
+            r.get(data.rotat_disp);
+            r.get(data.rotat_vel);
+        }
+    };
+}
+
 /*  */
 
 // Pseudo EKF
@@ -56,7 +105,11 @@ public:
 
     void task() override {}
 
-    [[noreturn]] void task(ThreadPool& thread_pool) override;
+    void task(ThreadPool& thread_pool) override;
+    bool schedule(Executor& executor) override; // on_firm_data() for every frame, as an event Task
+
+    // process the next firmware frame (blocks until there is one) and publish the motion data
+    void step();
 
 private:
     boost::shared_ptr<boost::asio::ip::udp::socket> socket;
@@ -66,6 +119,12 @@ private:
 
     arma::vec prev_disp = {0, 0};
     MotionEKF::MotionData motion_data;
+    B_Log logger;
+
+    void on_firm_data(const ITPS::ConstMsgPtr<VF_Data>& vf_data);
+
+    Executor::Task* exec_task = nullptr;
+    ITPS::Subscription firm_data_subscription;
 
 
 };
\ No newline at end of file
@@ -23,12 +23,23 @@ class MotionModule : public Module {
             ReferenceFrame ref_frame;
         };
 
+        // ITPS topics published by this module
+        ITPS_NONBLOCKING_TOPIC(TransSetPointTopic, CTRL::SetPoint<arma::vec>, "AI CMD", "Trans");
+        ITPS_NONBLOCKING_TOPIC(RotatSetPointTopic, CTRL::SetPoint<float>, "AI CMD", "Rotat");
+        ITPS_NONBLOCKING_TOPIC(NoSlowdownTopic, bool, "AI CMD", "NoSlowdown");
+        // the 3 topics above are published together by each move() call
+        ITPS_PUBLISH_GROUP(SetPointGroup);
+
 
         MotionModule();
         virtual ~MotionModule();
 
         virtual void task() {}
         virtual void task(ThreadPool& thread_pool);
+        bool schedule(Executor& executor) override; // same as task(), as a periodic Task also taking the commands
+
+        // one move() with the latest command, what task() runs on every command update/world frame tick
+        void step();
 
     protected:
         virtual void init_subscribers(void);
@@ -47,9 +58,36 @@ class MotionModule : public Module {
         ITPS::NonBlockingPublisher<CTRL::SetPoint<arma::vec>> trans_setpoint_pub;
         ITPS::NonBlockingPublisher<CTRL::SetPoint<float>> rotat_setpoint_pub;
         ITPS::NonBlockingPublisher<bool> no_slowdown_pub; // work-around for no slowdown modes
+
+        void on_command(const MotionCMD& cmd);
+        void on_tick();
+
+        Executor::Task* exec_task = nullptr;
+        ITPS::Subscription command_subscription;
+        bool loop_started = false; // the first tick comes once ready (check wait_ready()), commands before that wait for it
         
 
 
 };
 
 using Motion = MotionModule;
+
+// how the ITPS recorder serializes the MotionCMD
+namespace ITPS {
+    template <>
+    struct RecordCodec<Motion::MotionCMD> {
+        static const bool supported = true;
+
+        static void encode(const Motion::MotionCMD& cmd, RecordWriter& w) {
+            w.put(cmd.setpoint_3d);
+            w.put(cmd.mode);
+            w.put(cmd.ref_frame);
+        }
+
+        static void decode(RecordReader& r, Motion::MotionCMD& cmd) {
+            r.get(cmd.setpoint_3d);
+            r.get(cmd.mode);
+            r.get(cmd.ref_frame);
+        }
+    };
+}
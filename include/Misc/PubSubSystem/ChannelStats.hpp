@@ -0,0 +1,229 @@
+/*
+ * Live metrics & introspection of the ITPS channels
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include "HistoryBuffer.hpp"
+
+namespace ITPS {
+
+    /*
+     * Lock-free log2 histogram of durations: bucket i counts the samples in [2^(i-1), 2^i) microseconds,
+     * bucket 0 everything below 1us, the last bucket everything above. Recording is one relaxed increment,
+     * so it stays enabled in production.
+     */
+    class DurationHistogram {
+        public:
+            static const unsigned int NUM_BUCKETS = 24; // the last bucket starts at ~4s
+
+            DurationHistogram() : sum_ns(0) {
+                for(auto& bucket: buckets) bucket.store(0, boost::memory_order_relaxed);
+            }
+
+            void record(uint64_t duration_ns) {
+                uint64_t us = duration_ns / 1000;
+                unsigned int i = 0;
+                while(us > 0 && i < NUM_BUCKETS - 1) {
+                    us >>= 1;
+                    i++;
+                }
+                buckets[i].fetch_add(1, boost::memory_order_relaxed);
+                sum_ns.fetch_add(duration_ns, boost::memory_order_relaxed);
+            }
+
+            uint64_t count() const {
+                uint64_t n = 0;
+                for(auto& bucket: buckets) n += bucket.load(boost::memory_order_relaxed);
+                return n;
+            }
+
+            // exact mean (ns), 0 if empty
+            uint64_t mean() const {
+                uint64_t n = count();
+                return n == 0 ? 0 : sum_ns.load(boost::memory_order_relaxed) / n;
+            }
+
+            // upper bound (ns) of the bucket holding the p-th percentile (p in [0, 1]), 0 if empty
+            uint64_t percentile(double p) const {
+                uint64_t counts[NUM_BUCKETS];
+                uint64_t n = 0;
+                for(unsigned int i = 0; i < NUM_BUCKETS; i++) {
+                    counts[i] = buckets[i].load(boost::memory_order_relaxed);
+                    n += counts[i];
+                }
+                if(n == 0) return 0;
+                uint64_t rank = (uint64_t)(p * (n - 1)) + 1, seen = 0;
+                for(unsigned int i = 0; i < NUM_BUCKETS; i++) {
+                    seen += counts[i];
+                    if(seen >= rank) return upper_bound_ns(i);
+                }
+                return upper_bound_ns(NUM_BUCKETS - 1);
+            }
+
+            static uint64_t upper_bound_ns(unsigned int bucket) {
+                return (uint64_t(1) << bucket) * 1000;
+            }
+
+        private:
+            boost::atomic<uint64_t> buckets[NUM_BUCKETS];
+            boost::atomic<uint64_t> sum_ns;
+    };
+
+
+    // counters of one subscriber's message queue, updated by the queue itself (check CpQueue.hpp)
+    struct QueueStats {
+        boost::atomic<uint64_t> num_dropped{0};          // msgs lost to the OverflowPolicy, or to a publish timeout
+        boost::atomic<uint64_t> num_publish_timeouts{0}; // timed offers that gave up on a full queue
+        boost::atomic<uint64_t> num_consume_timeouts{0}; // timed consumes that returned the default msg
+        DurationHistogram consume_wait;                  // how long pop_msg() waited for a msg
+    };
+
+
+    // per channel publish counters, updated by every publish (check MsgChannel in PubSub.hpp)
+    class ChannelStats {
+        public:
+            void record_publish(timestamp_t now) {
+                num_publishes.fetch_add(1, boost::memory_order_relaxed);
+                timestamp_t prev = last_publish.exchange(now, boost::memory_order_relaxed);
+                if(prev == 0 || now <= prev) return;
+
+                // exponential moving average of the publish interval, with several publishers
+                // an update may get lost, which only makes the average a bit slower to follow
+                uint64_t avg = avg_interval.load(boost::memory_order_relaxed);
+                uint64_t interval = now - prev;
+                avg_interval.store(avg == 0 ? interval : avg - avg / 8 + interval / 8, boost::memory_order_relaxed);
+            }
+
+            uint64_t publishes() const {
+                return num_publishes.load(boost::memory_order_relaxed);
+            }
+
+            // 0 if never published
+            timestamp_t last_publish_time() const {
+                return last_publish.load(boost::memory_order_relaxed);
+            }
+
+            // recent publish rate, 0 if published less than twice
+            double rate_hz() const {
+                uint64_t avg = avg_interval.load(boost::memory_order_relaxed);
+                return avg == 0 ? 0.0 : 1e9 / double(avg);
+            }
+
+        private:
+            boost::atomic<uint64_t> num_publishes{0};
+            boost::atomic<timestamp_t> last_publish{0};
+            boost::atomic<uint64_t> avg_interval{0}; // ns
+    };
+
+
+    struct QueueReport {
+        std::string backend;
+        std::string overflow_policy;
+        unsigned int depth;
+        unsigned int capacity;
+        uint64_t num_dropped;
+        uint64_t num_publish_timeouts;
+        uint64_t num_consume_timeouts;
+        uint64_t num_waits;
+        uint64_t wait_p50_ns, wait_p99_ns, wait_max_ns;
+    };
+
+    struct ChannelReport {
+        std::string key; // topic_name.msg_name.mode
+        std::string topic_name, msg_name, mode;
+        std::string msg_type;
+        uint64_t num_publishes;
+        double rate_hz;
+        double last_publish_age_ms; // negative if never published
+        unsigned int num_listeners;  // callback subscriptions
+        std::string transport;       // "" in-process only, "shm-export" / "shm-import", check ShmTransport.hpp
+        uint64_t shm_dropped;        // msgs the shared-memory queue of an export had no room for
+        std::vector<QueueReport> queues; // Blocking mode, one per subscriber
+    };
+
+
+    /*
+     * Registry-wide introspection: every MsgChannel registers itself here when it gets into its
+     * channel table, reports are built on demand from the lock-free counters. The mutex only guards
+     * the registration list, never the publish/subscribe paths.
+     */
+    class ChannelRegistry {
+        public:
+            typedef boost::function<ChannelReport()> reporter_t;
+
+            static ChannelRegistry& instance() {
+                static ChannelRegistry registry;
+                return registry;
+            }
+
+            void add(reporter_t reporter) {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                reporters.push_back(reporter);
+            }
+
+            std::vector<ChannelReport> reports() {
+                std::vector<reporter_t> current;
+                {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    current = reporters;
+                }
+                std::vector<ChannelReport> rtn;
+                for(auto& reporter: current) rtn.push_back(reporter());
+                return rtn;
+            }
+
+            // human readable table, one line per channel & per subscriber queue
+            std::string dump() {
+                std::ostringstream os;
+                os << std::fixed << std::setprecision(1);
+                for(auto& r: reports()) {
+                    os << r.key << " <" << r.msg_type << "> pubs=" << r.num_publishes
+                       << " rate=" << r.rate_hz << "Hz age=";
+                    if(r.last_publish_age_ms < 0) os << "never";
+                    else os << r.last_publish_age_ms << "ms";
+                    if(r.num_listeners > 0) os << " callbacks=" << r.num_listeners;
+                    if(!r.transport.empty()) os << " " << r.transport;
+                    if(r.shm_dropped > 0) os << " shm_dropped=" << r.shm_dropped;
+                    os << "\n";
+                    for(std::size_t i = 0; i < r.queues.size(); i++) {
+                        const QueueReport& q = r.queues[i];
+                        os << "    queue#" << i << " " << q.backend << "/" << q.overflow_policy
+                           << " depth=" << q.depth << "/" << q.capacity
+                           << " dropped=" << q.num_dropped
+                           << " pub_timeouts=" << q.num_publish_timeouts
+                           << " pop_timeouts=" << q.num_consume_timeouts
+                           << " waits=" << q.num_waits
+                           << " wait_p50<" << q.wait_p50_ns / 1000 << "us"
+                           << " p99<" << q.wait_p99_ns / 1000 << "us"
+                           << " max<" << q.wait_max_ns / 1000 << "us\n";
+                    }
+                }
+                return os.str();
+            }
+
+        private:
+            ChannelRegistry() {}
+
+            boost::mutex mutex;
+            std::vector<reporter_t> reporters;
+    };
+
+    inline std::vector<ChannelReport> channel_reports() {
+        return ChannelRegistry::instance().reports();
+    }
+
+    inline std::string dump_channel_stats() {
+        return ChannelRegistry::instance().dump();
+    }
+
+}
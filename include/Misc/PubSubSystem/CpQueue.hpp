@@ -7,23 +7,128 @@
 
 #include <boost/thread/thread.hpp>
 #include <queue>
-#include <boost/chrono.hpp>
-#include <boost/chrono/system_clocks.hpp>
+#include <stdexcept>
+#include <boost/atomic.hpp>
+#include "ChannelStats.hpp"
+#include "../Utility/Clock.hpp"
+
+/* What the publisher side (offer()) does when a subscriber's queue is full */
+enum class OverflowPolicy {
+    Block,          // wait until the consumer makes room (the original behavior)
+    DropNewest,     // discard the incoming msg
+    DropOldest,     // evict the oldest queued msg to make room for the incoming one
+    OverwriteLatest // replace the most recently queued msg, the older backlog is kept in order
+};
+
+inline const char* overflow_policy_name(OverflowPolicy policy) {
+    switch(policy) {
+        case OverflowPolicy::Block:           return "Block";
+        case OverflowPolicy::DropNewest:      return "DropNewest";
+        case OverflowPolicy::DropOldest:      return "DropOldest";
+        case OverflowPolicy::OverwriteLatest: return "OverwriteLatest";
+    }
+    return "?";
+}
+
+/* Thrown by consume() once the queue got closed, e.g. to get a consumer blocked on it out of its loop */
+class QueueClosed : public std::runtime_error {
+    public:
+        QueueClosed() : std::runtime_error("ITPS: message queue closed") {}
+};
+
+/* Interface of the bounded message queues used by the Blocking ("B") ITPS channels,
+ * implemented by ConsumerProducerQueue (mutex + condition variables, below) 
+ * and RingBufferQueue (lock-free, check RingBufferQueue.hpp)
+ */
+template <typename data_t>
+class MessageQueue {
+    public:
+        MessageQueue(OverflowPolicy policy) : policy(policy) {}
+        virtual ~MessageQueue() {}
+
+        /* publisher side: enqueue according to the overflow policy, only blocks under OverflowPolicy::Block
+         * return false if the incoming msg got dropped (DropNewest, or Block timed out)
+         */
+        virtual bool offer(data_t data) = 0;
+        virtual bool offer(data_t data, unsigned int timeout_ms) = 0;
+
+        // block while the queue is full
+        virtual void produce(data_t data) = 0;
+        // return false if still full after timeout_ms
+        virtual bool produce(data_t data, unsigned int timeout_ms) = 0;
+        // block while the queue is empty
+        virtual data_t consume() = 0;
+        // return dft_rtn if still empty after timeout_ms
+        virtual data_t consume(unsigned int timeout_ms, data_t dft_rtn) = 0;
+        // never block, return false if empty
+        virtual bool try_consume(data_t& data) = 0;
+
+        virtual bool is_full() const = 0;
+        virtual bool is_empty() const = 0;
+        virtual unsigned int size() const = 0;
+        virtual unsigned int capacity() const = 0;
+        virtual void clear() = 0;
+        virtual const char* backend_name() const = 0;
+
+        /* shut the queue down for good: wake up everybody blocked on it, then the consume() calls
+         * throw QueueClosed and the produce()/offer() calls drop their msg. try_consume() still drains it
+         */
+        virtual void close() = 0;
+        virtual bool is_closed() const = 0;
+
+        OverflowPolicy overflow_policy() const {
+            return policy;
+        }
+
+        // lock-free counters, check ChannelStats.hpp
+        ITPS::QueueStats& stats() {
+            return counters;
+        }
+
+    protected:
+        OverflowPolicy policy;
+        ITPS::QueueStats counters;
+};
 
 template <typename data_t> 
-class ConsumerProducerQueue {
+class ConsumerProducerQueue : public MessageQueue<data_t> {
     public:
-        ConsumerProducerQueue(unsigned int max_size) {
+        ConsumerProducerQueue(unsigned int max_size, OverflowPolicy policy = OverflowPolicy::Block) 
+            : MessageQueue<data_t>(policy) {
             this->max_size = max_size;
         }
 
+        bool offer(data_t data) {
+            if(this->policy == OverflowPolicy::Block) {
+                produce(data);
+                return !closed;
+            }
+            return offer_nonblocking(data);
+        }
+
+        bool offer(data_t data, unsigned int timeout_ms) {
+            if(this->policy == OverflowPolicy::Block) {
+                if(produce(data, timeout_ms)) return true;
+                if(!closed) this->counters.num_publish_timeouts.fetch_add(1, boost::memory_order_relaxed);
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+            return offer_nonblocking(data);
+        }
+
         void produce(data_t data) {
             mu.lock();
-            while(is_full()) {
+            while(is_full() && !closed) {
                  // freeze this thread until queue is not full
                 cond_not_full.wait(mu);
             }
+            if(closed) {
+                mu.unlock();
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return;
+            }
             cp_queue.push(data);
+            depth.store(cp_queue.size(), boost::memory_order_relaxed);
             
             // unlock & notify order problem: https://stackoverflow.com/questions/17101922/do-i-have-to-acquire-lock-before-calling-condition-variable-notify-one/17102100#17102100
             mu.unlock();
@@ -33,25 +138,24 @@ class ConsumerProducerQueue {
         }
 
         bool produce(data_t data, unsigned int timeout_ms) {
-            boost::system_time const timeout = boost::get_system_time()+ boost::posix_time::milliseconds(timeout_ms);
+            Clock& clock = current_clock(); // the timeout runs on simulated time as well
+            uint64_t const deadline_ns = clock.deadline_after_ms(timeout_ms);
             bool fulfilled = true;
             mu.lock();
-            while(is_full()) {
+            while(is_full() && !closed) {
                  // freeze this thread until queue is not full
-                if(cond_not_full.timed_wait(mu, timeout)) {
-                    // if wait returns due to condition being fulfilled
-                    fulfilled = true;
-                } 
-                else {
+                if(!clock.wait_until(cond_not_full, mu, deadline_ns) && is_full()) {
                     // if wait returns due to time out
                     fulfilled = false;
                     break;
                 }
 
             }
+            if(closed) fulfilled = false;
 
             if(fulfilled) {
                 cp_queue.push(data);
+                depth.store(cp_queue.size(), boost::memory_order_relaxed);
             
                 // unlock & notify order problem: https://stackoverflow.com/questions/17101922/do-i-have-to-acquire-lock-before-calling-condition-variable-notify-one/17102100#17102100
                  mu.unlock();
@@ -68,12 +172,17 @@ class ConsumerProducerQueue {
 
         data_t consume() {
             mu.lock();
-            while(is_empty()) {
+            while(is_empty() && !closed) {
                 // freeze this thread until queue is not empty
                 cond_not_empty.wait(mu); 
             }
+            if(closed) {
+                mu.unlock();
+                throw QueueClosed();
+            }
             data_t rtn = cp_queue.front();
             cp_queue.pop();
+            depth.store(cp_queue.size(), boost::memory_order_relaxed);
             mu.unlock();
 
             // when a datum is dequeued, the queue must be not-full, notify the producer to unlock wait
@@ -83,25 +192,27 @@ class ConsumerProducerQueue {
 
         /* Timed consume: on timeout (unit: milliseconds), return dft_rtn (default return value) */
         data_t consume(unsigned int timeout_ms, data_t dft_rtn) {
-            boost::system_time const timeout = boost::get_system_time()+ boost::posix_time::milliseconds(timeout_ms);
+            Clock& clock = current_clock(); // the timeout runs on simulated time as well
+            uint64_t const deadline_ns = clock.deadline_after_ms(timeout_ms);
             bool fulfilled = true;
             mu.lock();
-            while(is_empty()) {
+            while(is_empty() && !closed) {
                 // freeze this thread until queue is not empty or timed out
-                if(cond_not_empty.timed_wait(mu, timeout)) {
-                    // if wait returns due to condition being fulfilled
-                    fulfilled = true;
-                } 
-                else {
+                if(!clock.wait_until(cond_not_empty, mu, deadline_ns) && is_empty()) {
                     // if wait returns due to time out
                     fulfilled = false;
                     break;
                 }
             }
+            if(closed) {
+                mu.unlock();
+                throw QueueClosed();
+            }
 
             if(fulfilled) {
                 data_t rtn = cp_queue.front();
                 cp_queue.pop();
+                depth.store(cp_queue.size(), boost::memory_order_relaxed);
                 mu.unlock();
 
                 // when a datum is dequeued, the queue must be not-full, notify the producer to unlock wait
@@ -110,10 +221,25 @@ class ConsumerProducerQueue {
             }
             else {
                 mu.unlock();
+                this->counters.num_consume_timeouts.fetch_add(1, boost::memory_order_relaxed);
                 return dft_rtn;
             }
         }
 
+        bool try_consume(data_t& data) {
+            mu.lock();
+            if(is_empty()) {
+                mu.unlock();
+                return false;
+            }
+            data = cp_queue.front();
+            cp_queue.pop();
+            depth.store(cp_queue.size(), boost::memory_order_relaxed);
+            mu.unlock();
+            cond_not_full.notify_all();
+            return true;
+        }
+
         bool is_full() const {
             return cp_queue.size() >= max_size;
         }
@@ -122,8 +248,17 @@ class ConsumerProducerQueue {
             return cp_queue.size() <= 0;
         }
 
+        // safe to call without holding the lock (e.g. for the stats)
         unsigned int size() const {
-            return cp_queue.size();
+            return depth.load(boost::memory_order_relaxed);
+        }
+
+        unsigned int capacity() const {
+            return max_size;
+        }
+
+        const char* backend_name() const {
+            return "Locking";
         }
 
         void clear() {
@@ -131,20 +266,59 @@ class ConsumerProducerQueue {
             while(!is_empty()) {
                 cp_queue.pop();
             }
+            depth.store(0, boost::memory_order_relaxed);
             mu.unlock();
             cond_not_full.notify_all();
         }
 
+        void close() {
+            mu.lock();
+            closed = true;
+            mu.unlock();
+            cond_not_full.notify_all();
+            cond_not_empty.notify_all();
+        }
 
-    private:
+        bool is_closed() const {
+            return closed;
+        }
 
-        static unsigned int millis(void) {
-            auto t = boost::chrono::high_resolution_clock::now();
-            return (unsigned int)(double(t.time_since_epoch().count()) / 1000000.00f);
+
+    private:
+        
+        bool offer_nonblocking(const data_t& data) {
+            mu.lock();
+            if(closed) {
+                mu.unlock();
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+            if(is_full() && this->policy == OverflowPolicy::DropNewest) {
+                mu.unlock();
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+            if(is_full() && this->policy == OverflowPolicy::OverwriteLatest && !is_empty()) {
+                cp_queue.back() = data;
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+            }
+            else {
+                while(is_full() && !is_empty()) {
+                    cp_queue.pop(); // DropOldest
+                    this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                }
+                cp_queue.push(data);
+                depth.store(cp_queue.size(), boost::memory_order_relaxed);
+            }
+            mu.unlock();
+            cond_not_empty.notify_all();
+            return true;
         }
 
         boost::mutex mu;
         boost::condition_variable_any cond_not_full, cond_not_empty;
         std::queue<data_t> cp_queue;
+        boost::atomic<unsigned int> depth{0}; // cp_queue.size(), updated under mu
         unsigned int max_size;
+        boost::atomic<bool> closed{false}; // set under mu
 };
\ No newline at end of file
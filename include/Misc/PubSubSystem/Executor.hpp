@@ -0,0 +1,284 @@
+#pragma once
+
+#include <deque>
+#include <queue>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "PeriodicTimer.hpp"
+#include "ThreadSched.hpp"
+#include "../Utility/Clock.hpp"
+
+/*
+ * Cooperative, rate-monotonic executor: runs the modules' work as short steps on a small fixed set of
+ * worker threads, instead of one pool thread per module looping forever.
+ *
+ *      Executor executor(2);
+ *      Executor::Task& pid = executor.add_periodic("PID_System", 500, [&]() { controller.step(); });
+ *      Executor::Task& ekf = executor.add_event("BallEKF", 60);
+ *      subscription = sub.on_message(callback, ekf);                   // event-triggered steps
+ *
+ * A Task is the unit of scheduling, typically one per module: its steps never run concurrently with each
+ * other (like a ThreadPool::Strand), posted ones run in order. Whenever a worker is free it picks the
+ * ready task with the highest rate (rate-monotonic priority), ties in the order they became ready.
+ * Steps are never preempted, so a step should return within a fraction of the shortest period, a
+ * blocking call (socket read, pop_msg() without timeout...) holds a worker for its whole duration.
+ *
+ * Periodic steps are released on absolute deadlines of the current clock (check Clock.hpp), a step still
+ * pending or running at its next release counts as an overrun and the missed releases are skipped,
+ * same as PeriodicTimer, whose stats (dump_loop_stats()) they share.
+ * Tasks are owned by the executor, which must outlive the subscriptions posting to them. A cancelled task
+ * (e.g. of a stopped module) stays there inert, a restarted module adds new ones.
+ * The workers' scheduling attributes (real-time priority, CPUs...) are given at construction, check ThreadSched.
+ */
+class Executor {
+    public:
+        class Task {
+            public:
+                // post a step, e.g. by ITPS::Subscriber::on_message()
+                template<class Function>
+                void execute(Function func) {
+                    executor.post(this, boost::function<void()>(func));
+                }
+
+                const std::string& name() const {
+                    return task_name;
+                }
+
+                /* stop the task for good: no more periodic releases, the posted steps not started yet are dropped
+                 * and later ones ignored. Then wait for a step in progress to complete, unless called from it
+                 */
+                void cancel() {
+                    executor.cancel(this);
+                }
+
+                Task(const Task&) = delete;
+                Task& operator=(const Task&) = delete;
+
+            private:
+                friend class Executor;
+
+                Task(Executor& executor, const std::string& name, double priority)
+                    : executor(executor), task_name(name), priority(priority), period_ns(0), next_release_ns(NO_RELEASE),
+                      release_ns(0), stats(nullptr), step_pending(false), queued(false), running(false), cancelled(false) {}
+
+                Executor& executor;
+                const std::string task_name;
+                const double priority;
+                std::deque< boost::function<void()> > funcs; // posted steps
+
+                // periodic step, period_ns = 0 if none
+                boost::function<void()> step;
+                uint64_t period_ns, next_release_ns, release_ns;
+                LoopStats* stats;
+                bool step_pending; // released but not started yet
+
+                bool queued, running, cancelled;
+        };
+
+        // sched: of every worker, named after sched.name + its index
+        Executor(unsigned int num_workers, const ThreadSched& sched = ThreadSched("executor"))
+            : stopping(false), next_seq(0), num_runs(0) {
+            if(num_workers == 0) throw std::runtime_error("Executor: needs at least one worker thread");
+            for(unsigned int i = 0; i < num_workers; i++) {
+                ThreadSched worker_sched = sched;
+                worker_sched.name += std::to_string(i);
+                workers.create_thread(boost::bind(&Executor::work, this, worker_sched));
+            }
+        }
+
+        // a step in progress completes, the pending ones are dropped
+        ~Executor() {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                stopping = true;
+            }
+            cond.notify_all();
+            workers.join_all();
+            for(Task* task: tasks) delete task;
+        }
+
+        /* a task running step every 1/rate_hz, the first time start_delay_ms from now, at priority rate_hz.
+         * name: the loop's entry in dump_loop_stats(). Steps can also be posted to it with execute()
+         */
+        Task& add_periodic(const std::string& name, double rate_hz, boost::function<void()> step,
+                           unsigned int start_delay_ms = 0) {
+            Task* task = add_task(name, rate_hz);
+            uint64_t period_ns = (uint64_t)(1e9 / rate_hz + 0.5);
+            LoopStats& stats = LoopStatsRegistry::instance().loop(name, period_ns);
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                task->step = step;
+                task->period_ns = period_ns;
+                task->stats = &stats;
+                task->next_release_ns = current_clock().deadline_after_ms(start_delay_ms);
+                periodic.push_back(task);
+            }
+            cond.notify_all(); // the workers may be waiting for a later release
+            return *task;
+        }
+
+        // a task only running the steps posted with execute(), rate_hz: its priority, the rate they're expected at
+        Task& add_event(const std::string& name, double rate_hz) {
+            return *add_task(name, rate_hz);
+        }
+
+        unsigned int num_workers() {
+            return workers.size();
+        }
+
+        // CUMULATIVE number of steps run, periodic & posted
+        uint64_t num_steps() const {
+            return num_runs.load(boost::memory_order_relaxed);
+        }
+
+    private:
+        static const uint64_t NO_RELEASE = UINT64_MAX;
+
+        struct Ready {
+            double priority;
+            uint64_t seq;
+            Task* task;
+        };
+
+        // the top of the queue runs first: highest rate, then the one ready for the longest
+        struct ReadyOrder {
+            bool operator()(const Ready& a, const Ready& b) const {
+                if(a.priority != b.priority) return a.priority < b.priority;
+                return a.seq > b.seq;
+            }
+        };
+
+        Task* add_task(const std::string& name, double rate_hz) {
+            if(!(rate_hz > 0.0)) throw std::runtime_error("Executor: the rate of a task must be positive");
+            boost::lock_guard<boost::mutex> lock(mutex);
+            tasks.push_back(new Task(*this, name, rate_hz));
+            return tasks.back();
+        }
+
+        void post(Task* task, boost::function<void()> func) {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if(task->cancelled) return;
+                task->funcs.push_back(func);
+                make_ready(task);
+            }
+            cond.notify_one();
+        }
+
+        void cancel(Task* task) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            task->cancelled = true;
+            task->funcs.clear();
+            task->step_pending = false;
+            periodic.erase(std::remove(periodic.begin(), periodic.end(), task), periodic.end());
+            if(running_task() == task) return; // cancelled by its own step
+            while(task->running) step_done.wait(lock);
+        }
+
+        // the task whose step the calling worker is running, nullptr outside of the workers
+        static Task*& running_task() {
+            static thread_local Task* task = nullptr;
+            return task;
+        }
+
+        // with the mutex held
+        void make_ready(Task* task) {
+            if(task->queued || task->running) return; // picked up again once it's done
+            task->queued = true;
+            ready.push(Ready{task->priority, next_seq++, task});
+        }
+
+        // release the periodic steps due by now, return the next release time, with the mutex held
+        uint64_t release_due(uint64_t now) {
+            uint64_t next = NO_RELEASE;
+            for(Task* task: periodic) {
+                if(task->next_release_ns <= now) {
+                    uint64_t missed = (now - task->next_release_ns) / task->period_ns; // releases skipped entirely
+                    uint64_t release = task->next_release_ns + missed * task->period_ns;
+                    if(task->step_pending || task->running) {
+                        missed++; // the previous one hasn't completed, this release merges into it
+                    }
+                    if(missed > 0) {
+                        task->stats->num_overruns.fetch_add(1, boost::memory_order_relaxed);
+                        task->stats->num_skipped_periods.fetch_add(missed, boost::memory_order_relaxed);
+                    }
+                    task->release_ns = release;
+                    task->step_pending = true;
+                    task->next_release_ns = release + task->period_ns;
+                    make_ready(task);
+                }
+                next = std::min(next, task->next_release_ns);
+            }
+            return next;
+        }
+
+        void work(const ThreadSched& sched) {
+            sched.apply();
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while(!stopping) {
+                Clock& clock = current_clock();
+                uint64_t now = clock.now_ns();
+                uint64_t next_release = release_due(now);
+                if(ready.empty()) {
+                    if(next_release == NO_RELEASE) cond.wait(lock);
+                    else clock.wait_until(cond, lock, next_release);
+                    continue;
+                }
+
+                Task* task = ready.top().task;
+                ready.pop();
+                task->queued = false;
+                if(task->cancelled) continue; // queued before it got cancelled
+                task->running = true;
+                if(!ready.empty()) cond.notify_one(); // more work for another worker
+
+                bool periodic_step = task->step_pending;
+                boost::function<void()> func;
+                if(periodic_step) {
+                    task->step_pending = false;
+                    func = task->step;
+                    task->stats->lateness.record(now > task->release_ns ? now - task->release_ns : 0);
+                }
+                else {
+                    func.swap(task->funcs.front());
+                    task->funcs.pop_front();
+                }
+
+                lock.unlock();
+                running_task() = task;
+                func();
+                running_task() = nullptr;
+                uint64_t end = clock.now_ns();
+                lock.lock();
+
+                if(periodic_step) {
+                    task->stats->run_time.record(end - now);
+                    task->stats->num_cycles.fetch_add(1, boost::memory_order_relaxed);
+                }
+                num_runs.fetch_add(1, boost::memory_order_relaxed);
+                task->running = false;
+                if(task->cancelled) step_done.notify_all();
+                else if(task->step_pending || !task->funcs.empty()) make_ready(task);
+            }
+        }
+
+        boost::mutex mutex;
+        boost::condition_variable_any cond; // new ready work or a new periodic step, with mutex
+        boost::condition_variable_any step_done; // the step of a cancelled task completed, with mutex
+        bool stopping;
+        std::vector<Task*> tasks;    // all of them, owned
+        std::vector<Task*> periodic; // those with a periodic step
+        std::priority_queue<Ready, std::vector<Ready>, ReadyOrder> ready;
+        uint64_t next_seq;
+        boost::atomic<uint64_t> num_runs;
+        boost::thread_group workers;
+};
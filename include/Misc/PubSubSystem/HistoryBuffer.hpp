@@ -0,0 +1,152 @@
+/*
+ * Time-indexed message history for the NonBlocking ("NB") ITPS channels
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono.hpp>
+#include "MsgPool.hpp"
+#include "../Utility/Clock.hpp"
+
+namespace ITPS {
+
+    // monotonic timestamp in nanoseconds, unrelated to the wall clock
+    typedef uint64_t timestamp_t;
+
+    // on the current clock, check Clock.hpp
+    inline timestamp_t now_ns() {
+        return current_clock().now_ns();
+    }
+
+    /* How HistoryBuffer::at_time() blends the 2 msgs around the queried time,
+     * alpha = 0 means a, alpha = 1 means b.
+     * The default picks the nearer msg, arithmetic types are interpolated linearly,
+     * specialize it for a msg type to interpolate it properly (check MotionEkfModule.hpp for an example)
+     */
+    template <typename T, typename Enable = void>
+    struct Interpolator {
+        static T apply(const T& a, const T& b, double alpha) {
+            return alpha < 0.5 ? a : b;
+        }
+    };
+
+    template <typename T>
+    struct Interpolator<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+        static T apply(const T& a, const T& b, double alpha) {
+            return (T)(a + (b - a) * alpha);
+        }
+    };
+
+
+    /*
+     * Fixed ring of the last N msgs, each stamped with a monotonic timestamp
+     *
+     *  * Writers (the publishers of the channel) are serialized by a spin flag, like LatestValueBuffer.
+     *    Each entry is built in a buffer recycled by a MsgPool, then installed with an atomic
+     *    shared_ptr store, so the writer allocates nothing in the steady state.
+     *  * Readers take atomic shared_ptr loads of the entries and never block the writer, an entry
+     *    stays valid for as long as a reader holds it even if the ring moves on meanwhile. Each entry
+     *    carries its sequence number, so a reader notices when a slot got overwritten under its feet
+     *    and simply stops there (the older history is gone by then).
+     */
+    template <typename data_t>
+    class HistoryBuffer {
+        public:
+            struct Stamped {
+                timestamp_t stamp;
+                data_t data;
+                uint64_t seq; // index of the write
+            };
+
+            HistoryBuffer(unsigned int capacity) : slots(capacity > 0 ? capacity : 1),
+                                                   pool(slots.size() + 2), num_writes(0), last_stamp(0) {}
+
+            // timestamps must be monotonic, an older one is clamped to the newest one in the ring
+            void append(timestamp_t stamp, const data_t& data) {
+                while(write_flag.test_and_set(boost::memory_order_acquire)) {
+                    boost::this_thread::yield();
+                }
+
+                uint64_t seq = num_writes.load(boost::memory_order_relaxed);
+                if(stamp < last_stamp) stamp = last_stamp;
+                last_stamp = stamp;
+
+                boost::shared_ptr<Stamped> entry = pool.acquire();
+                entry->stamp = stamp;
+                entry->data = data;
+                entry->seq = seq;
+                boost::atomic_store(&slots[seq % slots.size()], boost::shared_ptr<const Stamped>(entry));
+                num_writes.store(seq + 1, boost::memory_order_release);
+
+                write_flag.clear(boost::memory_order_release);
+            }
+
+            /* the msg at time t, interpolated between the 2 msgs around t
+             * returns false (and leaves out untouched) if the ring is empty,
+             * or if t is older than the whole ring (out = oldest msg)
+             * if t is newer than the newest msg, out = newest msg (no extrapolation)
+             */
+            bool at_time(timestamp_t t, data_t& out) const {
+                boost::shared_ptr<const Stamped> newer;
+                uint64_t n = num_writes.load(boost::memory_order_acquire);
+                for(uint64_t i = n; i > 0 && n - i < slots.size(); i--) {
+                    boost::shared_ptr<const Stamped> entry = load(i - 1);
+                    if(!entry) break; // overwritten, the older history is gone
+                    if(entry->stamp <= t) {
+                        if(!newer || newer->stamp == entry->stamp) {
+                            out = entry->data;
+                        }
+                        else {
+                            double alpha = double(t - entry->stamp) / double(newer->stamp - entry->stamp);
+                            out = Interpolator<data_t>::apply(entry->data, newer->data, alpha);
+                        }
+                        return true;
+                    }
+                    newer = entry;
+                }
+                if(newer) out = newer->data; // t predates the history
+                return false;
+            }
+
+            // msgs stamped within [t0, t1], in chronological order
+            std::vector<Stamped> range(timestamp_t t0, timestamp_t t1) const {
+                std::vector<Stamped> rtn;
+                uint64_t n = num_writes.load(boost::memory_order_acquire);
+                for(uint64_t i = n; i > 0 && n - i < slots.size(); i--) {
+                    boost::shared_ptr<const Stamped> entry = load(i - 1);
+                    if(!entry || entry->stamp < t0) break;
+                    if(entry->stamp <= t1) rtn.push_back(*entry);
+                }
+                return std::vector<Stamped>(rtn.rbegin(), rtn.rend());
+            }
+
+            bool empty() const {
+                return num_writes.load(boost::memory_order_acquire) == 0;
+            }
+
+            unsigned int capacity() const {
+                return slots.size();
+            }
+
+        private:
+            // nullptr if the slot no longer holds write #seq
+            boost::shared_ptr<const Stamped> load(uint64_t seq) const {
+                boost::shared_ptr<const Stamped> entry = boost::atomic_load(&slots[seq % slots.size()]);
+                if(!entry || entry->seq != seq) return boost::shared_ptr<const Stamped>();
+                return entry;
+            }
+
+            std::vector< boost::shared_ptr<const Stamped> > slots; // only accessed via atomic_load/store
+            MsgPool<Stamped> pool;           // only touched by the writer holding write_flag
+            boost::atomic<uint64_t> num_writes;
+            timestamp_t last_stamp;          // only touched by the writer holding write_flag
+            boost::atomic_flag write_flag = BOOST_ATOMIC_FLAG_INIT;
+    };
+
+}
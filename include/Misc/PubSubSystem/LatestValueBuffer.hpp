@@ -0,0 +1,128 @@
+/*
+ * Latest-value buffer used as the backing store of the NonBlocking ("NB") ITPS channels
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+/* A generalized triple buffer: a small array of preallocated slots, one of them is "current".
+ *
+ *  * Writers copy the new value into a slot that is neither current nor pinned by any reader,
+ *    then publish it by swapping the current index. Writers are serialized among themselves
+ *    by a spin flag, but never wait on a reader unless every non-current slot is pinned at the
+ *    same time (needs num_slots - 1 readers lingering on stale slots, practically never happens).
+ *  * Readers pin the current slot with a reference count and re-check that it is still current,
+ *    then copy the value out. Readers never block, they only retry when a publish lands in
+ *    between the 2 loads of the current index.
+ *
+ * Unlike a plain seqlock, a slot is never written while somebody is reading it, so this is also
+ * safe for non trivially-copyable messages (arma::vec, protobuf messages, ...) whose copy
+ * involves heap pointers.
+ *
+ * Every write stamps the slot with a monotonically increasing version number (starting from 1),
+ * a value installed with reset() has version 0, which means "nothing has been written yet".
+ * A write may also attach a small tag_t (e.g. the ITPS trace context) that is read together with the value.
+ */
+struct LatestValueBufferNoTag {};
+
+template <typename data_t, typename tag_t = LatestValueBufferNoTag, unsigned int num_slots = 4>
+class LatestValueBuffer {
+    static_assert(num_slots >= 3, "LatestValueBuffer needs at least 3 slots");
+
+    public:
+        LatestValueBuffer() : current(0), latest_version(0), num_writes(0) {
+            for(unsigned int i = 0; i < num_slots; i++) {
+                slots[i].readers.store(0);
+                slots[i].version = 0;
+            }
+        }
+
+        void write(const data_t& data, const tag_t& tag = tag_t()) {
+            install(data, tag, true);
+        }
+
+        /* install a (default) value without counting it as a write, i.e. version goes back to 0 */
+        void reset(const data_t& data) {
+            install(data, tag_t(), false);
+        }
+
+        data_t read() {
+            uint64_t msg_version;
+            return read(msg_version);
+        }
+
+        /* read the value together with the version number it was written with */
+        data_t read(uint64_t& msg_version) {
+            tag_t tag;
+            return read(msg_version, tag);
+        }
+
+        /* same as above, also returns the tag the value was written with */
+        data_t read(uint64_t& msg_version, tag_t& tag) {
+            while(true) {
+                unsigned int idx = current.load(boost::memory_order_seq_cst);
+                Slot& slot = slots[idx];
+                slot.readers.fetch_add(1, boost::memory_order_seq_cst);
+
+                // the slot might have been retired (and is about to be rewritten) before it got pinned
+                if(current.load(boost::memory_order_seq_cst) == idx) {
+                    data_t rtn = slot.data;
+                    msg_version = slot.version;
+                    tag = slot.tag;
+                    slot.readers.fetch_sub(1, boost::memory_order_release);
+                    return rtn;
+                }
+                slot.readers.fetch_sub(1, boost::memory_order_release);
+            }
+        }
+
+        /* version of the latest write, cheap to poll without copying the value */
+        uint64_t version() const {
+            return latest_version.load(boost::memory_order_seq_cst);
+        }
+
+    private:
+        struct alignas(64) Slot { // one slot per cache line to avoid false sharing between readers
+            boost::atomic<unsigned int> readers;
+            uint64_t version;
+            tag_t tag;
+            data_t data;
+        };
+
+        void install(const data_t& data, const tag_t& tag, bool count_as_write) {
+            while(write_flag.test_and_set(boost::memory_order_acquire)) {
+                boost::this_thread::yield(); // another writer is copying, they are short
+            }
+
+            unsigned int curr = current.load(boost::memory_order_relaxed);
+            unsigned int idx = curr;
+            while(true) {
+                idx = (idx + 1) % num_slots;
+                if(idx == curr) {
+                    boost::this_thread::yield(); // every spare slot is pinned, very unlikely
+                    continue;
+                }
+                if(slots[idx].readers.load(boost::memory_order_seq_cst) == 0) {
+                    break;
+                }
+            }
+
+            uint64_t msg_version = count_as_write ? ++num_writes : 0;
+            slots[idx].data = data;
+            slots[idx].version = msg_version;
+            slots[idx].tag = tag;
+            current.store(idx, boost::memory_order_seq_cst);
+            latest_version.store(msg_version, boost::memory_order_seq_cst);
+
+            write_flag.clear(boost::memory_order_release);
+        }
+
+        Slot slots[num_slots];
+        boost::atomic<unsigned int> current;
+        boost::atomic<uint64_t> latest_version;
+        uint64_t num_writes; // only touched by the writer holding write_flag
+        boost::atomic_flag write_flag = BOOST_ATOMIC_FLAG_INIT;
+};
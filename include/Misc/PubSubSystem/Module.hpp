@@ -2,13 +2,72 @@
 #pragma once
  
 #include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "PubSub.hpp"
 #include "Observer.hpp"
 #include "ThreadPool.hpp"
+#include "PeriodicTimer.hpp"
+#include "Executor.hpp"
+#include "ThreadSched.hpp"
+#include "../Utility/BoostLogger.hpp"
 
+/* Modules constructed within a RobotScope belong to that robot: their ITPS topics live in the
+ * robot's namespace ("robot<id>/..."), check ITPS::Namespace, and robot_id() tells them which
+ * ports/devices to use. Without any RobotScope, a module is robot 0 in the global namespace.
+ */
+class RobotScope {
+    public:
+        RobotScope(unsigned int robot_id) : ns_scope("robot" + std::to_string(robot_id)), prev_robot(current()) {
+            current() = robot_id;
+        }
+
+        ~RobotScope() {
+            current() = prev_robot;
+        }
+
+        static unsigned int current_robot() {
+            return current();
+        }
+
+        RobotScope(const RobotScope&) = delete;
+        RobotScope& operator=(const RobotScope&) = delete;
+
+    private:
+        friend class Module;
+
+        static unsigned int& current() {
+            static thread_local unsigned int robot_id = 0;
+            return robot_id;
+        }
+
+        ITPS::NamespaceScope ns_scope;
+        unsigned int prev_robot;
+};
+
+
+/*
+ * Lifecycle of a module:
+ *
+ *  construct  the constructor creates the member publishers and declares the topics the module reads and
+ *             writes (reads<Topic>()/writes<Topic>()), main.cpp orders the startup by this dependency graph
+ *             (check ModuleGraph.hpp)
+ *  wire       init_subscribers() subscribes, waiting for the publishers created by task() of other modules
+ *  ready      wait_ready(): the inputs awaited with await_first_publish() have been published once, i.e. they
+ *             hold real data instead of their publisher's default value
+ *  run        schedule() hands steps to the executor, or task() loops on a thread of its own
+ *  stop       request_stop(): the loops see stop_requested(), the stop actions (on_stop(), StopCallback) cancel the
+ *             executor tasks & subscriptions and wake up the blocking calls, wait_stopped() joins. run() again
+ *             restarts the module on the same pool/executor threads, its publishers find their channels again
+ */
 class Module {
     public:
-        Module() {
+        Module() : robot(RobotScope::current_robot()), topic_namespace(ITPS::current_namespace()) {
 
         }
         ~Module() {
@@ -17,12 +76,62 @@ class Module {
 
         virtual void task() {}
         virtual void task(ThreadPool& thread_pool) {}
+
+        /* cooperative alternative to task(): wire the module, then hand its work to executor as periodic and/or
+         * event-triggered Tasks (check Executor) instead of looping on a thread of its own.
+         * Return false if the module can only run as task(), e.g. around blocking socket I/O
+         */
+        virtual bool schedule(Executor& executor) { return false; }
+
+        /* subscribe to the topics this module reads, called by task() before its loop starts.
+         * Public so a driver stepping the modules itself (e.g. the replay tool) can wire them without task()
+         */
+        virtual void init_subscribers() {}
+
+        /* scheduling attributes of the thread running task() (check ThreadSched), e.g. a real-time priority
+         * for a module on the control path, applied when the module starts. A pool thread gets the pool's back
+         * when task() returns. Not used by schedule(), its steps run with the executor's attributes
+         */
+        void set_sched(const ThreadSched& sched) {
+            task_sched = sched;
+            has_task_sched = true;
+        }
+
+        // keys ("topic.msg.mode", check ITPS::topic_key()) of the topics declared by the constructor
+        const std::vector<std::string>& input_topics() const {
+            return inputs;
+        }
+
+        const std::vector<std::string>& output_topics() const {
+            return outputs;
+        }
+
+        // non-blocking version of wait_ready(), for a driver stepping the module itself (e.g. the replay tool)
+        bool inputs_ready() const {
+            for(auto& input: awaited) {
+                if(input.version() == 0) return false;
+            }
+            return true;
+        }
+
+        // the robot this module was constructed for
+        unsigned int robot_id() const {
+            return robot;
+        }
+
+        /* the namespace of its topics. The executor steps don't run within it, unlike task(), so they pass it
+         * explicitly where the current namespace matters, e.g. to an ITPS::GroupPublish
+         */
+        const ITPS::Namespace& module_namespace() const {
+            return topic_namespace;
+        }
         
         //======================Create New Thread Version=================================//
         /* create a new thread and run the module in that thread */
         void run() {
+            begin_run();
             mthread = boost::shared_ptr<boost::thread>(
-                new boost::thread(boost::bind(&Module::task, this))
+                new boost::thread(boost::bind(&Module::run_task, this))
             );
         }
         /* don't use this method if the threadpool version of Module::run() was used */
@@ -42,11 +151,257 @@ class Module {
         //============================Thread Pool Version=================================//
         /* run the module as a task to be queued for a thread pool*/
         void run(ThreadPool& thread_pool) {
-            thread_pool.execute(boost::bind(&Module::task, this, boost::ref(thread_pool)));
+            begin_run();
+            thread_pool.execute(boost::bind(&Module::run_pool_task, this, boost::ref(thread_pool)));
+        }
+        //================================================================================//
+
+
+
+
+        //============================Executor Version====================================//
+        /* run the module's steps on executor if it supports it (schedule()), as a thread pool task otherwise.
+         * The wiring runs on the pool either way, subscribing may wait for the publishers
+         */
+        void run(ThreadPool& thread_pool, Executor& executor) {
+            begin_run();
+            thread_pool.execute(boost::bind(&Module::run_scheduled, this, boost::ref(thread_pool), boost::ref(executor)));
+        }
+        //================================================================================//
+
+
+
+
+        //==========================Cooperative Cancellation==============================//
+        /* ask the module to stop and return right away: its loops see stop_requested(), its stop actions
+         * run on the calling thread. Thread-safe, no-op if already requested
+         */
+        void request_stop() {
+            boost::lock_guard<boost::mutex> lock(stop_mutex);
+            if(stop_flag.exchange(true)) return;
+            for(auto& action: stop_actions) action();
+            for(StopCallback* callback: stop_callbacks) callback->action();
+            stop_cond.notify_all();
+        }
+
+        bool stop_requested() const {
+            return stop_flag.load();
+        }
+
+        /* not running: never started, or task()/schedule() returned after request_stop(). A task() returning
+         * early (e.g. after setting up its callbacks) still counts as running until request_stop()
+         */
+        bool stopped() {
+            boost::lock_guard<boost::mutex> lock(stop_mutex);
+            return is_stopped();
+        }
+
+        // join, whichever version of run() was used
+        void wait_stopped() {
+            boost::unique_lock<boost::mutex> lock(stop_mutex);
+            while(!is_stopped()) stop_cond.wait(lock);
+        }
+
+        // same as above, return false if still running after timeout_ms (real time, the sockets don't wait on a simulated clock)
+        bool wait_stopped(unsigned int timeout_ms) {
+            boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() 
+                                                               + boost::chrono::milliseconds(timeout_ms);
+            boost::unique_lock<boost::mutex> lock(stop_mutex);
+            while(!is_stopped()) {
+                if(stop_cond.wait_until(lock, deadline) == boost::cv_status::timeout) return is_stopped();
+            }
+            return true;
         }
         //================================================================================//
 
+    protected:
+        /* stop action for the local resources of task() (sockets, io_service...), registered for the scope of
+         * this object. Runs right away if the stop was already requested. It must not call request_stop()
+         *
+         *      Module::StopCallback stop_cb(*this, [&]() { io_service.stop(); });
+         */
+        class StopCallback {
+            public:
+                StopCallback(Module& module, boost::function<void()> action) : module(module), action(action) {
+                    boost::lock_guard<boost::mutex> lock(module.stop_mutex);
+                    if(module.stop_flag.load()) this->action();
+                    else module.stop_callbacks.push_back(this);
+                }
+
+                ~StopCallback() {
+                    boost::lock_guard<boost::mutex> lock(module.stop_mutex);
+                    auto& callbacks = module.stop_callbacks;
+                    callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), this), callbacks.end());
+                }
+
+                StopCallback(const StopCallback&) = delete;
+                StopCallback& operator=(const StopCallback&) = delete;
+
+            private:
+                friend class Module;
+                Module& module;
+                boost::function<void()> action;
+        };
+
+        /* stop action for the members the module keeps across runs (its Executor tasks, subscriptions,
+         * BlockingSubscribers...), registered by the constructor, run by every request_stop()
+         */
+        void on_stop(boost::function<void()> action) {
+            boost::lock_guard<boost::mutex> lock(stop_mutex);
+            stop_actions.push_back(action);
+        }
+
+        /* set up what the on_stop() actions tear down (executor tasks, subscriptions, strands...) within this, from
+         * schedule()/task(): setup runs with the stop lock held, so a concurrent request_stop() sees either all of
+         * it or none. Skipped if the stop was already requested (the stop actions ran), return false then.
+         * setup must not call request_stop()
+         *
+         *      setup_unless_stopped([&]() { exec_task = &executor.add_periodic(...); });
+         */
+        bool setup_unless_stopped(boost::function<void()> setup) {
+            boost::lock_guard<boost::mutex> lock(stop_mutex);
+            if(stop_flag.load()) return false;
+            setup();
+            return true;
+        }
+
+        /* the module's loop at a declared rate: call step() every 1/rate_hz until request_stop(), on absolute
+         * deadlines (check PeriodicTimer) instead of a delay() after each step. name (qualified with the module's
+         * namespace) reports the loop's overruns & jitter in dump_loop_stats()
+         */
+        template <typename Step>
+        void run_periodic(const std::string& name, double rate_hz, Step step) {
+            PeriodicTimer timer(qualified_name(name), rate_hz);
+            timer.start();
+            while(!stop_requested()) {
+                step();
+                timer.wait();
+            }
+        }
+
+        template <typename Topic>
+        void reads() {
+            inputs.push_back(ITPS::topic_key<Topic>());
+        }
+
+        template <typename Topic>
+        void writes() {
+            outputs.push_back(ITPS::topic_key<Topic>());
+        }
+
+        // wait_ready() waits for sub's first publish, sub must be subscribed by then
+        template <typename Msg>
+        void await_first_publish(ITPS::NonBlockingSubscriber<Msg>& sub) {
+            AwaitedInput input;
+            input.sub_key = [&sub]() { return sub.key(); };
+            input.version = [&sub]() { return sub.latest_version(); };
+            input.wait = [&sub](unsigned int timeout_ms) { return sub.wait_for_update(0, timeout_ms); };
+            awaited.push_back(input);
+        }
+
+        /* block until every input awaited with await_first_publish() has been published once, without polling
+         * (the condition variable of NonBlockingSubscriber::wait_for_update()), logging the ones still missing
+         * every log_period_ms. Return false if the stop got requested in the meantime
+         */
+        bool wait_ready(B_Log& logger, unsigned int log_period_ms) {
+            for(auto& input: awaited) {
+                unsigned int waited_ms = 0;
+                while(!input.wait(STOP_CHECK_MS)) {
+                    if(stop_requested()) return false;
+                    waited_ms += STOP_CHECK_MS;
+                    if(waited_ms >= log_period_ms) {
+                        logger.log(Warning, "waiting for the first publish of " + input.sub_key());
+                        waited_ms = 0;
+                    }
+                }
+            }
+            return !stop_requested();
+        }
+
+        // name within the module's namespace, e.g. "robot1/PID_System", for the loop stats
+        std::string qualified_name(const std::string& name) const {
+            return topic_namespace.qualify(name);
+        }
+
     private:
+        static const unsigned int STOP_CHECK_MS = 100; // the blocking waits of wait_ready() see a stop request within this
+
+        struct AwaitedInput {
+            boost::function<std::string()> sub_key;
+            boost::function<uint64_t()> version;
+            boost::function<bool(unsigned int)> wait;
+        };
+
+        // a restart needs the previous run to be over
+        void begin_run() {
+            boost::lock_guard<boost::mutex> lock(stop_mutex);
+            if(!is_stopped()) {
+                throw std::runtime_error("Module: run() while still running, request_stop() and wait_stopped() first");
+            }
+            started = true;
+            running = true;
+            stop_flag.store(false);
+        }
+
+        void end_run() {
+            boost::lock_guard<boost::mutex> lock(stop_mutex);
+            running = false;
+            stop_cond.notify_all();
+        }
+
+        // with stop_mutex held
+        bool is_stopped() const {
+            return !running && (!started || stop_flag.load());
+        }
+
+        // the publishers/subscribers created by task() bind to the module's robot as well
+        void run_task() {
+            ITPS::NamespaceScope ns_scope(topic_namespace);
+            RobotScope::current() = robot;
+            if(has_task_sched) task_sched.apply();
+            task();
+            end_run();
+        }
+
+        void run_pool_task(ThreadPool& thread_pool) {
+            ITPS::NamespaceScope ns_scope(topic_namespace);
+            RobotScope::current() = robot;
+            run_pool_task_sched(thread_pool);
+            RobotScope::current() = 0; // the pool thread goes back to serving anyone
+            end_run();
+        }
+
+        void run_scheduled(ThreadPool& thread_pool, Executor& executor) {
+            ITPS::NamespaceScope ns_scope(topic_namespace);
+            RobotScope::current() = robot;
+            if(!schedule(executor)) run_pool_task_sched(thread_pool);
+            RobotScope::current() = 0;
+            end_run();
+        }
+
+        void run_pool_task_sched(ThreadPool& thread_pool) {
+            if(!has_task_sched) {
+                task(thread_pool);
+                return;
+            }
+            task_sched.apply();
+            task(thread_pool);
+            thread_pool.sched().apply();
+        }
+
         boost::shared_ptr<boost::thread> mthread;
+        unsigned int robot;
+        ITPS::Namespace topic_namespace;
+        ThreadSched task_sched;
+        bool has_task_sched = false;
+        std::vector<std::string> inputs, outputs;
+        std::vector<AwaitedInput> awaited;
+
+        boost::mutex stop_mutex;
+        boost::condition_variable_any stop_cond; // a run ended or the stop got requested, with stop_mutex
+        boost::atomic<bool> stop_flag{false};
+        bool started = false, running = false; // run() called at least once, task()/schedule() not returned yet
+        std::vector< boost::function<void()> > stop_actions;
+        std::vector<StopCallback*> stop_callbacks;
 
 };
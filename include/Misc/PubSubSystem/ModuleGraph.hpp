@@ -0,0 +1,80 @@
+#pragma once
+
+#include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+#include "Module.hpp"
+
+/*
+ * Startup order of the modules from the topics they declared (Module::input_topics()/output_topics()):
+ * the producers of a topic start before its consumers, so a consumer's wiring and first steps find their
+ * inputs already flowing instead of racing them.
+ *
+ *      std::vector< boost::shared_ptr<Module> > order = ModuleGraph(modules, {ITPS::topic_key<ConstsTopic>()}).order();
+ *
+ * Control loops close through the robot (commands => firmware => sensor data => control), so the graph has
+ * cycles: a cycle is entered at the module with the fewest producers left to start, first constructed first.
+ * An input nobody produces is a wiring error, thrown at construction instead of a subscriber waiting forever.
+ */
+class ModuleGraph {
+    public:
+        typedef boost::shared_ptr<Module> module_ptr;
+
+        /* external_topics: inputs published outside of the modules (e.g. by main.cpp),
+         * throw std::runtime_error if some declared input has no producer
+         */
+        ModuleGraph(const std::vector<module_ptr>& modules, const std::vector<std::string>& external_topics = {})
+            : modules(modules) {
+            std::map< std::string, std::vector<std::size_t> > producers;
+            for(std::size_t i = 0; i < modules.size(); i++) {
+                for(auto& key: modules[i]->output_topics()) producers[key].push_back(i);
+            }
+            std::set<std::string> external(external_topics.begin(), external_topics.end());
+
+            deps.resize(modules.size());
+            for(std::size_t i = 0; i < modules.size(); i++) {
+                for(auto& key: modules[i]->input_topics()) {
+                    auto it = producers.find(key);
+                    if(it == producers.end()) {
+                        if(external.count(key)) continue;
+                        throw std::runtime_error("ModuleGraph: no module publishes " + key + ", read by a module of robot "
+                                                 + std::to_string(modules[i]->robot_id()));
+                    }
+                    for(std::size_t p: it->second) {
+                        if(p != i) deps[i].insert(p);
+                    }
+                }
+            }
+        }
+
+        // topological order, cycles broken as described above
+        std::vector<module_ptr> order() const {
+            std::vector<module_ptr> rtn;
+            std::vector<bool> started(modules.size(), false);
+            for(std::size_t n = 0; n < modules.size(); n++) {
+                std::size_t next = modules.size(), next_pending = SIZE_MAX;
+                for(std::size_t i = 0; i < modules.size(); i++) {
+                    if(started[i]) continue;
+                    std::size_t pending = 0;
+                    for(std::size_t p: deps[i]) {
+                        if(!started[p]) pending++;
+                    }
+                    if(pending < next_pending) {
+                        next = i;
+                        next_pending = pending;
+                    }
+                }
+                started[next] = true;
+                rtn.push_back(modules[next]);
+            }
+            return rtn;
+        }
+
+    private:
+        std::vector<module_ptr> modules;
+        std::vector< std::set<std::size_t> > deps; // module => the modules whose outputs it reads
+};
@@ -0,0 +1,75 @@
+/*
+ * Zero-copy message delivery for large ITPS payloads
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/atomic.hpp>
+
+namespace ITPS {
+
+    /*
+     * Immutable shared message, use it as the Msg type of a channel to hand over a pointer
+     * instead of copying the whole message on every publish()/latest_msg()/pop_msg():
+     *
+     *      ITPS_BLOCKING_TOPIC(SensorDataTopic, ITPS::ConstMsgPtr<VF_Data>, "FirmClient", "InternalSensorData");
+     *
+     * Every subscriber receives the very same object, so it must never be modified once published,
+     * the const in the pointer type enforces that on the subscriber side.
+     */
+    template <typename Msg>
+    using ConstMsgPtr = boost::shared_ptr<const Msg>;
+
+
+    /*
+     * Recycles the buffers of ConstMsgPtr messages, so that publishing allocates nothing in the
+     * steady state (arma::vec and protobuf messages keep their heap storage when being overwritten)
+     *
+     *      boost::shared_ptr<VF_Data> data = pool.acquire();
+     *      data->ParseFromString(received); // fill it in place
+     *      pub.publish(data);               // subscribers get it as ConstMsgPtr<VF_Data>
+     *
+     * A buffer is handed out again once the pool holds the only reference left to it, i.e. every
+     * subscriber/queue slot/LatestValueBuffer slot has let it go. If all buffers are still in use,
+     * the pool grows by one, so the pool size settles at the number of msgs in flight.
+     *
+     * Not thread-safe: a pool belongs to the thread that publishes with it.
+     */
+    template <typename Msg>
+    class MsgPool {
+        public:
+            MsgPool(unsigned int init_size = 8) : next(0) {
+                for(unsigned int i = 0; i < init_size; i++) {
+                    buffers.push_back(boost::make_shared<Msg>());
+                }
+            }
+
+            // a buffer nobody else references anymore, holding the content it was last published with
+            boost::shared_ptr<Msg> acquire() {
+                for(std::size_t n = 0; n < buffers.size(); n++) {
+                    next = (next + 1) % buffers.size();
+                    if(buffers[next].use_count() == 1) {
+                        // the last reader released it, its accesses happen-before our writes
+                        boost::atomic_thread_fence(boost::memory_order_acquire);
+                        return buffers[next];
+                    }
+                }
+                buffers.push_back(boost::make_shared<Msg>());
+                next = buffers.size() - 1;
+                return buffers[next];
+            }
+
+            std::size_t size() const {
+                return buffers.size();
+            }
+
+        private:
+            std::vector< boost::shared_ptr<Msg> > buffers;
+            std::size_t next;
+    };
+
+}
@@ -0,0 +1,106 @@
+/*
+ * Topic namespaces of the ITPS, to host several independent pipelines (e.g. robots) in one process
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+namespace ITPS {
+
+    /*
+     * Every publisher/subscriber is bound to the namespace that is current on its thread when it gets
+     * constructed: "topic_name" becomes "<namespace>/topic_name", so the same module classes can be
+     * instantiated once per robot without their channels colliding.
+     *
+     *      {
+     *          ITPS::NamespaceScope scope("robot3");
+     *          ekf.reset(new VirtualMotionEKF()); // publishes "robot3/MotionEKF.MotionData.NB"
+     *      }
+     *
+     * The global namespace (the default, empty name) keeps the plain keys, so a single-pipeline process
+     * behaves exactly as before. Topics declared with ITPS_SHARED_NONBLOCKING_TOPIC/ITPS_SHARED_BLOCKING_TOPIC
+     * always live in the global namespace, they are the ones shared by all the pipelines.
+     *
+     * Each namespace gets a small id, topic descriptors keep one lock-free channel slot per id
+     * (up to MAX_NAMESPACES, beyond that subscribers fall back to the channel table).
+     */
+    class Namespace {
+        public:
+            static const unsigned int MAX_NAMESPACES = 32;
+
+            Namespace() : ns_id(0) {} // global
+
+            Namespace(const std::string& name) : ns_name(name), ns_id(name.empty() ? 0 : register_name(name)) {}
+
+            static Namespace global() {
+                return Namespace();
+            }
+
+            const std::string& name() const {
+                return ns_name;
+            }
+
+            unsigned int id() const {
+                return ns_id;
+            }
+
+            bool is_global() const {
+                return ns_id == 0;
+            }
+
+            // applied to the topic names of the publishers/subscribers
+            std::string qualify(const std::string& topic_name) const {
+                return is_global() ? topic_name : ns_name + "/" + topic_name;
+            }
+
+        private:
+            static unsigned int register_name(const std::string& name) {
+                static boost::mutex mutex;
+                static std::vector<std::string> names(1); // id 0 is the global namespace
+                boost::lock_guard<boost::mutex> lock(mutex);
+                for(unsigned int i = 1; i < names.size(); i++) {
+                    if(names[i] == name) return i;
+                }
+                names.push_back(name);
+                return names.size() - 1;
+            }
+
+            std::string ns_name;
+            unsigned int ns_id;
+    };
+
+    namespace namespace_detail {
+        inline Namespace& current() {
+            static thread_local Namespace ns;
+            return ns;
+        }
+    }
+
+    inline Namespace current_namespace() {
+        return namespace_detail::current();
+    }
+
+    // RAII: makes ns the current namespace of this thread until the end of the scope
+    class NamespaceScope {
+        public:
+            NamespaceScope(const Namespace& ns) : prev(namespace_detail::current()) {
+                namespace_detail::current() = ns;
+            }
+
+            NamespaceScope(const std::string& name) : NamespaceScope(Namespace(name)) {}
+
+            ~NamespaceScope() {
+                namespace_detail::current() = prev;
+            }
+
+            NamespaceScope(const NamespaceScope&) = delete;
+            NamespaceScope& operator=(const NamespaceScope&) = delete;
+
+        private:
+            Namespace prev;
+    };
+
+}
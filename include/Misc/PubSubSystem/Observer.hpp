@@ -8,14 +8,20 @@
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/signals2.hpp>
 
-/* This implementation is not multithreaded-safe, 
- * for multithreaded-safe one, use the function pointer 
- * version of observer pattern in publisher_subscriber.hpp  
+/* Multithreaded-safe: observers may be added/removed while notifying,
+ * on_update() is called outside the lock, from the notifying thread.
+ * remove_observer() waits out the notifications already in progress, so a removed observer is never called once it
+ * returned (and may be destroyed). Called from an on_update(), it doesn't wait for the notification of its own thread.
+ * For notifications dispatched to a thread pool instead,
+ * use the callback subscriptions of the ITPS (on_message() in PubSub.hpp)
  * */
 
 
@@ -31,17 +37,66 @@ template<class Data>
 class Subject {
     public:
         void add_observer(Observer<Data>& obs) {
+            boost::lock_guard<boost::mutex> lock(observers_mutex);
             observers.push_back(&obs);
         }
 
+        void remove_observer(Observer<Data>& obs) {
+            boost::unique_lock<boost::mutex> lock(observers_mutex);
+            observers.erase(std::remove(observers.begin(), observers.end(), &obs), observers.end());
+            // the later notifications already miss obs
+            uint64_t removed_at = next_ticket;
+            boost::thread::id self = boost::this_thread::get_id();
+            while(std::any_of(notifiers.begin(), notifiers.end(), [&](const Notifier& n) {
+                      return n.ticket < removed_at && n.thread != self;
+                  })) {
+                notify_done.wait(lock);
+            }
+        }
+
         void notify_observers(Data data) {
-            for(auto& obs : observers) {
-                obs->on_update(data);
+            std::vector< Observer<Data>* > current;
+            uint64_t ticket;
+            {
+                boost::lock_guard<boost::mutex> lock(observers_mutex);
+                current = observers;
+                ticket = next_ticket++;
+                notifiers.push_back(Notifier{ticket, boost::this_thread::get_id()});
+            }
+            try {
+                for(auto& obs : current) {
+                    obs->on_update(data);
+                }
+            }
+            catch(...) {
+                end_notify(ticket);
+                throw;
             }
+            end_notify(ticket);
         }
 
     protected:
         std::vector< Observer<Data>* > observers;
+        boost::mutex observers_mutex;
+
+        // a notify_observers() call in progress
+        struct Notifier {
+            uint64_t ticket;
+            boost::thread::id thread;
+        };
+        std::vector<Notifier> notifiers;
+        uint64_t next_ticket = 0;
+        boost::condition_variable notify_done;
+
+    private:
+        void end_notify(uint64_t ticket) {
+            {
+                boost::lock_guard<boost::mutex> lock(observers_mutex);
+                notifiers.erase(std::find_if(notifiers.begin(), notifiers.end(),
+                                             [&](const Notifier& n) { return n.ticket == ticket; }));
+            }
+            notify_done.notify_all();
+        }
 };
 
 
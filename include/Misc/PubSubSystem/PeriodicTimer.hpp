@@ -0,0 +1,153 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdint>
+#include <stdexcept>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include "ChannelStats.hpp"
+#include "../Utility/Clock.hpp"
+
+// timing of one periodic loop, check PeriodicTimer
+class LoopStats {
+    public:
+        LoopStats(uint64_t period_ns) : period_ns(period_ns), num_cycles(0), num_overruns(0), num_skipped_periods(0) {}
+
+        const uint64_t period_ns;
+        boost::atomic<uint64_t> num_cycles;
+        boost::atomic<uint64_t> num_overruns;        // cycles that started after their deadline
+        boost::atomic<uint64_t> num_skipped_periods; // whole periods lost to overruns
+        ITPS::DurationHistogram lateness;            // cycle start - deadline, i.e. the wake-up jitter when on time
+        ITPS::DurationHistogram run_time;            // of the work done within a cycle
+};
+
+
+// name => loop stats, the mutex is only taken when a loop is registered and when dumping
+class LoopStatsRegistry {
+    public:
+        static LoopStatsRegistry& instance() {
+            static LoopStatsRegistry registry;
+            return registry;
+        }
+
+        /* the returned reference stays valid for the lifetime of the program,
+         * a loop restarted under the same name keeps counting into the same stats */
+        LoopStats& loop(const std::string& name, uint64_t period_ns) {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            LoopStats*& stats = loops[name];
+            if(stats == nullptr) stats = new LoopStats(period_ns); // never freed, loops live as long as the program
+            return *stats;
+        }
+
+        std::string dump() {
+            std::vector< std::pair<std::string, LoopStats*> > current;
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                current.assign(loops.begin(), loops.end());
+            }
+            std::ostringstream os;
+            for(auto& l: current) {
+                LoopStats& s = *l.second;
+                os << l.first << " period=" << s.period_ns / 1000 << "us"
+                   << " cycles=" << s.num_cycles.load(boost::memory_order_relaxed)
+                   << " overruns=" << s.num_overruns.load(boost::memory_order_relaxed)
+                   << " skipped=" << s.num_skipped_periods.load(boost::memory_order_relaxed)
+                   << " late_p50<" << s.lateness.percentile(0.5) / 1000 << "us"
+                   << " late_p99<" << s.lateness.percentile(0.99) / 1000 << "us"
+                   << " run_mean=" << s.run_time.mean() / 1000 << "us"
+                   << " run_p99<" << s.run_time.percentile(0.99) / 1000 << "us\n";
+            }
+            return os.str();
+        }
+
+    private:
+        LoopStatsRegistry() {}
+
+        boost::mutex mutex;
+        std::map<std::string, LoopStats*> loops;
+};
+
+inline std::string dump_loop_stats() {
+    return LoopStatsRegistry::instance().dump();
+}
+
+
+/*
+ * Paces a loop at a fixed rate on absolute deadlines (the clock_nanosleep(TIMER_ABSTIME) way):
+ *
+ *      PeriodicTimer timer("PID_System", 500);
+ *      timer.start();
+ *      while(1) {
+ *          step();
+ *          timer.wait(); // until start + n * 2 ms, however long step() took
+ *      }
+ *
+ * Unlike a delay(period) after the work, neither the run time of the work nor the wake-up latency
+ * shift the following deadlines, so the rate doesn't drift and the jitter doesn't accumulate.
+ * A cycle that overruns its deadline starts right away; one overrunning by whole periods skips
+ * them rather than running a burst of late cycles, and the deadlines keep their original phase.
+ * Both are counted in stats() (check dump_loop_stats()).
+ * Runs on the current clock (check Clock.hpp), captured by start().
+ */
+class PeriodicTimer {
+    public:
+        // name: the loop's entry in dump_loop_stats()
+        PeriodicTimer(const std::string& name, double rate_hz)
+            : period(rate_to_period(rate_hz)), loop_stats(LoopStatsRegistry::instance().loop(name, period)),
+              clock(&current_clock()), next_deadline(0), cycle_start(0) {}
+
+        // the first deadline is one period from now
+        void start() {
+            clock = &current_clock();
+            cycle_start = clock->now_ns();
+            next_deadline = cycle_start + period;
+        }
+
+        /* end of a cycle: sleep until the next deadline, return false if the cycle overran it,
+         * in which case the next cycle starts right away
+         */
+        bool wait() {
+            uint64_t now = clock->now_ns();
+            loop_stats.run_time.record(now - cycle_start);
+            loop_stats.num_cycles.fetch_add(1, boost::memory_order_relaxed);
+
+            uint64_t deadline = next_deadline;
+            bool on_time = now <= deadline;
+            if(on_time) {
+                clock->sleep_until_ns(deadline);
+                now = clock->now_ns();
+            }
+            else {
+                uint64_t skipped = (now - deadline) / period;
+                deadline += skipped * period; // the latest deadline missed, keeping the phase
+                loop_stats.num_overruns.fetch_add(1, boost::memory_order_relaxed);
+                loop_stats.num_skipped_periods.fetch_add(skipped, boost::memory_order_relaxed);
+            }
+            loop_stats.lateness.record(now > deadline ? now - deadline : 0);
+            next_deadline = deadline + period;
+            cycle_start = now;
+            return on_time;
+        }
+
+        uint64_t period_ns() const {
+            return period;
+        }
+
+        const LoopStats& stats() const {
+            return loop_stats;
+        }
+
+    private:
+        static uint64_t rate_to_period(double rate_hz) {
+            if(!(rate_hz > 0.0)) throw std::runtime_error("PeriodicTimer: the rate must be positive");
+            return (uint64_t)(1e9 / rate_hz + 0.5);
+        }
+
+        const uint64_t period;
+        LoopStats& loop_stats;
+        Clock* clock;
+        uint64_t next_deadline, cycle_start;
+};
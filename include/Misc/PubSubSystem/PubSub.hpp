@@ -14,15 +14,28 @@
 #include <boost/thread/thread.hpp>
 #include <boost/signals2.hpp>
 #include <exception>
+#include <typeinfo>
+#include <boost/core/demangle.hpp>
 #include "CpQueue.hpp"
+#include "RingBufferQueue.hpp"
+#include "LatestValueBuffer.hpp"
+#include "MsgPool.hpp"
+#include "HistoryBuffer.hpp"
+#include "PublishGroup.hpp"
+#include "Subscription.hpp"
+#include "ChannelStats.hpp"
+#include "Trace.hpp"
+#include "Namespace.hpp"
+#include "ShmTransport.hpp"
+#include "Recorder.hpp"
+#include "Topic.hpp"
 
 
 /* Synchronization for Reader/Writer problems */
-// get exclusive access
-#define ITPS_writer_lock(mutex) do { \
+// get exclusive access (no do{}while(0) here, the locks must live until the end of the caller's scope)
+#define ITPS_writer_lock(mutex) \
     boost::upgrade_lock<boost::shared_mutex> __writer_lock(mutex); \
-    boost::upgrade_to_unique_lock<boost::shared_mutex> __unique_writer_lock( __writer_lock ); \
-}while(0)
+    boost::upgrade_to_unique_lock<boost::shared_mutex> __unique_writer_lock( __writer_lock );
 // get shared access
 #define ITPS_reader_lock(mutex) boost::shared_lock<boost::shared_mutex>  __reader_lock(mutex); 
 
@@ -38,12 +51,14 @@ namespace ITPS {
 
     /*
      * 
-     *  * (NonBlocking Mode)Trivial Mode: msg channel only use 1 field to store the msg, every time a new msg
-     *      is sent from the publisher, the field gets overwritten, hence only the latest msg
-     *      is saved.
+     *  * (NonBlocking Mode)Trivial Mode: msg channel only keeps the latest msg, every time a new msg
+     *      is sent from the publisher, it overwrites the previous one. The msg is stored in a
+     *      lock-free LatestValueBuffer, so readers never block and never wait on writers.
+     *      Check LatestValueBuffer.hpp for implementation details.
      *  * (Blocking Mode)Message Queue Mode: use a MQ to store a series of msgs, MQ is instantiated by subscriber
-     *      Each subscriber gets its own MQ. When MQ is full, the publisher thread is suspended until
-     *      the queue is consumed(pop) by a subscriber to give room for new msgs. Check cp_queue.hpp 
+     *      Each subscriber gets its own MQ. By default, when MQ is full, the publisher thread is suspended until
+     *      the queue is consumed(pop) by a subscriber to give room for new msgs, a subscriber may pick 
+     *      another OverflowPolicy (drop newest/oldest, overwrite latest) instead. Check cp_queue.hpp 
      *      for implementation details of the consumer-producer queue.
      *      
      *  * MsgChannel utilizes a HashTable to manage messgaes
@@ -58,6 +73,20 @@ namespace ITPS {
      *        Similarly, when the queue is full, the publisher is blocked instead. 
      */
 
+    /* Implementation of a subscriber's message queue, picked at BlockingSubscriber construction:
+     *  * Locking: ConsumerProducerQueue, mutex + condition variables
+     *  * LockFree: RingBufferQueue, preallocated ring, no lock on the produce/consume fast path,
+     *      for the high-rate channels where contending on the queue mutex shows up in the latency.
+     *      Not with OverflowPolicy::OverwriteLatest, the constructor throws std::invalid_argument
+     */
+    enum class QueueBackend {Locking, LockFree};
+
+    /* per subscriber queue overflow behavior, check CpQueue.hpp */
+    using ::OverflowPolicy;
+
+    /* thrown by BlockingSubscriber::pop_msg() once unsubscribe() closed its queue, check CpQueue.hpp */
+    using ::QueueClosed;
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /* This class serves as a bridge between the Publisher class and the Subcribe class*/ 
@@ -68,83 +97,374 @@ namespace ITPS {
             // unordered map == hash map
             typedef std::unordered_map<std::string, MsgChannel<Msg>*> msg_table_t;
         public:
+            // Blocking Mode subscriber queues, the msgs travel with their trace context (check Trace.hpp)
+            typedef MessageQueue<Traced<Msg>> queue_t;
 
-            MsgChannel(std::string topic_name, std::string msg_name, std::string mode) {
-                ITPS_writer_lock(table_mutex);
+            MsgChannel(std::string topic_name, std::string msg_name, std::string mode) 
+                : topic_name(topic_name), msg_name(msg_name), mode(mode) {
                 this->key = topic_name + "." + msg_name + "." + mode;
                 // std::cout << key << std::endl;
-                
-                // if key doesn'Msg exist
-                if(msg_table.find(key) == msg_table.end()) {
-                    msg_table[key] = this;
+                bool registered = false;
+                {
+                    ITPS_writer_lock(table_mutex);
+                    // if key doesn'Msg exist
+                    if(msg_table.find(key) == msg_table.end()) {
+                        msg_table[key] = this;
+                        registered = true;
+                    }
+                }
+                if(registered) {
+                    ChannelRegistry::instance().add(boost::bind(&MsgChannel<Msg>::report, this));
                 }
+                trace_stats = &TraceRegistry::instance().hop(key);
+                // wake up the subscribers waiting for a matching publisher
+                table_cond.notify_all();
             }
 
             static MsgChannel *get_channel(std::string topic_name, std::string msg_name, std::string mode) {
                 ITPS_reader_lock(table_mutex);
                 std::string key = topic_name + "." + msg_name + "." + mode;
                 
+                auto it = msg_table.find(key);
                 // if key doesn'Msg exist
-                if(msg_table.find(key) == msg_table.end()) {
+                if(it == msg_table.end()) {
                     return nullptr;
                 }
-                return msg_table[key];
+                return it->second;
+            }
+
+            /* block (without spinning) until a publisher registers a channel with the matching key */
+            static MsgChannel *wait_for_channel(std::string topic_name, std::string msg_name, std::string mode) {
+                std::string key = topic_name + "." + msg_name + "." + mode;
+                boost::unique_lock<boost::shared_mutex> lock(table_mutex);
+                typename msg_table_t::iterator it;
+                while((it = msg_table.find(key)) == msg_table.end()) {
+                    table_cond.wait(lock);
+                }
+                return it->second;
+            }
+
+            /* same as above, return nullptr on timeout (unit: milliseconds) */
+            static MsgChannel *wait_for_channel(std::string topic_name, std::string msg_name, std::string mode, 
+                                                unsigned int timeout_ms) {
+                Clock& clock = current_clock();
+                uint64_t const deadline_ns = clock.deadline_after_ms(timeout_ms);
+                std::string key = topic_name + "." + msg_name + "." + mode;
+                boost::unique_lock<boost::shared_mutex> lock(table_mutex);
+                typename msg_table_t::iterator it;
+                while((it = msg_table.find(key)) == msg_table.end()) {
+                    if(!clock.wait_until(table_cond, lock, deadline_ns)) {
+                        it = msg_table.find(key);
+                        return it == msg_table.end() ? nullptr : it->second;
+                    }
+                }
+                return it->second;
+            }
+
+            /* the registered channel of the key, created (without any local publisher) if there's none yet,
+             * used by the shm importers. Never freed, same as the channels of the publishers in practice
+             */
+            static MsgChannel *get_or_create_channel(std::string topic_name, std::string msg_name, std::string mode) {
+                MsgChannel* channel = get_channel(topic_name, msg_name, mode);
+                if(channel != nullptr) return channel;
+                MsgChannel* created = new MsgChannel(topic_name, msg_name, mode); // registers itself, unless another thread was faster
+                channel = get_channel(topic_name, msg_name, mode);
+                if(channel != created) delete created;
+                return channel;
+            }
+
+            /* copy-on-write: publishers keep fanning out to the old list while it's being replaced */
+            void add_msg_queue(boost::shared_ptr<queue_t> queue) {
+                ITPS_writer_lock(msg_mutex); // serializes the writers of the list
+                boost::shared_ptr<queue_list_t> new_queues(new queue_list_t(*boost::atomic_load(&msg_queues)));
+                new_queues->push_back(queue);
+                boost::atomic_store(&msg_queues, boost::shared_ptr<const queue_list_t>(new_queues));
+            }
+
+            void remove_msg_queue(boost::shared_ptr<queue_t> queue) {
+                ITPS_writer_lock(msg_mutex);
+                boost::shared_ptr<queue_list_t> new_queues(new queue_list_t());
+                for(auto& q: *boost::atomic_load(&msg_queues)) {
+                    if(q != queue) new_queues->push_back(q);
+                }
+                boost::atomic_store(&msg_queues, boost::shared_ptr<const queue_list_t>(new_queues));
+            }
+
+            // callback subscriptions (on_message()), same copy-on-write scheme as the queues
+            void add_listener(boost::shared_ptr<MsgListener> listener) {
+                ITPS_writer_lock(msg_mutex);
+                boost::shared_ptr<listener_list_t> new_listeners(new listener_list_t(*boost::atomic_load(&listeners)));
+                new_listeners->push_back(listener);
+                boost::atomic_store(&listeners, boost::shared_ptr<const listener_list_t>(new_listeners));
             }
 
-            void add_msg_queue(boost::shared_ptr<ConsumerProducerQueue<Msg>> queue) {
-                ITPS_writer_lock(msg_mutex); 
-                msg_queues.push_back(queue);
+            void remove_listener(boost::shared_ptr<MsgListener> listener) {
+                ITPS_writer_lock(msg_mutex);
+                boost::shared_ptr<listener_list_t> new_listeners(new listener_list_t());
+                for(auto& l: *boost::atomic_load(&listeners)) {
+                    if(l != listener) new_listeners->push_back(l);
+                }
+                boost::atomic_store(&listeners, boost::shared_ptr<const listener_list_t>(new_listeners));
             }
 
+            // Non-blocking Mode, lock-free
+            void set_msg(const Msg& msg) {
+                set_msg(msg, now_ns());
+            }
 
-            /* deprecated, no longer integrate observer pattern into this implementation
-            void add_slot(boost::function<void(Msg)> callback_function) {
-                callback_funcs.push_back(callback_function);
-            }*/
+            // Non-blocking Mode, stamp is only used by the history, if enabled
+            void set_msg(const Msg& msg, timestamp_t stamp) {
+                message.write(msg, trace_publish());
+                stats.record_publish(stamp);
+                if(recording()) record(msg, stamp);
+                ShmEndpoint<Msg>* out = shm_export.load(boost::memory_order_acquire);
+                if(out) out->publish(msg);
+                boost::shared_ptr<HistoryBuffer<Msg>> hist = boost::atomic_load(&history);
+                if(hist) hist->append(stamp, msg);
+                notify_update();
+                notify_listeners();
+            }
 
-            // Non-blocking Mode
-            void set_msg(Msg msg) {
+            // Non-blocking Mode, also keep the last history_size msgs with their timestamps
+            void enable_history(unsigned int history_size) {
                 ITPS_writer_lock(msg_mutex);
-                message = msg;
+                if(boost::atomic_load(&history)) return; // the first publisher decides
+                boost::atomic_store(&history, boost::shared_ptr<HistoryBuffer<Msg>>(new HistoryBuffer<Msg>(history_size)));
+            }
+
+            // Non-blocking Mode, nullptr if no publisher enabled the history
+            boost::shared_ptr<HistoryBuffer<Msg>> get_history() {
+                return boost::atomic_load(&history);
             }
 
-            // Non-blocking Mode
+            // Non-blocking Mode, the PublishGroup this channel's msgs are published with, check PublishGroup.hpp
+            void set_group(PublishGroup* publish_group) {
+                group.store(publish_group);
+            }
+
+            // Non-blocking Mode, nullptr if not part of a group
+            PublishGroup* get_group() {
+                return group.load();
+            }
+
+            // Non-blocking Mode, install the publisher's default msg, which doesn't count as a publish (version 0)
+            void reset_msg(const Msg& msg) {
+                message.reset(msg);
+            }
+
+            // Non-blocking Mode, lock-free
             Msg get_msg() { 
-                ITPS_reader_lock(msg_mutex);
-                return this->message;
+                uint64_t version;
+                return get_msg(version);
+            }
+
+            // Non-blocking Mode, lock-free, also returns the version number of the msg
+            Msg get_msg(uint64_t& version) { 
+                ShmEndpoint<Msg>* in = shm_import.load(boost::memory_order_acquire);
+                if(in) return in->read(version);
+                TraceContext trace;
+                Msg rtn = message.read(version, trace);
+                adopt_trace(trace); // no-op for untraced msgs
+                return rtn;
+            }
+
+            // Non-blocking Mode, number of publishes so far, 0 if only the default msg is there
+            uint64_t get_version() {
+                ShmEndpoint<Msg>* in = shm_import.load(boost::memory_order_acquire);
+                if(in) return in->version();
+                return message.version();
+            }
+
+            /* Non-blocking Mode: block until the version number becomes greater than last_seen
+             * return false on timeout (unit: milliseconds)
+             */
+            bool wait_for_update(uint64_t last_seen, unsigned int timeout_ms) {
+                ShmEndpoint<Msg>* in = shm_import.load(boost::memory_order_acquire);
+                if(in) return in->wait_for_update(last_seen, timeout_ms);
+                if(message.version() > last_seen) return true; // fast path, lock-free
+
+                Clock& clock = current_clock();
+                uint64_t const deadline_ns = clock.deadline_after_ms(timeout_ms);
+                bool updated = true;
+                num_waiters.fetch_add(1);
+                update_mutex.lock();
+                while(message.version() <= last_seen) {
+                    if(!clock.wait_until(update_cond, update_mutex, deadline_ns)) {
+                        updated = message.version() > last_seen;
+                        break;
+                    }
+                }
+                update_mutex.unlock();
+                num_waiters.fetch_sub(1);
+                return updated;
             }
             
-            // Blocking Mode
+            /* Blocking Mode
+             * fan-out works on a snapshot of the subscriber list, no channel-wide lock is held while a 
+             * queue is full. Each queue applies its own OverflowPolicy, so only a subscriber with 
+             * OverflowPolicy::Block can hold the publisher back, other policies never wait.
+             */
             void enqueue_msg(Msg msg) {
-                ITPS_writer_lock(msg_mutex);
+                boost::shared_ptr<const queue_list_t> queues = boost::atomic_load(&msg_queues);
+                timestamp_t stamp = now_ns();
+                stats.record_publish(stamp);
+                Traced<Msg> traced{std::move(msg), trace_publish()};
+                if(recording()) record(traced.data, stamp);
                 
                 /* enqueue MQ */
-                for(auto& queue: msg_queues) {
-                    queue->produce(msg); // it will block the publisher's thread if the queue is full
+                for(auto& queue: *queues) {
+                    queue->offer(traced); 
                 }
+                ShmEndpoint<Msg>* out = shm_export.load(boost::memory_order_acquire);
+                if(out) out->publish(traced.data);
+                notify_listeners();
             }
 
             // Blocking Mode
             void enqueue_msg(Msg msg, unsigned int timeout_ms) {
-                ITPS_writer_lock(msg_mutex);
+                boost::shared_ptr<const queue_list_t> queues = boost::atomic_load(&msg_queues);
+                timestamp_t stamp = now_ns();
+                stats.record_publish(stamp);
+                Traced<Msg> traced{std::move(msg), trace_publish()};
+                if(recording()) record(traced.data, stamp);
+
                 /* timed enqueue MQ */
-                for(auto& queue: msg_queues) {
-                    queue->produce(msg, timeout_ms); // if timed out, it won'Msg block
+                for(auto& queue: *queues) {
+                    queue->offer(traced, timeout_ms); // if timed out, it won't block
                 }
+                ShmEndpoint<Msg>* out = shm_export.load(boost::memory_order_acquire);
+                if(out) out->publish(traced.data);
+                notify_listeners();
             }
 
 
+            /* mirror every publish of this channel into a shared-memory segment other processes can import,
+             * check ShmTransport.hpp. queue_capacity: 0 for a NonBlocking topic. The first exporter decides.
+             */
+            void export_shm(unsigned int queue_capacity) {
+                ITPS_writer_lock(msg_mutex);
+                if(shm_export.load() != nullptr || shm_import.load() != nullptr) return;
+                boost::shared_ptr<ShmTopic<Msg>> topic = ShmTopic<Msg>::create(key, queue_capacity);
+                if(queue_capacity == 0 && message.version() > 0) topic->write(message.read()); // catch up
+                shm_endpoint = topic;
+                shm_export.store(topic.get(), boost::memory_order_release);
+            }
+
+            /* Non-blocking Mode: serve the reads of this channel from the segment exported by another process
+             * (don't publish locally to an imported channel). No-op if this process exports the channel itself.
+             */
+            void import_shm(boost::shared_ptr<ShmEndpoint<Msg>> endpoint) {
+                ITPS_writer_lock(msg_mutex);
+                if(shm_export.load() != nullptr || shm_import.load() != nullptr) return;
+                shm_endpoint = endpoint;
+                shm_import.store(endpoint.get(), boost::memory_order_release);
+            }
+
+            bool is_shm_import() {
+                return shm_import.load() != nullptr;
+            }
+
+            // snapshot of the counters of this channel & its subscriber queues, check ChannelStats.hpp
+            ChannelReport report() {
+                ChannelReport r;
+                r.key = key;
+                r.topic_name = topic_name;
+                r.msg_name = msg_name;
+                r.mode = mode;
+                r.msg_type = boost::core::demangle(typeid(Msg).name());
+                r.num_publishes = stats.publishes();
+                r.rate_hz = stats.rate_hz();
+                timestamp_t last = stats.last_publish_time();
+                r.last_publish_age_ms = last == 0 ? -1.0 : double(now_ns() - last) / 1e6;
+                r.num_listeners = boost::atomic_load(&listeners)->size();
+                ShmEndpoint<Msg>* out = shm_export.load();
+                r.transport = out != nullptr ? "shm-export" : (shm_import.load() != nullptr ? "shm-import" : "");
+                r.shm_dropped = out != nullptr ? out->num_dropped() : 0;
+                for(auto& queue: *boost::atomic_load(&msg_queues)) {
+                    QueueStats& q = queue->stats();
+                    QueueReport qr;
+                    qr.backend = queue->backend_name();
+                    qr.overflow_policy = overflow_policy_name(queue->overflow_policy());
+                    qr.depth = queue->size();
+                    qr.capacity = queue->capacity();
+                    qr.num_dropped = q.num_dropped.load(boost::memory_order_relaxed);
+                    qr.num_publish_timeouts = q.num_publish_timeouts.load(boost::memory_order_relaxed);
+                    qr.num_consume_timeouts = q.num_consume_timeouts.load(boost::memory_order_relaxed);
+                    qr.num_waits = q.consume_wait.count();
+                    qr.wait_p50_ns = q.consume_wait.percentile(0.5);
+                    qr.wait_p99_ns = q.consume_wait.percentile(0.99);
+                    qr.wait_max_ns = q.consume_wait.percentile(1.0);
+                    r.queues.push_back(qr);
+                }
+                return r;
+            }
+
         protected:
-            Msg message;
+            /* capture this publish into the ITPS recording (check Recorder.hpp), the topic gets its id
+             * the first time. Channels of msg types without a RecordCodec aren't recorded.
+             */
+            void record(const Msg& msg, timestamp_t stamp) {
+                if(!RecordCodec<Msg>::supported) return;
+                uint32_t id = record_topic.load(boost::memory_order_relaxed);
+                if(id == NO_RECORD_TOPIC) {
+                    id = Recorder::instance().topic_id(key, boost::core::demangle(typeid(Msg).name()));
+                    record_topic.store(id, boost::memory_order_relaxed);
+                }
+                Recorder::instance().record(id, stamp, [&msg](RecordWriter& w) { w.put(msg); });
+            }
+
+            // the publishing thread's trace context, counted as a hop through this channel
+            TraceContext trace_publish() {
+                TraceContext trace = current_trace();
+                if(trace.valid()) trace = trace_stats->record(trace, now_ns());
+                return trace;
+            }
+
+            /* the publisher only pays for a lock when someone is actually sleeping in wait_for_update() */
+            void notify_update() {
+                if(num_waiters.load() == 0) return;
+                update_mutex.lock(); // a waiter is either before its version check or already waiting
+                update_mutex.unlock();
+                update_cond.notify_all();
+            }
+
+            void notify_listeners() {
+                boost::shared_ptr<const listener_list_t> current = boost::atomic_load(&listeners);
+                for(auto& listener: *current) {
+                    listener->on_publish(); // only posts to an executor, never runs a callback here
+                }
+            }
+
+            LatestValueBuffer<Msg, TraceContext> message;
+            boost::shared_ptr<HistoryBuffer<Msg>> history; // only accessed via atomic_load/store
+            boost::atomic<PublishGroup*> group{nullptr};
+            boost::atomic<unsigned int> num_waiters{0};
+            boost::mutex update_mutex;
+            boost::condition_variable_any update_cond;
             static msg_table_t msg_table;
             
             boost::shared_mutex msg_mutex;
             static boost::shared_mutex table_mutex;
+            static boost::condition_variable_any table_cond; // signaled whenever a channel is registered
 
             std::string key;
+            std::string topic_name, msg_name, mode;
+            ChannelStats stats;
+            TraceStats* trace_stats;
 
-            std::vector< boost::shared_ptr<ConsumerProducerQueue<Msg>> > msg_queues;
-            std::vector< boost::function<void(Msg)> > callback_funcs;
+            // shared-memory mirror (at most one of the two is set, once), kept mapped by shm_endpoint
+            boost::atomic<ShmEndpoint<Msg>*> shm_export{nullptr};
+            boost::atomic<ShmEndpoint<Msg>*> shm_import{nullptr};
+            boost::shared_ptr<ShmEndpoint<Msg>> shm_endpoint;
+
+            static const uint32_t NO_RECORD_TOPIC = UINT32_MAX;
+            boost::atomic<uint32_t> record_topic{NO_RECORD_TOPIC}; // id in the recordings, once recorded
+
+            typedef std::vector< boost::shared_ptr<queue_t> > queue_list_t;
+            boost::shared_ptr<const queue_list_t> msg_queues{new queue_list_t()}; // only accessed via atomic_load/store
+
+            typedef std::vector< boost::shared_ptr<MsgListener> > listener_list_t;
+            boost::shared_ptr<const listener_list_t> listeners{new listener_list_t()}; // only accessed via atomic_load/store
     };
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -156,16 +476,35 @@ namespace ITPS {
     template <typename Msg>
     class Publisher {
         public:
-            Publisher(std::string topic_name, std::string msg_name, std::string mode) {
-                // if two publisher uses the same topic_nam + msg_name + mode, they would share the same msg channel (handled inside MsgChannel Constructor)
-                channel = boost::shared_ptr<ITPS::MsgChannel<Msg>>(new ITPS::MsgChannel<Msg>(topic_name, msg_name, mode));
+            // bound to the current namespace of the constructing thread, check Namespace.hpp
+            Publisher(std::string topic_name, std::string msg_name, std::string mode) 
+                : Publisher(current_namespace(), topic_name, msg_name, mode) {}
+
+            // construct from a topic descriptor, check Topic.hpp
+            template <typename Topic, typename = typename std::enable_if<is_topic<Topic>::value>::type>
+            Publisher(Topic topic) : Publisher(Topic::topic_namespace(), Topic::topic_name, Topic::msg_name, Topic::mode()) {
+                static_assert(std::is_same<typename Topic::Msg, Msg>::value, 
+                              "ITPS: publisher's message type doesn't match the topic descriptor");
+                // first publisher wins, same as the channel table
+                MsgChannel<Msg>* expected = nullptr;
+                boost::atomic<MsgChannel<Msg>*>* slot = Topic::channel_slot(Topic::topic_namespace().id());
+                if(slot != nullptr) slot->compare_exchange_strong(expected, channel);
             }
             ~Publisher() {}
 
             virtual void publish(Msg message) = 0;
 
         protected:
-            boost::shared_ptr<ITPS::MsgChannel<Msg>> channel;
+            /* if two publishers use the same topic_name + msg_name + mode, they share the same msg channel.
+             * Channels are never freed, so a publisher re-created by a restarted module finds the channel
+             * (and the subscribers attached to it) it published to before
+             */
+            Publisher(const Namespace& ns, std::string topic_name, std::string msg_name, std::string mode) : ns(ns) {
+                channel = ITPS::MsgChannel<Msg>::get_or_create_channel(ns.qualify(topic_name), msg_name, mode);
+            }
+
+            ITPS::MsgChannel<Msg>* channel;
+            Namespace ns; // the one the topic lives in
     };
 
     template <typename Msg>
@@ -174,15 +513,56 @@ namespace ITPS {
 
             NonBlockingPublisher(std::string topic_name, std::string msg_name, Msg default_msg) 
                 : Publisher<Msg>(topic_name, msg_name, "NB") {
-                this->channel->set_msg(default_msg); // this avoids dealing with nullpointer exception 
-                                               // if the msg type is not primitive when subscriber 
-                                               // pull latest msg before publisher ever published anything
+                init_msg(default_msg); // this avoids dealing with nullpointer exception 
+                                       // if the msg type is not primitive when subscriber 
+                                       // pull latest msg before publisher ever published anything
             }
+
+            template <typename Topic, typename = typename std::enable_if<is_topic<Topic>::value>::type>
+            NonBlockingPublisher(Topic topic, Msg default_msg) : Publisher<Msg>(topic) {
+                static_assert(!Topic::is_blocking, "ITPS: NonBlockingPublisher constructed with a blocking topic");
+                init_msg(default_msg);
+            }
+
             void publish(Msg message) {
                 // boost::this_thread::sleep_for(boost::chrono::microseconds(AVOID_STARVATION_DELAY));
                 this->channel->set_msg(message);
             }    
 
+            // stamp: when the msg was valid (e.g. the sensor sampling time), check ITPS::now_ns()
+            void publish(Msg message, timestamp_t stamp) {
+                this->channel->set_msg(message, stamp);
+            }
+
+            /* let subscribers look up past msgs by time (msg_at_time(), msg_history()),
+             * the channel keeps the last history_size msgs
+             */
+            void keep_history(unsigned int history_size) {
+                this->channel->enable_history(history_size);
+            }
+
+            /* declare this topic a member of a publish group, so that Snapshot readers see the
+             * publishes made within an ITPS::GroupPublish all at once, check PublishGroup.hpp.
+             * The group of the publisher's namespace, not of the calling thread's
+             */
+            template <typename Group, typename = typename std::enable_if<is_publish_group<Group>::value>::type>
+            void join_group(Group) {
+                this->channel->set_group(&Group::group(this->ns));
+            }
+
+            /* also share this topic with other processes through shared memory (trivially copyable msgs only),
+             * they read it with NonBlockingSubscriber::subscribe_shm(), check ShmTransport.hpp
+             */
+            void export_shm() {
+                this->channel->export_shm(0);
+            }
+
+        private:
+            // the default never replaces a msg already published, e.g. by this publisher before a restart
+            void init_msg(const Msg& default_msg) {
+                if(this->channel->get_version() == 0) this->channel->reset_msg(default_msg);
+            }
+
     };
 
 
@@ -192,6 +572,11 @@ namespace ITPS {
             BlockingPublisher(std::string topic_name, std::string msg_name) 
                 : Publisher<Msg>(topic_name, msg_name, "B") {}
 
+            template <typename Topic, typename = typename std::enable_if<is_topic<Topic>::value>::type>
+            BlockingPublisher(Topic topic) : Publisher<Msg>(topic) {
+                static_assert(Topic::is_blocking, "ITPS: BlockingPublisher constructed with a non-blocking topic");
+            }
+
             void publish(Msg message) {
                 this->channel->enqueue_msg(message);
             }
@@ -199,6 +584,14 @@ namespace ITPS {
             void publish(Msg message, unsigned int timeout_ms) {
                 this->channel->enqueue_msg(message, timeout_ms);
             }    
+
+            /* also push every msg into a shared-memory queue of queue_capacity msgs (trivially copyable msgs only),
+             * consumed by the BlockingSubscriber::subscribe_shm() of other processes. The publisher never waits
+             * on that queue, msgs are dropped when it's full. Check ShmTransport.hpp
+             */
+            void export_shm(unsigned int queue_capacity) {
+                this->channel->export_shm(queue_capacity);
+            }
     };
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -211,10 +604,16 @@ namespace ITPS {
     class Subscriber {
         public:
 
-            Subscriber(std::string topic_name, std::string msg_name, std::string mode) {
-                this->topic_name = topic_name;
-                this->msg_name = msg_name;
-                this->mode = mode;
+            // bound to the current namespace of the constructing thread, check Namespace.hpp
+            Subscriber(std::string topic_name, std::string msg_name, std::string mode) 
+                : Subscriber(current_namespace(), topic_name, msg_name, mode) {}
+
+            // construct from a topic descriptor, check Topic.hpp
+            template <typename Topic, typename = typename std::enable_if<is_topic<Topic>::value>::type>
+            Subscriber(Topic topic) : Subscriber(Topic::topic_namespace(), Topic::topic_name, Topic::msg_name, Topic::mode()) {
+                static_assert(std::is_same<typename Topic::Msg, Msg>::value, 
+                              "ITPS: subscriber's message type doesn't match the topic descriptor");
+                this->channel_slot = Topic::channel_slot(Topic::topic_namespace().id());
             }
             ~Subscriber() {}
 
@@ -222,12 +621,12 @@ namespace ITPS {
              * key = "topic_name.msg_name.mode".
              * the msg channel is created during the constructing phase
              * of the corresponding publisher with the same key string.
-             * The MsgChannel object is stored in a internally global hash-map
+             * The MsgChannel object is stored in a internally global hash-map,
+             * which signals the waiting subscribers whenever a new channel is registered
              */
             virtual void subscribe() {
-                do {
-                    this->channel = MsgChannel<Msg>::get_channel(this->topic_name, this->msg_name, this->mode);
-                } while(this->channel == nullptr);
+                if(resolve_from_slot()) return;
+                this->channel = MsgChannel<Msg>::wait_for_channel(this->topic_name, this->msg_name, this->mode);
             }
 
             /* return true if finding a msg channel with matching key string.
@@ -238,23 +637,53 @@ namespace ITPS {
              * The MsgChannel object is stored in a internally global hash-map
              */
             virtual void subscribe(unsigned int timeout_ms) {
-                unsigned int t0 = millis();
-                do {
-                    if(millis() - t0 >= timeout_ms) {
-                        throw std::runtime_error("Subscribe() TimeOut Exception, Cannot find a matching Publisher");
-                    }
-                    this->channel = MsgChannel<Msg>::get_channel(this->topic_name, this->msg_name, this->mode);
-                } while(this->channel == nullptr);
+                if(resolve_from_slot()) return;
+                this->channel = MsgChannel<Msg>::wait_for_channel(this->topic_name, this->msg_name, this->mode, timeout_ms);
+                if(this->channel == nullptr) {
+                    throw std::runtime_error("Subscribe() TimeOut Exception, Cannot find a matching Publisher: " 
+                                             + this->topic_name + "." + this->msg_name + "." + this->mode);
+                }
+            }
+
+            // "topic_name.msg_name.mode", namespace included
+            std::string key() const {
+                return this->topic_name + "." + this->msg_name + "." + this->mode;
             }
 
         protected:
+            /* map the segment exported for this topic by another process, waiting for it
+             * (polling, there's no cross-process registry to signal it) up to timeout_ms, or forever if 0
+             */
+            boost::shared_ptr<ShmTopic<Msg>> open_shm(unsigned int timeout_ms) {
+                std::string key = this->topic_name + "." + this->msg_name + "." + this->mode;
+                timestamp_t deadline = ShmTopic<Msg>::deadline_after(timeout_ms);
+                boost::shared_ptr<ShmTopic<Msg>> topic;
+                while(!(topic = ShmTopic<Msg>::open(key))) {
+                    if(timeout_ms != 0 && now_ns() >= deadline) {
+                        throw std::runtime_error("subscribe_shm() TimeOut Exception, no process exports: " + key);
+                    }
+                    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                }
+                return topic;
+            }
+
+            Subscriber(const Namespace& ns, std::string topic_name, std::string msg_name, std::string mode) {
+                this->topic_name = ns.qualify(topic_name);
+                this->msg_name = msg_name;
+                this->mode = mode;
+            }
+
             MsgChannel<Msg> *channel = nullptr;
             std::string topic_name, msg_name, mode;
 
-        private:
-            static unsigned int millis(void) {
-                auto t = boost::chrono::high_resolution_clock::now();
-                return (unsigned int)(double(t.time_since_epoch().count()) / 1000000.00f);
+            // only set when constructed from a topic descriptor
+            boost::atomic<MsgChannel<Msg>*> *channel_slot = nullptr;
+
+            // lock-free fast path when the publisher of the descriptor already exists
+            bool resolve_from_slot() {
+                if(channel_slot == nullptr) return false;
+                this->channel = channel_slot->load();
+                return this->channel != nullptr;
             }
     };
 
@@ -266,6 +695,11 @@ namespace ITPS {
             NonBlockingSubscriber(std::string topic_name, std::string msg_name) 
                 : Subscriber<Msg>(topic_name, msg_name, "NB") {}
 
+            template <typename Topic, typename = typename std::enable_if<is_topic<Topic>::value>::type>
+            NonBlockingSubscriber(Topic topic) : Subscriber<Msg>(topic) {
+                static_assert(!Topic::is_blocking, "ITPS: NonBlockingSubscriber constructed with a blocking topic");
+            }
+
 
             void subscribe() {
                 Subscriber<Msg>::subscribe();
@@ -281,6 +715,17 @@ namespace ITPS {
                 }
             }
 
+            /* subscribe to a topic exported by another process (NonBlockingPublisher::export_shm()),
+             * timeout_ms = 0 waits forever. The channel of this key then reads from shared memory for
+             * every subscriber of this process, plain subscribe() calls included. Callbacks (on_message())
+             * and the history aren't available on an imported topic.
+             */
+            void subscribe_shm(unsigned int timeout_ms = 0) {
+                boost::shared_ptr<ShmTopic<Msg>> topic = this->open_shm(timeout_ms);
+                this->channel = MsgChannel<Msg>::get_or_create_channel(this->topic_name, this->msg_name, this->mode);
+                this->channel->import_shm(topic);
+            }
+
             // Non-blocking Mode getter method
             Msg latest_msg() {
                 // non-blocking
@@ -289,6 +734,92 @@ namespace ITPS {
                 return rtn;
             }   
 
+            // same as above, also returns the version number of the msg
+            Msg latest_msg(uint64_t& version) {
+                return this->channel->get_msg(version);
+            }
+
+            /* Change notification: every publish increments a per-channel version number,
+             * the default msg of the publisher has version 0
+             */
+            uint64_t latest_version() {
+                return this->channel->get_version();
+            }
+
+            /* block until a msg newer than last_seen is published, instead of polling latest_msg() with delays,
+             * return false on timeout (unit: milliseconds)
+             */
+            bool wait_for_update(uint64_t last_seen, unsigned int timeout_ms) {
+                return this->channel->wait_for_update(last_seen, timeout_ms);
+            }
+
+            /* non-blocking: if a msg newer than last_seen exists, copy it to msg, 
+             * update last_seen to its version and return true, otherwise leave both untouched and return false 
+             */
+            bool try_get_if_newer(Msg& msg, uint64_t& last_seen) {
+                if(this->channel->get_version() <= last_seen) return false;
+                uint64_t version;
+                Msg rtn = this->channel->get_msg(version);
+                if(version <= last_seen) return false;
+                msg = rtn;
+                last_seen = version;
+                return true;
+            }
+
+            /* time-aligned lookup, requires the publisher to keep_history():
+             * msg = the msg at time t (interpolated, check HistoryBuffer.hpp), return true
+             * if the history doesn't cover t, msg = the closest msg available (or the latest msg 
+             * without any history), return false
+             */
+            bool msg_at_time(timestamp_t t, Msg& msg) {
+                boost::shared_ptr<HistoryBuffer<Msg>> hist = this->channel->get_history();
+                if(!hist || hist->empty()) {
+                    msg = this->channel->get_msg();
+                    return false;
+                }
+                return hist->at_time(t, msg);
+            }
+
+            // msgs published within [t0, t1] still in the history, in chronological order
+            std::vector<typename HistoryBuffer<Msg>::Stamped> msg_history(timestamp_t t0, timestamp_t t1) {
+                boost::shared_ptr<HistoryBuffer<Msg>> hist = this->channel->get_history();
+                if(!hist) return std::vector<typename HistoryBuffer<Msg>::Stamped>();
+                return hist->range(t0, t1);
+            }
+
+            /* Reactive mode: instead of owning a thread polling latest_msg(), run callback(msg) on executor
+             * (a ThreadPool, a ThreadPool::Strand, ...) whenever a msg is published. Runs are coalesced
+             * (check Subscription.hpp), so the callback always gets the latest msg, and intermediate msgs
+             * published while a run is pending are skipped. On a plain ThreadPool, runs of the same
+             * callback may overlap, use a Strand to serialize them.
+             * Must be called after subscribe(), the executor must outlive the subscription.
+             */
+            template <typename Executor>
+            Subscription on_message(boost::function<void(const Msg&)> callback, Executor& executor) {
+                MsgChannel<Msg>* channel = this->channel;
+                if(channel == nullptr || channel->is_shm_import()) {
+                    throw std::runtime_error("on_message() called before subscribe(), or on a shm import: " 
+                                             + this->topic_name + "." + this->msg_name + "." + this->mode);
+                }
+                boost::shared_ptr<boost::atomic<uint64_t>> last_seen(new boost::atomic<uint64_t>(channel->get_version()));
+                boost::shared_ptr<CallbackDispatch> dispatch(new CallbackDispatch([channel, last_seen, callback]() {
+                    uint64_t version;
+                    Msg msg = channel->get_msg(version);
+                    uint64_t prev = last_seen->load();
+                    do {
+                        if(version <= prev) return; // already delivered by an overlapping run
+                    } while(!last_seen->compare_exchange_weak(prev, version));
+                    callback(msg);
+                }, CallbackDispatch::wrap(executor)));
+                channel->add_listener(dispatch);
+                return Subscription(dispatch, [channel, dispatch]() { channel->remove_listener(dispatch); });
+            }
+
+            // the publish group of this topic (nullptr if none), used by Snapshot
+            PublishGroup* publish_group() {
+                return this->channel->get_group();
+            }
+
             // method reserved for special use case only
             void force_set_latest_msg(Msg msg) {
                 this->channel->set_msg(msg);
@@ -303,23 +834,36 @@ namespace ITPS {
         public:
             //with message queue of size 1
             BlockingSubscriber(std::string topic_name, std::string msg_name) 
-                : Subscriber<Msg>(topic_name, msg_name, "B") {
-                msg_queue = boost::shared_ptr<ConsumerProducerQueue<Msg>>(
-                    new ConsumerProducerQueue<Msg>(1) 
-                );
+                : Subscriber<Msg>(topic_name, msg_name, "B"), queue_size(1), 
+                  backend(QueueBackend::Locking), policy(OverflowPolicy::Block) {
+                msg_queue = make_queue(queue_size, backend, policy);
             } 
     
             //with message queue of size queue_size
-            BlockingSubscriber(std::string topic_name, std::string msg_name, unsigned int queue_size) 
-                : Subscriber<Msg>(topic_name, msg_name, "B") {
-                msg_queue = boost::shared_ptr<ConsumerProducerQueue<Msg>>(
-                    new ConsumerProducerQueue<Msg>(queue_size) 
-                );
+            BlockingSubscriber(std::string topic_name, std::string msg_name, unsigned int queue_size, 
+                               QueueBackend backend = QueueBackend::Locking, 
+                               OverflowPolicy policy = OverflowPolicy::Block) 
+                : Subscriber<Msg>(topic_name, msg_name, "B"), queue_size(queue_size), backend(backend), policy(policy) {
+                msg_queue = make_queue(queue_size, backend, policy);
             } 
 
+            template <typename Topic, typename = typename std::enable_if<is_topic<Topic>::value>::type>
+            BlockingSubscriber(Topic topic, unsigned int queue_size = 1, 
+                               QueueBackend backend = QueueBackend::Locking,
+                               OverflowPolicy policy = OverflowPolicy::Block) 
+                : Subscriber<Msg>(topic), queue_size(queue_size), backend(backend), policy(policy) {
+                static_assert(Topic::is_blocking, "ITPS: BlockingSubscriber constructed with a non-blocking topic");
+                msg_queue = make_queue(queue_size, backend, policy);
+            } 
+
+            // the channel outlives its subscribers, it mustn't keep filling (or, under Block, waiting on) a dead queue
+            ~BlockingSubscriber() {
+                unsubscribe();
+            }
+
             void subscribe() {
                 Subscriber<Msg>::subscribe();
-                this->channel->add_msg_queue(msg_queue);
+                attach_queue();
             }    
 
             void subscribe(unsigned int timeout_ms) {
@@ -329,22 +873,103 @@ namespace ITPS {
                 catch(std::exception& e){
                     throw std::runtime_error(e.what());   
                 } 
-                this->channel->add_msg_queue(msg_queue);
+                attach_queue();
+            }
+
+            /* detach the queue from the channel and close it: a pop_msg() blocked on it (or called later) throws
+             * ITPS::QueueClosed, and a publisher blocked on it under OverflowPolicy::Block moves on.
+             * A later subscribe() starts over with an empty queue, e.g. when a stopped module restarts
+             */
+            void unsubscribe() {
+                if(this->channel != nullptr) this->channel->remove_msg_queue(msg_queue);
+                msg_queue->close();
+            }
+
+            /* consume the shared-memory queue of a topic exported by another process
+             * (BlockingPublisher::export_shm()) instead of an in-process queue, timeout_ms = 0 waits forever.
+             * That queue is shared by all the importing subscribers, each msg goes to only one of them.
+             * pop_msg() works as usual, on_message() isn't available.
+             */
+            void subscribe_shm(unsigned int timeout_ms = 0) {
+                msg_queue = boost::shared_ptr<queue_t>(new ShmMessageQueue<Msg>(this->open_shm(timeout_ms)));
             }
 
             // For Message Queue Mode only
             Msg pop_msg() {
                 // conditionally blocking
-                return msg_queue->consume();
+                timestamp_t start = now_ns();
+                Traced<Msg> rtn = msg_queue->consume();
+                msg_queue->stats().consume_wait.record(now_ns() - start);
+                adopt_trace(rtn.trace);
+                return std::move(rtn.data);
             }
 
             // with time limit, if surpassing the timeout limit, return dft_rtn (default return value) 
             Msg pop_msg(unsigned int timeout_ms, Msg dft_rtn) {
-                return msg_queue->consume(timeout_ms, dft_rtn);
+                timestamp_t start = now_ns();
+                Traced<Msg> rtn = msg_queue->consume(timeout_ms, Traced<Msg>{std::move(dft_rtn), TraceContext()});
+                msg_queue->stats().consume_wait.record(now_ns() - start);
+                adopt_trace(rtn.trace);
+                return std::move(rtn.data);
+            }
+
+            // never blocks, false if the queue is empty
+            bool try_pop_msg(Msg& msg) {
+                Traced<Msg> rtn;
+                if(!msg_queue->try_consume(rtn)) return false;
+                adopt_trace(rtn.trace);
+                msg = std::move(rtn.data);
+                return true;
+            }
+
+            /* Reactive mode: run callback(msg) on executor for every msg delivered to this subscriber's
+             * queue, instead of owning a thread blocking on pop_msg() (don't mix the two).
+             * Each run drains the queue, so with OverflowPolicy::Block a callback that can't keep up
+             * still slows the publisher down, pick DropOldest/DropNewest to decouple them.
+             * Use a ThreadPool::Strand to keep the msgs in order. Must be called after subscribe().
+             */
+            template <typename Executor>
+            Subscription on_message(boost::function<void(const Msg&)> callback, Executor& executor) {
+                MsgChannel<Msg>* channel = this->channel;
+                if(channel == nullptr) {
+                    throw std::runtime_error("on_message() called before subscribe(), or on a shm import: " 
+                                             + this->topic_name + "." + this->msg_name + "." + this->mode);
+                }
+                boost::shared_ptr<queue_t> queue = msg_queue;
+                boost::shared_ptr<CallbackDispatch> dispatch(new CallbackDispatch([queue, callback]() {
+                    Traced<Msg> msg;
+                    while(queue->try_consume(msg)) {
+                        adopt_trace(msg.trace);
+                        callback(msg.data);
+                    }
+                }, CallbackDispatch::wrap(executor)));
+                channel->add_listener(dispatch);
+                dispatch->on_publish(); // msgs queued before the subscription started
+                return Subscription(dispatch, [channel, dispatch]() { channel->remove_listener(dispatch); });
             }
 
         protected:
-            boost::shared_ptr<ConsumerProducerQueue<Msg>> msg_queue;
+            typedef typename MsgChannel<Msg>::queue_t queue_t;
+
+            // LockFree + OverwriteLatest throws std::invalid_argument (check RingBufferQueue) rather than silently locking
+            static boost::shared_ptr<queue_t> make_queue(unsigned int queue_size, QueueBackend backend, 
+                                                         OverflowPolicy policy) {
+                if(backend == QueueBackend::LockFree) {
+                    return boost::shared_ptr<queue_t>(new RingBufferQueue<Traced<Msg>>(queue_size, policy));
+                }
+                return boost::shared_ptr<queue_t>(new ConsumerProducerQueue<Traced<Msg>>(queue_size, policy));
+            }
+
+            // a queue closed by unsubscribe() is replaced, the channel never sees a closed queue again
+            void attach_queue() {
+                if(msg_queue->is_closed()) msg_queue = make_queue(queue_size, backend, policy);
+                this->channel->add_msg_queue(msg_queue);
+            }
+
+            boost::shared_ptr<queue_t> msg_queue;
+            unsigned int queue_size;
+            QueueBackend backend;
+            OverflowPolicy policy;
     };
 
 }
@@ -358,3 +983,6 @@ std::unordered_map<std::string, ITPS::MsgChannel<Msg>*> ITPS::MsgChannel<Msg>::m
 
 template <typename Msg>
 boost::shared_mutex ITPS::MsgChannel<Msg>::table_mutex;
+
+template <typename Msg>
+boost::condition_variable_any ITPS::MsgChannel<Msg>::table_cond;
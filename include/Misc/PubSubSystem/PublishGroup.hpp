@@ -0,0 +1,128 @@
+/*
+ * Atomic publishing of a group of NonBlocking ("NB") ITPS topics
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include "Namespace.hpp"
+
+namespace ITPS {
+
+    /*
+     * A sequence lock shared by the channels of related topics, e.g. the translational & rotational
+     * setpoints computed by the same MotionModule::move() call:
+     *
+     *  * Publishers wrap the publishes of the whole group in a GroupPublish (below), the sequence
+     *    number is odd while the group is being updated
+     *  * Snapshot (check Snapshot.hpp) retries its reads if a member's group sequence number was odd
+     *    or has changed meanwhile, so it never observes half of a group update
+     *
+     * Readers never block the publishers, they only spin (then yield) for the few microseconds it takes
+     * to publish a group.
+     */
+    class PublishGroup {
+        public:
+            PublishGroup() : seq(0) {}
+
+            void begin_publish() {
+                while(write_flag.test_and_set(boost::memory_order_acquire)) {
+                    boost::this_thread::yield(); // another publisher of the same group
+                }
+                seq.fetch_add(1, boost::memory_order_seq_cst); // odd: update in progress
+            }
+
+            void end_publish() {
+                seq.fetch_add(1, boost::memory_order_seq_cst); // even: stable again
+                write_flag.clear(boost::memory_order_release);
+            }
+
+            // reader side: wait for a stable state, return its sequence number
+            uint64_t read_begin() const {
+                uint64_t s;
+                for(unsigned int i = 0; (s = seq.load(boost::memory_order_seq_cst)) & 1; i++) {
+                    if(i >= NUM_SPINS) boost::this_thread::yield();
+                }
+                return s;
+            }
+
+            // reader side: true if a group update happened since read_begin() returned s
+            bool read_retry(uint64_t s) const {
+                return seq.load(boost::memory_order_seq_cst) != s;
+            }
+
+        private:
+            static const unsigned int NUM_SPINS = 64;
+
+            boost::atomic<uint64_t> seq;
+            boost::atomic_flag write_flag = BOOST_ATOMIC_FLAG_INIT;
+    };
+
+
+    /* compile-time group descriptor, owns one PublishGroup per namespace (check Namespace.hpp), so the
+     * robots running the same module never make each other's Snapshot readers retry:
+     *
+     *      ITPS_PUBLISH_GROUP(SetPointGroup);
+     *
+     *      trans_setpoint_pub.join_group(SetPointGroup{});
+     *      rotat_setpoint_pub.join_group(SetPointGroup{});
+     *      ...
+     *      {
+     *          ITPS::GroupPublish group_publish(SetPointGroup{}); // the current namespace's group
+     *          trans_setpoint_pub.publish(trans_setpoint);
+     *          rotat_setpoint_pub.publish(rotat_setpoint);
+     *      }
+     *
+     * The publishers join the group of the namespace they are bound to, a GroupPublish takes the current
+     * namespace's unless given one, which must be the same.
+     */
+    struct PublishGroupTag {};
+
+    template <typename T>
+    struct is_publish_group : std::is_base_of<PublishGroupTag, T> {};
+
+    template <typename Descriptor>
+    struct PublishGroupDescriptor : public PublishGroupTag {
+        static PublishGroup& group(const Namespace& ns = current_namespace()) {
+            static PublishGroup groups[Namespace::MAX_NAMESPACES];
+            if(ns.id() < Namespace::MAX_NAMESPACES) return groups[ns.id()];
+
+            // beyond the array, same as the topic descriptors' channel slots. Never freed, like the channels
+            static boost::mutex mutex;
+            static std::map<unsigned int, std::unique_ptr<PublishGroup>> more_groups;
+            boost::lock_guard<boost::mutex> lock(mutex);
+            std::unique_ptr<PublishGroup>& group = more_groups[ns.id()];
+            if(!group) group.reset(new PublishGroup());
+            return *group;
+        }
+    };
+
+    // RAII: the publishes made during its lifetime are seen by Snapshot readers all at once
+    class GroupPublish {
+        public:
+            template <typename Group, typename = typename std::enable_if<is_publish_group<Group>::value>::type>
+            GroupPublish(Group, const Namespace& ns = current_namespace()) : group(Group::group(ns)) {
+                group.begin_publish();
+            }
+
+            ~GroupPublish() {
+                group.end_publish();
+            }
+
+            GroupPublish(const GroupPublish&) = delete;
+            GroupPublish& operator=(const GroupPublish&) = delete;
+
+        private:
+            PublishGroup& group;
+    };
+
+}
+
+/* declare a publish group type named Name, to be used in a namespace or class scope */
+#define ITPS_PUBLISH_GROUP(Name) \
+    struct Name : public ITPS::PublishGroupDescriptor<Name> {}
@@ -0,0 +1,690 @@
+/*
+ * Binary recorder of the ITPS traffic
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include "HistoryBuffer.hpp"
+
+namespace ITPS {
+
+    /*
+     * Every publish of every channel can be captured into a file, with its timestamp, to replay field
+     * sessions and to benchmark changes against the same inputs:
+     *
+     *      ITPS::Recorder::instance().start("session.itpsrec", 256 << 20);
+     *
+     *  * The publishing thread serializes the msg straight into a preallocated cell of a lock-free ring
+     *    (claim a cell, encode, commit), no lock, no allocation, no syscall. If the ring is full or
+     *    the msg is larger than a cell, the record is dropped and counted, the publisher never waits.
+     *  * A background thread drains the ring in order into a memory-mapped file preallocated at
+     *    start(), and truncates it to what was actually written at stop().
+     *
+     * File layout (little endian, as in memory):
+     *
+     *      RecordFileHeader
+     *      { RecordHeader, payload, zero padding to 8 bytes } ...
+     *      a zeroed RecordHeader (kind RECORD_END) or the end of the file
+     *
+     * A RECORD_TOPIC record (payload "key\0msg_type\0") introduces a topic id before its first
+     * RECORD_MSG, every start() lists again all the topics known so far.
+     *
+     * Msgs are serialized by RecordCodec<Msg>. Trivially copyable msgs, protobuf messages, armadillo
+     * matrices/vectors and ConstMsgPtr<> of those are supported out of the box; a struct holding e.g. an
+     * arma::vec needs a specialization listing its fields (check MotionEkfModule.hpp for an example).
+     * Channels of the other types are simply not recorded.
+     */
+    enum RecordKind : uint16_t {RECORD_END = 0, RECORD_TOPIC = 1, RECORD_MSG = 2};
+
+    struct RecordFileHeader {
+        static const uint32_t VERSION = 1;
+
+        char magic[8];          // "ITPSREC"
+        uint32_t version;
+        uint32_t header_size;   // sizeof(RecordFileHeader), the first record starts there
+        uint64_t start_stamp;   // ITPS::now_ns() at start()
+        uint64_t start_unix_ns; // wall clock at start()
+        uint64_t data_size;     // bytes of records, 0 if the recorder didn't stop cleanly (read until RECORD_END)
+    };
+
+    struct RecordHeader {
+        uint32_t size;   // payload bytes, without the padding
+        uint16_t kind;   // RecordKind
+        uint16_t topic;  // topic id
+        uint64_t stamp;  // ITPS::now_ns() of the publish (or the stamp given to publish())
+    };
+
+
+    // bounded byte cursor msgs are encoded with, sticks to "overflowed" once out of room
+    class RecordWriter {
+        public:
+            RecordWriter(char* buffer, uint32_t capacity) : buffer(buffer), room(capacity), used(0), overflow(false) {}
+
+            template <typename T>
+            void put(const T& value);
+
+            void put_bytes(const void* data, uint32_t n) {
+                char* dst = reserve(n);
+                if(dst != nullptr) std::memcpy(dst, data, n);
+            }
+
+            // n bytes to be filled in place by the caller, nullptr if they don't fit
+            char* reserve(uint32_t n) {
+                if(overflow || n > room - used) {
+                    overflow = true;
+                    return nullptr;
+                }
+                char* dst = buffer + used;
+                used += n;
+                return dst;
+            }
+
+            uint32_t size() const {
+                return used;
+            }
+
+            bool overflowed() const {
+                return overflow;
+            }
+
+        private:
+            char* buffer;
+            uint32_t room, used;
+            bool overflow;
+    };
+
+    // counterpart of RecordWriter, sticks to "not ok" once reading past the end
+    class RecordReader {
+        public:
+            RecordReader(const char* buffer, uint32_t size) : buffer(buffer), total(size), pos(0), underflow(false) {}
+
+            template <typename T>
+            void get(T& value);
+
+            void get_bytes(void* data, uint32_t n) {
+                const char* src = take(n);
+                if(src != nullptr) std::memcpy(data, src, n);
+                else std::memset(data, 0, n);
+            }
+
+            // n bytes to be read in place by the caller, nullptr if there aren't that many left
+            const char* take(uint32_t n) {
+                if(underflow || n > total - pos) {
+                    underflow = true;
+                    return nullptr;
+                }
+                const char* src = buffer + pos;
+                pos += n;
+                return src;
+            }
+
+            bool ok() const {
+                return !underflow;
+            }
+
+        private:
+            const char* buffer;
+            uint32_t total, pos;
+            bool underflow;
+    };
+
+
+    namespace record_detail {
+        template <typename...> struct make_void { typedef void type; };
+
+        // protobuf messages, detected by their API instead of including protobuf here
+        template <typename T, typename = void>
+        struct is_protobuf : std::false_type {};
+        template <typename T>
+        struct is_protobuf<T, typename make_void<decltype(std::declval<const T&>().ByteSizeLong()),
+                                                 decltype(std::declval<T&>().ParseFromArray((const void*) 0, 0))>::type>
+            : std::true_type {};
+
+        // dense armadillo objects (arma::vec, arma::mat, ...)
+        template <typename T, typename = void>
+        struct is_arma_dense : std::false_type {};
+        template <typename T>
+        struct is_arma_dense<T, typename make_void<typename T::elem_type,
+                                                   decltype(std::declval<T&>().set_size(0u, 0u)),
+                                                   decltype(std::declval<const T&>().memptr())>::type>
+            : std::true_type {};
+    }
+
+    /* How a msg type gets in and out of a record: specialize it for a msg type to make it recordable,
+     * encode/decode its fields in the same order with w.put(field) / r.get(field).
+     * The default handles the trivially copyable types as raw bytes.
+     */
+    template <typename T, typename Enable = void>
+    struct RecordCodec {
+        static const bool supported = std::is_trivially_copyable<T>::value;
+
+        static void encode(const T& msg, RecordWriter& w) {
+            encode_raw(msg, w, std::integral_constant<bool, supported>());
+        }
+
+        static void decode(RecordReader& r, T& msg) {
+            decode_raw(r, msg, std::integral_constant<bool, supported>());
+        }
+
+        private:
+            static void encode_raw(const T& msg, RecordWriter& w, std::true_type) {
+                w.put_bytes(&msg, sizeof(T));
+            }
+            static void encode_raw(const T&, RecordWriter& w, std::false_type) {
+                w.reserve(UINT32_MAX); // not recordable, never called for those
+            }
+            static void decode_raw(RecordReader& r, T& msg, std::true_type) {
+                r.get_bytes(&msg, sizeof(T));
+            }
+            static void decode_raw(RecordReader& r, T&, std::false_type) {
+                r.take(UINT32_MAX);
+            }
+    };
+
+    template <typename T>
+    struct RecordCodec<T, typename std::enable_if<record_detail::is_protobuf<T>::value>::type> {
+        static const bool supported = true;
+
+        static void encode(const T& msg, RecordWriter& w) {
+            uint32_t n = msg.ByteSizeLong();
+            w.put(n);
+            char* dst = w.reserve(n);
+            if(dst != nullptr) msg.SerializeToArray(dst, n);
+        }
+
+        static void decode(RecordReader& r, T& msg) {
+            uint32_t n = 0;
+            r.get(n);
+            const char* src = r.take(n);
+            if(src != nullptr) msg.ParseFromArray(src, n);
+        }
+    };
+
+    template <typename T>
+    struct RecordCodec<T, typename std::enable_if<record_detail::is_arma_dense<T>::value>::type> {
+        static const bool supported = std::is_trivially_copyable<typename T::elem_type>::value;
+
+        static void encode(const T& msg, RecordWriter& w) {
+            uint32_t n_rows = msg.n_rows, n_cols = msg.n_cols;
+            w.put(n_rows);
+            w.put(n_cols);
+            w.put_bytes(msg.memptr(), n_rows * n_cols * sizeof(typename T::elem_type));
+        }
+
+        static void decode(RecordReader& r, T& msg) {
+            uint32_t n_rows = 0, n_cols = 0;
+            r.get(n_rows);
+            r.get(n_cols);
+            msg.set_size(n_rows, n_cols);
+            r.get_bytes(msg.memptr(), n_rows * n_cols * sizeof(typename T::elem_type));
+        }
+    };
+
+    // ConstMsgPtr<T> (check MsgPool.hpp) is recorded as the msg it points to
+    template <typename T>
+    struct RecordCodec<boost::shared_ptr<const T>> {
+        static const bool supported = RecordCodec<T>::supported;
+
+        static void encode(const boost::shared_ptr<const T>& msg, RecordWriter& w) {
+            bool present = (bool) msg;
+            w.put(present);
+            if(present) w.put(*msg);
+        }
+
+        static void decode(RecordReader& r, boost::shared_ptr<const T>& msg) {
+            bool present = false;
+            r.get(present);
+            if(!present) {
+                msg.reset();
+                return;
+            }
+            boost::shared_ptr<T> decoded = boost::make_shared<T>();
+            r.get(*decoded);
+            msg = decoded;
+        }
+    };
+
+    template <typename T>
+    void RecordWriter::put(const T& value) {
+        RecordCodec<T>::encode(value, *this);
+    }
+
+    template <typename T>
+    void RecordReader::get(T& value) {
+        RecordCodec<T>::decode(*this, value);
+    }
+
+
+    namespace record_detail {
+        inline boost::atomic<bool>& active_flag() {
+            static boost::atomic<bool> flag(false);
+            return flag;
+        }
+    }
+
+    // what the publishers check, a relaxed load
+    inline bool recording() {
+        return record_detail::active_flag().load(boost::memory_order_relaxed);
+    }
+
+
+    /*
+     * Multi-producer single-consumer ring of fixed size cells (Vyukov's bounded queue, each cell
+     * carries its sequence number). Producers encode in place between claim() and commit().
+     */
+    class RecordRing {
+        public:
+            static const uint32_t CELL_SIZE = 512;
+            static const uint32_t PAYLOAD_SIZE = CELL_SIZE - 8 - sizeof(RecordHeader);
+
+            struct Cell {
+                boost::atomic<uint64_t> seq;
+                RecordHeader header;
+                char payload[PAYLOAD_SIZE];
+            };
+
+            // num_cells rounded up to a power of 2
+            RecordRing(unsigned int num_cells) : enqueue_pos(0), dequeue_pos(0) {
+                capacity = 1;
+                while(capacity < num_cells) capacity <<= 1;
+                cells = new Cell[capacity];
+                for(uint64_t i = 0; i < capacity; i++) cells[i].seq.store(i, boost::memory_order_relaxed);
+            }
+
+            ~RecordRing() {
+                delete[] cells;
+            }
+
+            RecordRing(const RecordRing&) = delete;
+            RecordRing& operator=(const RecordRing&) = delete;
+
+            // nullptr if full, otherwise the cell must be commit()ed, even when its content is dropped
+            Cell* claim() {
+                uint64_t pos = enqueue_pos.load(boost::memory_order_relaxed);
+                for(;;) {
+                    Cell* cell = &cells[pos & (capacity - 1)];
+                    uint64_t seq = cell->seq.load(boost::memory_order_acquire);
+                    int64_t dif = (int64_t) seq - (int64_t) pos;
+                    if(dif == 0) {
+                        if(enqueue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) return cell;
+                    }
+                    else if(dif < 0) {
+                        return nullptr;
+                    }
+                    else {
+                        pos = enqueue_pos.load(boost::memory_order_relaxed);
+                    }
+                }
+            }
+
+            void commit(Cell* cell) {
+                uint64_t pos = cell->seq.load(boost::memory_order_relaxed);
+                cell->seq.store(pos + 1, boost::memory_order_release);
+            }
+
+            // consumer side (single thread): the next committed cell in order, nullptr if none
+            Cell* front() {
+                Cell* cell = &cells[dequeue_pos & (capacity - 1)];
+                if(cell->seq.load(boost::memory_order_acquire) != dequeue_pos + 1) return nullptr;
+                return cell;
+            }
+
+            void pop() {
+                Cell* cell = &cells[dequeue_pos & (capacity - 1)];
+                cell->seq.store(dequeue_pos + capacity, boost::memory_order_release);
+                dequeue_pos++;
+            }
+
+        private:
+            Cell* cells;
+            uint64_t capacity;
+            boost::atomic<uint64_t> enqueue_pos;
+            uint64_t dequeue_pos; // only touched by the consumer
+    };
+
+
+    struct RecorderStats {
+        uint64_t num_records;     // written to the file
+        uint64_t num_bytes;       // file bytes used so far
+        uint64_t dropped_full;    // ring full (the writer couldn't keep up)
+        uint64_t dropped_too_big; // serialized msg larger than a ring cell
+        uint64_t dropped_no_room; // the file is full
+    };
+
+
+    class Recorder {
+        public:
+            static const uint64_t DEFAULT_FILE_SIZE = 256ULL << 20; // 256 MB
+            static const unsigned int DEFAULT_RING_CELLS = 8192;    // 4 MB, ~1s of backlog at 8k msgs/s
+            static const unsigned int WRITER_PERIOD_US = 1000;      // how long the writer sleeps on an empty ring
+
+            static Recorder& instance() {
+                static Recorder recorder;
+                return recorder;
+            }
+
+            /* start recording into path (overwritten), preallocated to file_size bytes,
+             * throw std::runtime_error if the file can't be created, no-op if already recording
+             */
+            void start(const std::string& path, uint64_t file_size = DEFAULT_FILE_SIZE,
+                       unsigned int ring_cells = DEFAULT_RING_CELLS) {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if(writer) return;
+
+                int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if(fd < 0) throw std::runtime_error("ITPS: can't create the record file " + path + ": " + std::strerror(errno));
+                if(file_size < sizeof(RecordFileHeader) + RecordRing::CELL_SIZE) file_size = sizeof(RecordFileHeader) + RecordRing::CELL_SIZE;
+                int err = ftruncate(fd, file_size);
+#ifdef __linux__
+                if(err == 0) err = posix_fallocate(fd, 0, file_size); // really reserve the blocks, no ENOSPC later
+#endif
+                void* base = err == 0 ? mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+                if(base == MAP_FAILED) {
+                    std::string reason = std::strerror(err > 0 ? err : errno);
+                    close(fd);
+                    throw std::runtime_error("ITPS: can't preallocate the record file " + path + ": " + reason);
+                }
+
+                file_fd = fd;
+                file_base = static_cast<char*>(base);
+                file_capacity = file_size;
+                RecordFileHeader* header = reinterpret_cast<RecordFileHeader*>(file_base);
+                std::memset(header, 0, sizeof(RecordFileHeader));
+                std::memcpy(header->magic, "ITPSREC", 8);
+                header->version = RecordFileHeader::VERSION;
+                header->header_size = sizeof(RecordFileHeader);
+                header->start_stamp = now_ns();
+                header->start_unix_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                                            boost::chrono::system_clock::now().time_since_epoch()).count();
+                file_used = sizeof(RecordFileHeader);
+
+                num_records.store(0);
+                file_used_snapshot.store(file_used);
+                dropped_full.store(0);
+                dropped_too_big.store(0);
+                dropped_no_room.store(0);
+
+                // the topics known so far, the ones registered from now on go through the ring
+                for(std::size_t id = 0; id < topics.size(); id++) {
+                    append(RECORD_TOPIC, id, header->start_stamp, topics[id].data(), topics[id].size());
+                }
+
+                ring.reset(new RecordRing(ring_cells));
+                ring_ptr.store(ring.get());
+                stop_requested.store(false);
+                writer.reset(new boost::thread(boost::bind(&Recorder::write_loop, this)));
+                record_detail::active_flag().store(true);
+            }
+
+            // flush what's left in the ring and close the file, no-op if not recording
+            void stop() {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if(!writer) return;
+                record_detail::active_flag().store(false);
+                stop_requested.store(true);
+                writer->join();
+                writer.reset();
+                ring.reset(); // the writer only returns once no publisher can reach the ring anymore
+
+                reinterpret_cast<RecordFileHeader*>(file_base)->data_size = file_used - sizeof(RecordFileHeader);
+                msync(file_base, file_used, MS_SYNC);
+                munmap(file_base, file_capacity);
+                if(ftruncate(file_fd, file_used) != 0) {} // keeps the zeroed tail, readers stop at RECORD_END anyway
+                close(file_fd);
+                file_base = nullptr;
+            }
+
+            /* id of a channel in the records, registered (once per channel) on its first recorded publish
+             * key = "topic_name.msg_name.mode"
+             */
+            uint16_t topic_id(const std::string& key, const std::string& msg_type) {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                std::string definition = key + '\0' + msg_type + '\0';
+                for(std::size_t id = 0; id < topics.size(); id++) {
+                    if(topics[id] == definition) return id;
+                }
+                uint16_t id = topics.size();
+                topics.push_back(definition);
+                if(ring) {
+                    RecordRing::Cell* cell = ring->claim();
+                    if(cell != nullptr) {
+                        uint32_t n = std::min<std::size_t>(definition.size(), RecordRing::PAYLOAD_SIZE);
+                        std::memcpy(cell->payload, definition.data(), n);
+                        cell->header = RecordHeader{n, RECORD_TOPIC, id, now_ns()};
+                        ring->commit(cell);
+                    }
+                    else {
+                        dropped_full.fetch_add(1, boost::memory_order_relaxed);
+                    }
+                }
+                return id;
+            }
+
+            /* publisher side, never blocks: encode(RecordWriter&) serializes the msg into a ring cell */
+            template <typename Encode>
+            void record(uint16_t topic, timestamp_t stamp, Encode encode) {
+                if(!recording()) return;
+                // a reader lock of sorts: the writer waits until no publisher is inside before stopping
+                num_inside.fetch_add(1);
+                RecordRing* current = ring_ptr.load();
+                if(current != nullptr) {
+                    RecordRing::Cell* cell = current->claim();
+                    if(cell == nullptr) {
+                        dropped_full.fetch_add(1, boost::memory_order_relaxed);
+                    }
+                    else {
+                        RecordWriter w(cell->payload, RecordRing::PAYLOAD_SIZE);
+                        encode(w);
+                        if(w.overflowed()) dropped_too_big.fetch_add(1, boost::memory_order_relaxed);
+                        cell->header = RecordHeader{w.overflowed() ? 0 : w.size(),
+                                                    (uint16_t) (w.overflowed() ? RECORD_END : RECORD_MSG), topic, stamp};
+                        current->commit(cell);
+                    }
+                }
+                num_inside.fetch_sub(1);
+            }
+
+            RecorderStats stats() {
+                RecorderStats s;
+                s.num_records = num_records.load(boost::memory_order_relaxed);
+                s.num_bytes = file_used_snapshot.load(boost::memory_order_relaxed);
+                s.dropped_full = dropped_full.load(boost::memory_order_relaxed);
+                s.dropped_too_big = dropped_too_big.load(boost::memory_order_relaxed);
+                s.dropped_no_room = dropped_no_room.load(boost::memory_order_relaxed);
+                return s;
+            }
+
+            std::string dump() {
+                RecorderStats s = stats();
+                std::ostringstream os;
+                os << (recording() ? "recording" : "not recording")
+                   << " records=" << s.num_records << " bytes=" << s.num_bytes
+                   << " dropped: ring_full=" << s.dropped_full << " too_big=" << s.dropped_too_big
+                   << " file_full=" << s.dropped_no_room << "\n";
+                return os.str();
+            }
+
+        private:
+            Recorder() : file_fd(-1), file_base(nullptr), file_capacity(0), file_used(0) {}
+
+            ~Recorder() {
+                stop();
+            }
+
+            void write_loop() {
+                for(;;) {
+                    bool stopping = stop_requested.load();
+                    if(stopping) {
+                        // no new publisher gets the ring, wait for those already encoding
+                        ring_ptr.store(nullptr);
+                        while(num_inside.load() != 0) boost::this_thread::yield();
+                    }
+                    bool drained_any = false;
+                    RecordRing::Cell* cell;
+                    while((cell = ring->front()) != nullptr) {
+                        if(cell->header.kind != RECORD_END) {
+                            append(cell->header.kind, cell->header.topic, cell->header.stamp, cell->payload, cell->header.size);
+                        }
+                        ring->pop();
+                        drained_any = true;
+                    }
+                    if(stopping) return;
+                    if(!drained_any) boost::this_thread::sleep_for(boost::chrono::microseconds(WRITER_PERIOD_US));
+                }
+            }
+
+            // writer thread (or start() before the writer exists)
+            void append(uint16_t kind, uint16_t topic, uint64_t stamp, const char* payload, uint32_t size) {
+                uint64_t padded = (sizeof(RecordHeader) + size + 7) / 8 * 8;
+                if(file_used + padded + sizeof(RecordHeader) > file_capacity) { // keep room for the end marker
+                    dropped_no_room.fetch_add(1, boost::memory_order_relaxed);
+                    return;
+                }
+                char* dst = file_base + file_used;
+                RecordHeader header{size, kind, topic, stamp};
+                std::memcpy(dst, &header, sizeof(RecordHeader));
+                std::memcpy(dst + sizeof(RecordHeader), payload, size);
+                file_used += padded; // the padding is already zero, the file is fresh
+                num_records.fetch_add(1, boost::memory_order_relaxed);
+                file_used_snapshot.store(file_used, boost::memory_order_relaxed);
+            }
+
+            boost::mutex mutex; // start/stop/topic registration, never taken by record()
+            std::vector<std::string> topics; // id => "key\0msg_type\0"
+
+            boost::shared_ptr<RecordRing> ring;
+            boost::atomic<RecordRing*> ring_ptr{nullptr}; // what record() uses, only set while the writer runs
+            boost::atomic<unsigned int> num_inside{0};
+            boost::shared_ptr<boost::thread> writer;
+            boost::atomic<bool> stop_requested{false};
+
+            int file_fd;
+            char* file_base;
+            uint64_t file_capacity;
+            uint64_t file_used; // only touched by the writer thread, and by start/stop while it's not running
+
+            boost::atomic<uint64_t> num_records{0};
+            boost::atomic<uint64_t> file_used_snapshot{0};
+            boost::atomic<uint64_t> dropped_full{0};
+            boost::atomic<uint64_t> dropped_too_big{0};
+            boost::atomic<uint64_t> dropped_no_room{0};
+    };
+
+    inline std::string dump_recorder_stats() {
+        return Recorder::instance().dump();
+    }
+
+
+    /*
+     * Reads a record file back (loaded in memory as a whole), e.g. for the replay tool:
+     *
+     *      ITPS::RecordFile file("session.itpsrec");
+     *      ITPS::RecordFile::Record rec;
+     *      while(file.next(rec)) {
+     *          if(rec.header.kind != ITPS::RECORD_MSG || file.topic_key(rec.header.topic) != key) continue;
+     *          ITPS::RecordReader r = rec.reader();
+     *          r.get(msg);
+     *      }
+     *
+     * The RECORD_TOPIC records are returned as well, topic_key()/topic_type() know them once they are read.
+     * Records are in the order their publishers committed them, which may differ slightly from their
+     * stamps' order between threads.
+     */
+    class RecordFile {
+        public:
+            struct Record {
+                RecordHeader header;
+                const char* payload;
+
+                RecordReader reader() const {
+                    return RecordReader(payload, header.size);
+                }
+            };
+
+            // throw std::runtime_error if the file can't be read or isn't a record file
+            RecordFile(const std::string& path) : pos(0) {
+                int fd = open(path.c_str(), O_RDONLY);
+                if(fd < 0) throw std::runtime_error("ITPS: can't open the record file " + path + ": " + std::strerror(errno));
+                off_t size = lseek(fd, 0, SEEK_END);
+                data.resize(size > 0 ? size : 0);
+                std::size_t done = 0;
+                while(done < data.size()) {
+                    ssize_t n = pread(fd, &data[done], data.size() - done, done);
+                    if(n <= 0) break;
+                    done += n;
+                }
+                close(fd);
+                if(done < sizeof(RecordFileHeader) || std::memcmp(data.data(), "ITPSREC", 8) != 0) {
+                    throw std::runtime_error("ITPS: not a record file: " + path);
+                }
+                std::memcpy(&file_header, data.data(), sizeof(RecordFileHeader));
+                if(file_header.version != RecordFileHeader::VERSION) {
+                    throw std::runtime_error("ITPS: unsupported record file version " + std::to_string(file_header.version) + ": " + path);
+                }
+                end = done;
+                if(file_header.data_size != 0) end = std::min<uint64_t>(end, file_header.header_size + file_header.data_size);
+                pos = file_header.header_size;
+            }
+
+            const RecordFileHeader& header() const {
+                return file_header;
+            }
+
+            // false at the end of the records
+            bool next(Record& rec) {
+                if(pos + sizeof(RecordHeader) > end) return false;
+                std::memcpy(&rec.header, &data[pos], sizeof(RecordHeader));
+                if(rec.header.kind == RECORD_END || pos + sizeof(RecordHeader) + rec.header.size > end) return false;
+                rec.payload = &data[pos + sizeof(RecordHeader)];
+                pos += (sizeof(RecordHeader) + rec.header.size + 7) / 8 * 8;
+
+                if(rec.header.kind == RECORD_TOPIC) {
+                    const char* key = rec.payload;
+                    std::size_t key_len = strnlen(key, rec.header.size);
+                    const char* type = key + std::min<std::size_t>(key_len + 1, rec.header.size);
+                    std::size_t type_len = strnlen(type, rec.payload + rec.header.size - type);
+                    if(topics.size() <= rec.header.topic) topics.resize(rec.header.topic + 1);
+                    topics[rec.header.topic] = std::make_pair(std::string(key, key_len), std::string(type, type_len));
+                }
+                return true;
+            }
+
+            // "" if the topic id wasn't introduced yet
+            const std::string& topic_key(uint16_t topic) const {
+                static const std::string unknown;
+                return topic < topics.size() ? topics[topic].first : unknown;
+            }
+
+            const std::string& topic_type(uint16_t topic) const {
+                static const std::string unknown;
+                return topic < topics.size() ? topics[topic].second : unknown;
+            }
+
+        private:
+            std::vector<char> data;
+            RecordFileHeader file_header;
+            std::size_t pos, end;
+            std::vector< std::pair<std::string, std::string> > topics; // id => (key, msg_type)
+    };
+
+}
@@ -0,0 +1,309 @@
+/*
+ * Bounded lock-free message queue for the Blocking ("B") ITPS channels
+ */
+
+#pragma once
+
+/* Reference: Dmitry Vyukov's bounded MPMC queue
+ *   https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include "CpQueue.hpp"
+
+/* Drop-in replacement of ConsumerProducerQueue:
+ *  * cells are preallocated in a power-of-2 ring, produce/consume never allocate
+ *  * producers/consumers claim cells with a single CAS on their own index, each cell carries
+ *    a sequence number telling whether it's ready to be written or read, so any number of
+ *    producers and consumers can work on the queue at the same time (MPMC)
+ *  * waiting (queue full on produce, queue empty on consume) spins for a short while, then
+ *    parks on a condition variable. The other side only touches the mutex when somebody
+ *    is actually parked, so the fast path is lock-free and notify-free
+ *  * OverflowPolicy::OverwriteLatest isn't supported: the newest cell may already be claimed by
+ *    a consumer, so it can't be rewritten in place without a lock. Use ConsumerProducerQueue for it.
+ */
+template <typename data_t>
+class RingBufferQueue : public MessageQueue<data_t> {
+    public:
+        RingBufferQueue(unsigned int max_size, OverflowPolicy policy = OverflowPolicy::Block) 
+            : MessageQueue<data_t>(policy), max_size(max_size), enqueue_pos(0), dequeue_pos(0),
+              num_parked_producers(0), num_parked_consumers(0), closed(false) {
+            if(max_size == 0) {
+                throw std::invalid_argument("RingBufferQueue: max_size must be at least 1");
+            }
+            if(policy == OverflowPolicy::OverwriteLatest) {
+                throw std::invalid_argument("RingBufferQueue: OverwriteLatest is only supported by ConsumerProducerQueue");
+            }
+            // the algorithm needs at least 2 cells, max_size is enforced separately
+            num_cells = 2;
+            while(num_cells < max_size) num_cells <<= 1;
+            mask = num_cells - 1;
+            cells = new Cell[num_cells];
+            for(std::size_t i = 0; i < num_cells; i++) {
+                cells[i].sequence.store(i, boost::memory_order_relaxed);
+            }
+        }
+
+        ~RingBufferQueue() {
+            delete[] cells;
+        }
+
+        /* non-blocking attempts, return false when full / empty */
+        bool try_produce(const data_t& data) {
+            if(!enqueue(data)) return false;
+            wake_up(num_parked_consumers);
+            return true;
+        }
+
+        bool try_consume(data_t& data) {
+            if(!dequeue(data)) return false;
+            wake_up(num_parked_producers);
+            return true;
+        }
+
+        bool offer(data_t data) {
+            if(is_closed()) {
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+            switch(this->policy) {
+                case OverflowPolicy::DropNewest:
+                    if(try_produce(data)) return true;
+                    this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                    return false;
+                case OverflowPolicy::DropOldest:
+                    produce_evicting(data);
+                    return true;
+                default:
+                    produce(data);
+                    return !is_closed();
+            }
+        }
+
+        bool offer(data_t data, unsigned int timeout_ms) {
+            if(this->policy == OverflowPolicy::Block) {
+                if(produce(data, timeout_ms)) return true;
+                if(!is_closed()) this->counters.num_publish_timeouts.fetch_add(1, boost::memory_order_relaxed);
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+            return offer(data);
+        }
+
+        void produce(data_t data) {
+            if(is_closed() || (!enqueue(data) && !wait_until([&]() { return enqueue(data); }, num_parked_producers, NO_DEADLINE))) {
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed); // closed
+                return;
+            }
+            wake_up(num_parked_consumers);
+        }
+
+        bool produce(data_t data, unsigned int timeout_ms) {
+            if(is_closed()) return false;
+            if(!enqueue(data)) {
+                if(!wait_until([&]() { return enqueue(data); }, num_parked_producers, current_clock().deadline_after_ms(timeout_ms))) {
+                    return false;
+                }
+            }
+            wake_up(num_parked_consumers);
+            return true;
+        }
+
+        data_t consume() {
+            data_t rtn;
+            if(is_closed()) throw QueueClosed();
+            if(!dequeue(rtn)) {
+                if(!wait_until([&]() { return dequeue(rtn); }, num_parked_consumers, NO_DEADLINE)) throw QueueClosed();
+            }
+            wake_up(num_parked_producers);
+            return rtn;
+        }
+
+        data_t consume(unsigned int timeout_ms, data_t dft_rtn) {
+            data_t rtn;
+            if(is_closed()) throw QueueClosed();
+            if(!dequeue(rtn)) {
+                if(!wait_until([&]() { return dequeue(rtn); }, num_parked_consumers, current_clock().deadline_after_ms(timeout_ms))) {
+                    if(is_closed()) throw QueueClosed();
+                    this->counters.num_consume_timeouts.fetch_add(1, boost::memory_order_relaxed);
+                    return dft_rtn;
+                }
+            }
+            wake_up(num_parked_producers);
+            return rtn;
+        }
+
+        bool is_full() const {
+            return size() >= max_size;
+        }
+
+        bool is_empty() const {
+            return size() == 0;
+        }
+
+        // approximate when producers/consumers are active at the same time
+        unsigned int size() const {
+            std::size_t deq = dequeue_pos.load(boost::memory_order_acquire);
+            std::size_t enq = enqueue_pos.load(boost::memory_order_acquire);
+            return enq > deq ? (unsigned int)(enq - deq) : 0;
+        }
+
+        unsigned int capacity() const {
+            return max_size;
+        }
+
+        const char* backend_name() const {
+            return "LockFree";
+        }
+
+        void clear() {
+            data_t dummy;
+            while(try_consume(dummy)) {}
+        }
+
+        void close() {
+            closed.store(true, boost::memory_order_seq_cst);
+            park_mutex.lock(); // same handshake as wake_up(), a parked thread checks closed under park_mutex
+            park_mutex.unlock();
+            park_cond.notify_all();
+        }
+
+        bool is_closed() const {
+            return closed.load(boost::memory_order_acquire);
+        }
+
+    private:
+        static const unsigned int NUM_SPINS = 64;  // busy retries before yielding
+        static const unsigned int NUM_YIELDS = 16; // yielding retries before parking
+
+        struct alignas(64) Cell {
+            boost::atomic<std::size_t> sequence;
+            data_t data;
+        };
+
+        /* DropOldest: steal msgs from the consumer's end until the new one fits, never blocks */
+        void produce_evicting(const data_t& data) {
+            data_t evicted;
+            while(!enqueue(data)) {
+                if(dequeue(evicted)) this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+            }
+            wake_up(num_parked_consumers);
+        }
+
+        /* claim a cell and fill it, doesn't wake anybody up (so it can run while holding park_mutex) */
+        bool enqueue(const data_t& data) {
+            Cell* cell;
+            std::size_t pos = enqueue_pos.load(boost::memory_order_relaxed);
+            while(true) {
+                std::ptrdiff_t used = (std::ptrdiff_t)(pos - dequeue_pos.load(boost::memory_order_acquire));
+                if(used >= (std::ptrdiff_t)max_size) {
+                    return false; // full with respect to max_size
+                }
+                cell = &cells[pos & mask];
+                std::size_t seq = cell->sequence.load(boost::memory_order_acquire);
+                std::ptrdiff_t dif = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+                if(dif == 0) {
+                    if(enqueue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if(dif < 0) {
+                    return false; // full, the cell hasn't been consumed yet
+                }
+                else {
+                    pos = enqueue_pos.load(boost::memory_order_relaxed);
+                }
+            }
+            cell->data = data;
+            cell->sequence.store(pos + 1, boost::memory_order_release);
+            return true;
+        }
+
+        bool dequeue(data_t& data) {
+            Cell* cell;
+            std::size_t pos = dequeue_pos.load(boost::memory_order_relaxed);
+            while(true) {
+                cell = &cells[pos & mask];
+                std::size_t seq = cell->sequence.load(boost::memory_order_acquire);
+                std::ptrdiff_t dif = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+                if(dif == 0) {
+                    if(dequeue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if(dif < 0) {
+                    return false; // empty
+                }
+                else {
+                    pos = dequeue_pos.load(boost::memory_order_relaxed);
+                }
+            }
+            data = std::move(cell->data); // don't keep shared payloads (ConstMsgPtr) alive in a consumed cell
+            cell->sequence.store(pos + mask + 1, boost::memory_order_release);
+            return true;
+        }
+
+        static const uint64_t NO_DEADLINE = UINT64_MAX;
+
+        /* spin-then-park until attempt() succeeds, return false once deadline_ns passed (on the current clock)
+         * or the queue got closed
+         */
+        template <typename Attempt>
+        bool wait_until(Attempt attempt, boost::atomic<unsigned int>& num_parked, uint64_t deadline_ns) {
+            Clock& clock = current_clock();
+            for(unsigned int i = 0; i < NUM_SPINS + NUM_YIELDS; i++) {
+                if(attempt()) return true;
+                if(is_closed()) return false;
+                if(i >= NUM_SPINS) boost::this_thread::yield();
+                if(deadline_ns != NO_DEADLINE && clock.now_ns() >= deadline_ns) return false;
+            }
+
+            bool fulfilled = true;
+            num_parked.fetch_add(1, boost::memory_order_seq_cst);
+            boost::atomic_thread_fence(boost::memory_order_seq_cst); // pairs with the fence in wake_up()
+            park_mutex.lock();
+            while(!attempt()) {
+                if(is_closed()) {
+                    fulfilled = false;
+                    break;
+                }
+                if(deadline_ns == NO_DEADLINE) {
+                    park_cond.wait(park_mutex);
+                }
+                else if(!clock.wait_until(park_cond, park_mutex, deadline_ns)) {
+                    fulfilled = attempt();
+                    break;
+                }
+            }
+            park_mutex.unlock();
+            num_parked.fetch_sub(1, boost::memory_order_seq_cst);
+            return fulfilled;
+        }
+
+        void wake_up(boost::atomic<unsigned int>& num_parked) {
+            boost::atomic_thread_fence(boost::memory_order_seq_cst); // the cell update must be visible before checking
+            if(num_parked.load(boost::memory_order_relaxed) == 0) return;
+            park_mutex.lock(); // a parked thread is either before its last attempt or already waiting
+            park_mutex.unlock();
+            park_cond.notify_all();
+        }
+
+        unsigned int max_size;
+        std::size_t num_cells, mask;
+        Cell* cells;
+
+        alignas(64) boost::atomic<std::size_t> enqueue_pos;
+        alignas(64) boost::atomic<std::size_t> dequeue_pos;
+
+        alignas(64) boost::atomic<unsigned int> num_parked_producers;
+        boost::atomic<unsigned int> num_parked_consumers;
+        boost::mutex park_mutex;
+        boost::condition_variable_any park_cond; // shared by both sides, parking is the slow path anyway
+        boost::atomic<bool> closed;
+};
@@ -0,0 +1,581 @@
+/*
+ * Shared-memory transport of the ITPS, to share topics between processes on the same machine
+ */
+
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <typeinfo>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/core/demangle.hpp>
+#include <boost/thread/thread.hpp>
+#include "CpQueue.hpp"
+#include "Trace.hpp"
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#if BOOST_ATOMIC_INT32_LOCK_FREE != 2 || BOOST_ATOMIC_INT64_LOCK_FREE != 2
+#error "ITPS: the shared-memory transport needs lock-free 32/64-bit atomics"
+#endif
+
+namespace ITPS {
+
+    /*
+     * A topic exported by a publisher (export_shm() in PubSub.hpp) is mirrored into a POSIX
+     * shared-memory object named "/TritonBot.<key>", laid out as
+     *
+     *      [ ShmHeader | latest-value slot | queue indices | queue cells (Blocking mode only) ]
+     *
+     *  * The latest msg lives in a seqlock slot: a writer makes the sequence number odd, copies the msg
+     *    and makes it even again, readers copy the msg out and retry if the sequence number moved meanwhile.
+     *    Readers never write to the slot, so any number of processes can follow a topic, and
+     *    version = number of writes, same as the version number of the in-process channels.
+     *  * Blocking topics also get a bounded MPMC queue (Vyukov's, one sequence number per cell).
+     *    Unlike the in-process channels it's ONE queue shared by every importing subscriber, so each msg
+     *    is consumed once, by one of them (SPSC being the common case). The exporting publisher never waits
+     *    on another process: when the queue is full the incoming msg is dropped and counted.
+     *  * Blocking reads (wait_for_update(), pop_msg()) sleep on a futex word of the segment that every
+     *    publish/consume bumps, the wake-up syscall is only made when somebody is actually sleeping.
+     *
+     * The bytes are copied as they are, hence the restriction to trivially copyable msgs, and both sides
+     * must be built with the same msg layout: the header records sizeof(Msg) and the type name,
+     * an importer rejects a segment that doesn't match.
+     *
+     * Segments outlive their exporter: importers keep reading the last msg, and a restarted exporter
+     * reuses a compatible segment, so the importers don't need to re-subscribe. An incompatible leftover
+     * (e.g. the msg type changed) is unlinked and replaced, processes still mapping it have to restart.
+     */
+    struct ShmHeader {
+        static const uint32_t MAGIC = 0x49545053; // "ITPS"
+        static const uint32_t LAYOUT_VERSION = 1;
+        static const unsigned int TYPE_NAME_SIZE = 128;
+
+        boost::atomic<uint32_t> magic;        // stored last by the initializing process
+        uint32_t layout_version;
+        uint64_t msg_size;
+        uint64_t queue_capacity;              // 0: latest value only (NonBlocking topics)
+        uint64_t segment_size;
+        char msg_type[TYPE_NAME_SIZE];        // typeid(Msg).name(), truncated
+        boost::atomic<uint64_t> num_dropped;  // queue overflows
+        boost::atomic<uint32_t> event;        // futex word, bumped by every publish & consume
+        boost::atomic<uint32_t> num_sleepers; // processes sleeping on event
+    };
+
+
+    namespace shm_detail {
+        static_assert(sizeof(boost::atomic<uint32_t>) == sizeof(uint32_t), "ITPS: futex word must be a plain 32-bit int");
+
+        const std::size_t CACHE_LINE = 64;
+
+        inline std::size_t align_up(std::size_t n, std::size_t alignment) {
+            return (n + alignment - 1) / alignment * alignment;
+        }
+
+        // "/TritonBot.<key>", with the characters shm_open() doesn't like replaced
+        inline std::string segment_name(const std::string& key) {
+            std::string name = "/TritonBot.";
+            for(char c: key) {
+                bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                          || c == '.' || c == '-' || c == '_';
+                name += ok ? c : '_';
+            }
+            return name;
+        }
+
+        inline std::string errno_str() {
+            return std::string(std::strerror(errno));
+        }
+
+        // sleep while *word == expected, at most timeout_ns (0: no timeout), spurious wake-ups are fine
+        inline void wait_on(boost::atomic<uint32_t>* word, uint32_t expected, uint64_t timeout_ns) {
+#ifdef __linux__
+            // not FUTEX_PRIVATE_FLAG: the word is shared between processes
+            struct timespec ts;
+            ts.tv_sec = timeout_ns / 1000000000ULL;
+            ts.tv_nsec = timeout_ns % 1000000000ULL;
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+                    timeout_ns == 0 ? nullptr : &ts, nullptr, 0);
+#else
+            // no futex, poll
+            (void) expected;
+            uint64_t step = 100000; // 100us
+            if(timeout_ns != 0 && timeout_ns < step) step = timeout_ns;
+            boost::this_thread::sleep_for(boost::chrono::nanoseconds(step));
+#endif
+        }
+
+        inline void wake_all(boost::atomic<uint32_t>* word) {
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+            (void) word;
+#endif
+        }
+    }
+
+
+    /* What a MsgChannel sees of its shared-memory mirror, the type-erased side of ShmTopic<Msg>
+     * (so that channels of non trivially copyable msgs compile, as long as they're never exported)
+     */
+    template <typename Msg>
+    class ShmEndpoint {
+        public:
+            virtual ~ShmEndpoint() {}
+
+            // latest value & queue (if any), never blocks
+            virtual void publish(const Msg& msg) = 0;
+            virtual Msg read(uint64_t& version) = 0;
+            virtual uint64_t version() = 0;
+            // block until version() > last_seen, return false on timeout (unit: milliseconds)
+            virtual bool wait_for_update(uint64_t last_seen, unsigned int timeout_ms) = 0;
+            virtual uint64_t num_dropped() = 0;
+    };
+
+
+    template <typename Msg>
+    class ShmTopic : public ShmEndpoint<Msg> {
+        static_assert(std::is_trivially_copyable<Msg>::value,
+                      "ITPS: only trivially copyable msgs can be shared across processes");
+        static_assert(alignof(Msg) <= shm_detail::CACHE_LINE, "ITPS: over-aligned msg type");
+
+        struct Slot {
+            boost::atomic<uint64_t> seq; // odd while being written, version = seq / 2
+            Msg data;
+        };
+
+        struct Cell {
+            boost::atomic<uint64_t> seq;
+            Msg data;
+        };
+
+        struct QueueIndices {
+            alignas(shm_detail::CACHE_LINE) boost::atomic<uint64_t> enqueue_pos;
+            alignas(shm_detail::CACHE_LINE) boost::atomic<uint64_t> dequeue_pos;
+        };
+
+        public:
+            /* exporter side: create the segment of key, or reuse a compatible one left by a previous run
+             * queue_capacity: 0 for a NonBlocking topic, rounded up to a power of 2 otherwise
+             */
+            static boost::shared_ptr<ShmTopic> create(const std::string& key, unsigned int queue_capacity) {
+                uint64_t capacity = 0;
+                if(queue_capacity > 0) {
+                    capacity = 1;
+                    while(capacity < queue_capacity) capacity <<= 1;
+                }
+                std::string name = shm_detail::segment_name(key);
+                std::size_t size = segment_size(capacity);
+
+                int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+                if(fd < 0) throw std::runtime_error("ITPS: shm_open(" + name + ") failed: " + shm_detail::errno_str());
+                struct stat st;
+                if(fstat(fd, &st) == 0 && st.st_size != 0 && (std::size_t) st.st_size != size) {
+                    // incompatible leftover, whoever still maps it keeps the old object
+                    close(fd);
+                    shm_unlink(name.c_str());
+                    fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+                    if(fd < 0) throw std::runtime_error("ITPS: shm_open(" + name + ") failed: " + shm_detail::errno_str());
+                    st.st_size = 0;
+                }
+                if(st.st_size == 0 && ftruncate(fd, size) != 0) {
+                    close(fd);
+                    throw std::runtime_error("ITPS: ftruncate(" + name + ") failed: " + shm_detail::errno_str());
+                }
+                void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                if(base == MAP_FAILED) throw std::runtime_error("ITPS: mmap(" + name + ") failed: " + shm_detail::errno_str());
+
+                boost::shared_ptr<ShmTopic> topic(new ShmTopic(base, size));
+                if(topic->compatible(capacity)) {
+                    topic->recover();
+                }
+                else {
+                    topic->initialize(capacity);
+                }
+                return topic;
+            }
+
+            /* importer side: map the segment of key
+             * return nullptr if no exporter created it yet, throw if it holds another msg type
+             */
+            static boost::shared_ptr<ShmTopic> open(const std::string& key) {
+                std::string name = shm_detail::segment_name(key);
+                int fd = shm_open(name.c_str(), O_RDWR, 0);
+                if(fd < 0) {
+                    if(errno == ENOENT) return nullptr;
+                    throw std::runtime_error("ITPS: shm_open(" + name + ") failed: " + shm_detail::errno_str());
+                }
+                struct stat st;
+                if(fstat(fd, &st) != 0 || (std::size_t) st.st_size < sizeof(ShmHeader)) {
+                    close(fd);
+                    return nullptr; // being created
+                }
+                std::size_t size = st.st_size;
+                void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                if(base == MAP_FAILED) throw std::runtime_error("ITPS: mmap(" + name + ") failed: " + shm_detail::errno_str());
+
+                boost::shared_ptr<ShmTopic> topic(new ShmTopic(base, size));
+                if(topic->header->magic.load(boost::memory_order_acquire) != ShmHeader::MAGIC) {
+                    return nullptr; // being initialized
+                }
+                if(!topic->compatible(topic->header->queue_capacity)) {
+                    throw std::runtime_error("ITPS: shared-memory segment " + name + " holds another msg type than "
+                                             + boost::core::demangle(typeid(Msg).name()));
+                }
+                return topic;
+            }
+
+            ~ShmTopic() {
+                munmap(base, size);
+            }
+
+            void publish(const Msg& msg) {
+                write(msg);
+                if(capacity > 0 && !try_push(msg)) {
+                    header->num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                }
+                notify();
+            }
+
+            // seqlock write, writers (of any process) are serialized by the odd sequence number
+            void write(const Msg& msg) {
+                uint64_t seq = slot->seq.load(boost::memory_order_relaxed);
+                for(;;) {
+                    if(seq & 1) {
+                        boost::this_thread::yield(); // another writer in the middle of its copy
+                        seq = slot->seq.load(boost::memory_order_relaxed);
+                        continue;
+                    }
+                    if(slot->seq.compare_exchange_weak(seq, seq + 1, boost::memory_order_acquire)) break;
+                }
+                boost::atomic_thread_fence(boost::memory_order_release); // odd seq visible before the data
+                std::memcpy(&slot->data, &msg, sizeof(Msg));
+                slot->seq.store(seq + 2, boost::memory_order_release);
+            }
+
+            Msg read(uint64_t& msg_version) {
+                Msg rtn;
+                for(;;) {
+                    uint64_t seq = slot->seq.load(boost::memory_order_acquire);
+                    if(seq & 1) {
+                        boost::this_thread::yield();
+                        continue;
+                    }
+                    std::memcpy(&rtn, &slot->data, sizeof(Msg));
+                    boost::atomic_thread_fence(boost::memory_order_acquire);
+                    if(slot->seq.load(boost::memory_order_relaxed) == seq) {
+                        msg_version = seq / 2;
+                        return rtn;
+                    }
+                }
+            }
+
+            uint64_t version() {
+                return slot->seq.load(boost::memory_order_acquire) / 2;
+            }
+
+            bool wait_for_update(uint64_t last_seen, unsigned int timeout_ms) {
+                return wait_until([this, last_seen]() { return version() > last_seen; }, deadline_after(timeout_ms));
+            }
+
+            uint64_t num_dropped() {
+                return header->num_dropped.load(boost::memory_order_relaxed);
+            }
+
+            /* Vyukov's bounded MPMC queue, return false if full */
+            bool try_push(const Msg& msg) {
+                uint64_t pos = indices->enqueue_pos.load(boost::memory_order_relaxed);
+                Cell* cell;
+                for(;;) {
+                    cell = &cells[pos & (capacity - 1)];
+                    uint64_t seq = cell->seq.load(boost::memory_order_acquire);
+                    int64_t dif = (int64_t) seq - (int64_t) pos;
+                    if(dif == 0) {
+                        if(indices->enqueue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+                    }
+                    else if(dif < 0) {
+                        return false;
+                    }
+                    else {
+                        pos = indices->enqueue_pos.load(boost::memory_order_relaxed);
+                    }
+                }
+                std::memcpy(&cell->data, &msg, sizeof(Msg));
+                cell->seq.store(pos + 1, boost::memory_order_release);
+                return true;
+            }
+
+            // return false if empty
+            bool try_pop(Msg& msg) {
+                uint64_t pos = indices->dequeue_pos.load(boost::memory_order_relaxed);
+                Cell* cell;
+                for(;;) {
+                    cell = &cells[pos & (capacity - 1)];
+                    uint64_t seq = cell->seq.load(boost::memory_order_acquire);
+                    int64_t dif = (int64_t) seq - (int64_t) (pos + 1);
+                    if(dif == 0) {
+                        if(indices->dequeue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+                    }
+                    else if(dif < 0) {
+                        return false;
+                    }
+                    else {
+                        pos = indices->dequeue_pos.load(boost::memory_order_relaxed);
+                    }
+                }
+                std::memcpy(&msg, &cell->data, sizeof(Msg));
+                cell->seq.store(pos + capacity, boost::memory_order_release);
+                return true;
+            }
+
+            // approximate while producers/consumers are active
+            unsigned int queue_size() {
+                uint64_t head = indices->dequeue_pos.load(boost::memory_order_relaxed);
+                uint64_t tail = indices->enqueue_pos.load(boost::memory_order_relaxed);
+                return tail > head ? (unsigned int) std::min<uint64_t>(tail - head, capacity) : 0;
+            }
+
+            unsigned int queue_capacity() {
+                return (unsigned int) capacity;
+            }
+
+            /* sleep on the segment's futex until ready() holds or the deadline passes (0: no deadline),
+             * return the last ready()
+             */
+            template <typename Pred>
+            bool wait_until(Pred ready, timestamp_t deadline) {
+                if(ready()) return true;
+                header->num_sleepers.fetch_add(1);
+                bool rtn;
+                for(;;) {
+                    uint32_t seen = header->event.load();
+                    if((rtn = ready())) break;
+                    timestamp_t now = now_ns();
+                    if(deadline != 0 && now >= deadline) break;
+                    shm_detail::wait_on(&header->event, seen, deadline == 0 ? 0 : deadline - now);
+                }
+                header->num_sleepers.fetch_sub(1);
+                return rtn;
+            }
+
+            static timestamp_t deadline_after(unsigned int timeout_ms) {
+                return now_ns() + (timestamp_t) timeout_ms * 1000000ULL;
+            }
+
+            // wake up the sleepers of all processes, a consume makes room for a waiting producer
+            void notify() {
+                header->event.fetch_add(1);
+                if(header->num_sleepers.load() > 0) shm_detail::wake_all(&header->event);
+            }
+
+        private:
+            ShmTopic(void* base, std::size_t size) : base(base), size(size) {
+                char* bytes = static_cast<char*>(base);
+                header = reinterpret_cast<ShmHeader*>(bytes);
+                slot = reinterpret_cast<Slot*>(bytes + slot_offset());
+                indices = reinterpret_cast<QueueIndices*>(bytes + indices_offset());
+                cells = reinterpret_cast<Cell*>(bytes + cells_offset());
+                capacity = 0;
+            }
+
+            static std::size_t slot_offset() {
+                return shm_detail::align_up(sizeof(ShmHeader), shm_detail::CACHE_LINE);
+            }
+
+            static std::size_t indices_offset() {
+                return shm_detail::align_up(slot_offset() + sizeof(Slot), shm_detail::CACHE_LINE);
+            }
+
+            static std::size_t cells_offset() {
+                return indices_offset() + sizeof(QueueIndices);
+            }
+
+            static std::size_t segment_size(uint64_t capacity) {
+                return cells_offset() + capacity * sizeof(Cell);
+            }
+
+            bool compatible(uint64_t queue_capacity) {
+                if(header->magic.load(boost::memory_order_acquire) != ShmHeader::MAGIC) return false;
+                char type_name[ShmHeader::TYPE_NAME_SIZE];
+                std::strncpy(type_name, typeid(Msg).name(), sizeof(type_name) - 1);
+                type_name[sizeof(type_name) - 1] = '\0';
+                bool ok = header->layout_version == ShmHeader::LAYOUT_VERSION
+                          && header->msg_size == sizeof(Msg)
+                          && header->queue_capacity == queue_capacity
+                          && header->segment_size == size
+                          && segment_size(queue_capacity) == size
+                          && std::strncmp(header->msg_type, type_name, sizeof(type_name)) == 0;
+                if(ok) capacity = queue_capacity;
+                return ok;
+            }
+
+            // fresh segment, importers only look at it once magic is stored
+            void initialize(uint64_t queue_capacity) {
+                std::memset(base, 0, size);
+                new (&header->magic) boost::atomic<uint32_t>(0);
+                new (&header->num_dropped) boost::atomic<uint64_t>(0);
+                new (&header->event) boost::atomic<uint32_t>(0);
+                new (&header->num_sleepers) boost::atomic<uint32_t>(0);
+                header->layout_version = ShmHeader::LAYOUT_VERSION;
+                header->msg_size = sizeof(Msg);
+                header->queue_capacity = queue_capacity;
+                header->segment_size = size;
+                std::strncpy(header->msg_type, typeid(Msg).name(), ShmHeader::TYPE_NAME_SIZE - 1);
+
+                new (&slot->seq) boost::atomic<uint64_t>(0);
+                new (&indices->enqueue_pos) boost::atomic<uint64_t>(0);
+                new (&indices->dequeue_pos) boost::atomic<uint64_t>(0);
+                for(uint64_t i = 0; i < queue_capacity; i++) {
+                    new (&cells[i].seq) boost::atomic<uint64_t>(i);
+                }
+                capacity = queue_capacity;
+                header->magic.store(ShmHeader::MAGIC, boost::memory_order_release);
+            }
+
+            // reused segment: a previous exporter may have died in the middle of a write
+            void recover() {
+                uint64_t seq = slot->seq.load();
+                if(seq & 1) slot->seq.compare_exchange_strong(seq, seq + 1);
+            }
+
+            void* base;
+            std::size_t size;
+            ShmHeader* header;
+            Slot* slot;
+            QueueIndices* indices;
+            Cell* cells;
+            uint64_t capacity; // power of 2, or 0
+    };
+
+
+    /* The subscriber queue of a BlockingSubscriber importing a topic (subscribe_shm() in PubSub.hpp):
+     * a MessageQueue view of the segment's MPMC queue. The trace contexts don't cross processes.
+     */
+    template <typename Msg>
+    class ShmMessageQueue : public MessageQueue<Traced<Msg>> {
+        public:
+            ShmMessageQueue(boost::shared_ptr<ShmTopic<Msg>> topic)
+                : MessageQueue<Traced<Msg>>(OverflowPolicy::DropNewest), topic(topic) {}
+
+            bool offer(Traced<Msg> data) {
+                if(!is_closed() && topic->try_push(data.data)) {
+                    topic->notify();
+                    return true;
+                }
+                this->counters.num_dropped.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+
+            bool offer(Traced<Msg> data, unsigned int timeout_ms) {
+                (void) timeout_ms;
+                return offer(data);
+            }
+
+            void produce(Traced<Msg> data) {
+                push(data, 0);
+            }
+
+            bool produce(Traced<Msg> data, unsigned int timeout_ms) {
+                return push(data, topic->deadline_after(timeout_ms));
+            }
+
+            Traced<Msg> consume() {
+                Traced<Msg> rtn;
+                pop(rtn, 0);
+                return rtn;
+            }
+
+            Traced<Msg> consume(unsigned int timeout_ms, Traced<Msg> dft_rtn) {
+                Traced<Msg> rtn;
+                if(!pop(rtn, topic->deadline_after(timeout_ms))) {
+                    this->counters.num_consume_timeouts.fetch_add(1, boost::memory_order_relaxed);
+                    return dft_rtn;
+                }
+                return rtn;
+            }
+
+            bool try_consume(Traced<Msg>& data) {
+                if(!topic->try_pop(data.data)) return false;
+                data.trace = TraceContext();
+                topic->notify();
+                return true;
+            }
+
+            bool is_full() const {
+                return topic->queue_size() >= topic->queue_capacity();
+            }
+
+            bool is_empty() const {
+                return topic->queue_size() == 0;
+            }
+
+            unsigned int size() const {
+                return topic->queue_size();
+            }
+
+            unsigned int capacity() const {
+                return topic->queue_capacity();
+            }
+
+            void clear() {
+                Msg msg;
+                while(topic->try_pop(msg)) {}
+                topic->notify();
+            }
+
+            const char* backend_name() const {
+                return "SharedMemory";
+            }
+
+            // only this process' side, the other importers & the exporter keep going
+            void close() {
+                closed.store(true);
+                topic->notify(); // also wakes up the sleepers of other processes, they just check again
+            }
+
+            bool is_closed() const {
+                return closed.load();
+            }
+
+        private:
+            // deadline 0: forever, false once closed
+            bool push(const Traced<Msg>& data, timestamp_t deadline) {
+                bool pushed = false;
+                topic->wait_until([&]() { return is_closed() || (pushed = topic->try_push(data.data)); }, deadline);
+                if(!pushed) return false;
+                topic->notify();
+                return true;
+            }
+
+            // deadline 0: forever, throw QueueClosed once closed
+            bool pop(Traced<Msg>& rtn, timestamp_t deadline) {
+                bool popped = false;
+                topic->wait_until([&]() { return is_closed() || (popped = topic->try_pop(rtn.data)); }, deadline);
+                if(popped) {
+                    topic->notify();
+                    return true;
+                }
+                if(is_closed()) throw QueueClosed();
+                return false;
+            }
+
+            boost::shared_ptr<ShmTopic<Msg>> topic;
+            boost::atomic<bool> closed{false};
+    };
+
+}
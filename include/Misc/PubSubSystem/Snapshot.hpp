@@ -0,0 +1,86 @@
+/*
+ * Consistent multi-topic reads of NonBlocking ("NB") ITPS topics
+ */
+
+#pragma once
+
+#include <tuple>
+#include <utility>
+#include <cstdint>
+#include <boost/thread/thread.hpp>
+#include "PubSub.hpp"
+
+namespace ITPS {
+
+    /*
+     * Reads the latest msgs of several NB topics as one consistent view, instead of calling
+     * latest_msg() on each subscriber in turn and mixing msgs from different publishes:
+     *
+     *      ITPS::Snapshot<MotionEKF::MotionData, arma::vec> inputs(sensor_sub, kicker_setpoint_sub);
+     *      ...
+     *      inputs.read(feedback, kicker_setpoint);
+     *
+     * Lock-free double collect: copy every msg together with its version number, then check that
+     * no version has moved on meanwhile, so there was an instant when all the msgs read were the latest
+     * ones at the same time. Topics whose publishers joined a PublishGroup are also checked against the
+     * group sequence lock, so a group update is either seen entirely or not at all. On a conflict
+     * (a publish landed in the middle of the read) the whole read is simply retried.
+     *
+     * The subscribers must outlive the Snapshot, and be subscribed before read() is called.
+     */
+    template <typename... Msgs>
+    class Snapshot {
+        public:
+            Snapshot(NonBlockingSubscriber<Msgs>&... subscribers) : subs(subscribers...) {}
+
+            void read(Msgs&... msgs) {
+                read_impl(std::index_sequence_for<Msgs...>{}, msgs...);
+            }
+
+            std::tuple<Msgs...> read() {
+                std::tuple<Msgs...> rtn;
+                std::apply([this](Msgs&... msgs) { read(msgs...); }, rtn);
+                return rtn;
+            }
+
+            // the reads retried so far because of a conflicting publish, for diagnostics
+            uint64_t num_retries() const {
+                return retries;
+            }
+
+        private:
+            static const unsigned int NUM_SPINS = 16; // retries before yielding to the publishers
+
+            template <std::size_t... I>
+            void read_impl(std::index_sequence<I...>, Msgs&... msgs) {
+                constexpr std::size_t N = sizeof...(Msgs);
+                PublishGroup* groups[N] = {std::get<I>(subs).publish_group()...};
+                uint64_t group_seqs[N];
+                uint64_t versions[N];
+
+                for(unsigned int attempt = 0; ; attempt++) {
+                    for(std::size_t i = 0; i < N; i++) {
+                        group_seqs[i] = groups[i] ? groups[i]->read_begin() : 0;
+                    }
+
+                    // first collect
+                    ((msgs = std::get<I>(subs).latest_msg(versions[I])), ...);
+
+                    // second collect, versions only
+                    bool consistent = true;
+                    ((consistent = consistent && std::get<I>(subs).latest_version() == versions[I]), ...);
+                    for(std::size_t i = 0; i < N && consistent; i++) {
+                        consistent = !(groups[i] && groups[i]->read_retry(group_seqs[i]));
+                    }
+                    if(consistent) return;
+                    retries++;
+
+                    if(attempt >= NUM_SPINS) boost::this_thread::yield();
+                }
+            }
+
+            std::tuple<NonBlockingSubscriber<Msgs>&...> subs;
+            uint64_t retries = 0;
+    };
+
+}
@@ -0,0 +1,97 @@
+/*
+ * Callback-driven (reactive) subscriptions of the ITPS, check on_message() in PubSub.hpp
+ */
+
+#pragma once
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/atomic.hpp>
+
+namespace ITPS {
+
+    // notified by a MsgChannel after every publish
+    class MsgListener {
+        public:
+            virtual ~MsgListener() {}
+            virtual void on_publish() = 0;
+    };
+
+
+    /* Runs a handler on an executor (ThreadPool, ThreadPool::Strand, anything with execute(func))
+     * whenever the channel it listens to gets a publish.
+     *
+     * Notifications are coalesced: at most one run of the handler is pending at a time, the handler
+     * itself fetches what's new when it runs (the latest msg, or everything in its queue). So a fast
+     * publisher never floods the executor, and a slow handler simply skips intermediate NB msgs.
+     */
+    class CallbackDispatch : public MsgListener, public boost::enable_shared_from_this<CallbackDispatch> {
+        public:
+            typedef boost::function<void(boost::function<void()>)> executor_t;
+
+            CallbackDispatch(boost::function<void()> handler, executor_t executor)
+                : handler(handler), executor(executor), pending(false), cancelled(false) {}
+
+            template <typename Executor>
+            static executor_t wrap(Executor& executor) {
+                return [&executor](boost::function<void()> func) { executor.execute(func); };
+            }
+
+            void on_publish() {
+                if(cancelled.load()) return;
+                if(pending.exchange(true)) return; // a run is already on its way, it'll see this publish too
+                boost::shared_ptr<CallbackDispatch> self = shared_from_this();
+                executor([self]() { self->run(); });
+            }
+
+            void cancel() {
+                cancelled.store(true);
+            }
+
+            bool is_cancelled() const {
+                return cancelled.load();
+            }
+
+        private:
+            void run() {
+                pending.store(false); // publishes from now on schedule another run
+                if(cancelled.load()) return;
+                handler();
+            }
+
+            boost::function<void()> handler;
+            executor_t executor;
+            boost::atomic<bool> pending;
+            boost::atomic<bool> cancelled;
+    };
+
+
+    /* Handle of a callback subscription returned by on_message()
+     * cancel() detaches it from the channel, a run of the handler already in progress still completes.
+     * Dropping the handle doesn't cancel the subscription.
+     */
+    class Subscription {
+        public:
+            Subscription() {}
+
+            Subscription(boost::shared_ptr<CallbackDispatch> dispatch, boost::function<void()> detach)
+                : dispatch(dispatch), detach(detach) {}
+
+            void cancel() {
+                if(!dispatch) return;
+                dispatch->cancel();
+                detach();
+                dispatch.reset();
+            }
+
+            bool active() const {
+                return dispatch && !dispatch->is_cancelled();
+            }
+
+        private:
+            boost::shared_ptr<CallbackDispatch> dispatch;
+            boost::function<void()> detach;
+    };
+
+}
@@ -5,8 +5,27 @@
 #include <iostream>
 #include <boost/thread/thread.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
 #include <vector>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include "ThreadSched.hpp"
+#include "TimerWheel.hpp"
+#include "WorkStealingExecutor.hpp"
+#include "ChannelStats.hpp"
 
 //-------------------------------------------------------------------------------------------------------------------//
 
@@ -14,9 +33,25 @@
 
 class ThreadPool {
 public:
-    ThreadPool(unsigned int num_threads) : io_work(ios) {
+    /* where the posted functions wait for a thread:
+     *  IoService: the single queue of a boost io_service, shared by all the threads
+     *  WorkStealing: a queue per thread, check WorkStealingExecutor, for many short functions posted
+     *                from many threads (callbacks...). Plus one more thread for the timers' io_service
+     * benchmark/ThreadPoolBenchmark.cpp compares them
+     */
+    enum class Backend {IoService, WorkStealing};
+
+    // sched: of every pool thread, check ThreadSched
+    ThreadPool(unsigned int num_threads, const ThreadSched& sched = ThreadSched("pool"), Backend backend = Backend::IoService)
+        : io_work(ios), worker_sched(sched), num_workers(num_threads), timer_start(boost::asio::steady_timer::clock_type::now()),
+          tick_timer(ios), armed_tick(TimerWheel<timer_ptr>::NO_TICK) {
+        if(backend == Backend::WorkStealing) {
+            stealing.reset(new WorkStealingExecutor(num_threads, sched));
+            threads.create_thread(boost::bind(&ThreadPool::run_worker, this)); // only runs the timer wheel's ticks
+            return;
+        }
         for (int i = 0; i < num_threads; i++) {
-            threads.create_thread(boost::bind(&boost::asio::io_service::run, &ios));
+            threads.create_thread(boost::bind(&ThreadPool::run_worker, this));
         }
     }
 
@@ -26,43 +61,470 @@ public:
             threads.join_all(); // wait for all threads to terminate
         }
         catch ( const std::exception& ) {}
+        stealing.reset(); // after the io_service thread, which may post to it
     }
 
     template<class Function>
     void execute(Function func) {
-        ios.post(func); // add the function to the io_service queue 
-                        // to be run in the threads created in the constructor
+        post(instrument(func)); // add the function to the backend's queue 
+                                // to be run in the threads created in the constructor
         // non-blocking, return immediately
 
         /* if there aren't available threads in the pool, i.e. every
            thread in the pool is already busy executing some other 
            function, the new coming thread has to wait until one of 
            the running thread is finished. */
+    }
 
-        /* No counter provided to track the number of free threads             
-           due to implementation overheads with wrapping func with 
-           a counter addition when function finishes, and at the same
-           time supporting boost::bind externally for passing func. 
-           Refer to this post for more details: 
-                https://stackoverflow.com/questions/12215395/thread-pool-using-boost-asio/12267138#12267138
-        */
-       num_tasks++;
+    /* execute(func) and get its result (or the exception it threw) through the returned future.
+     * Waiting on the future from a pool thread deadlocks if all the others are busy, parallel_for() doesn't
+     */
+    template<class Function>
+    auto submit(Function func) -> std::future<decltype(func())> {
+        typedef decltype(func()) Result;
+        std::shared_ptr< std::packaged_task<Result()> > task = std::make_shared< std::packaged_task<Result()> >(func);
+        std::future<Result> rtn = task->get_future();
+        execute([task]() { (*task)(); });
+        return rtn;
+    }
+
+    /* func(i) for every i in [begin, end), return once they all completed. The range is split into chunks
+     * of grain indices (0: about 4 chunks per thread) taken in turns by the calling thread and the pool's
+     * threads as they become free, so it completes even when every pool thread is busy, e.g. hosting a module,
+     * and it may be called from a pool thread. If func throws, the chunks not started yet are skipped and
+     * the first exception is rethrown here.
+     *
+     *      pool.parallel_for(0, NUM_ROBOTS, [&](std::size_t i) { robots[i].update(); });
+     */
+    template<class Function>
+    void parallel_for(std::size_t begin, std::size_t end, Function func, std::size_t grain = 0) {
+        for_chunks(begin, end, grain, [&func](std::size_t, std::size_t first, std::size_t last) {
+            for(std::size_t i = first; i < last; i++) func(i);
+        });
     }
 
-    /* total CUMULATIVE number of tasks ever being posted by ThreadPool::execute,
+    /* reduce(...reduce(reduce(identity, map(begin)), map(begin + 1))..., map(end - 1)), run as parallel_for(),
+     * each chunk folding its own indices from identity. The chunks' results are then folded in index order,
+     * so reduce only needs to be associative, not commutative, and the result doesn't depend on the timing.
+     *
+     *      double best = pool.parallel_reduce(0, candidates.size(), -1e9, [&](std::size_t i) { return score(candidates[i]); },
+     *                                         [](double a, double b) { return std::max(a, b); });
+     */
+    template<typename T, class Map, class Reduce>
+    T parallel_reduce(std::size_t begin, std::size_t end, T identity, Map map, Reduce reduce, std::size_t grain = 0) {
+        std::deque<T> results; // not a vector, the chunks write their own element concurrently (vector<bool>...)
+        for_chunks(begin, end, grain, [&](std::size_t chunk, std::size_t first, std::size_t last) {
+            T result = identity;
+            for(std::size_t i = first; i < last; i++) result = reduce(result, map(i));
+            results[chunk] = result;
+        }, [&](std::size_t num_chunks) { results.assign(num_chunks, identity); });
+        T rtn = identity;
+        for(auto& result: results) rtn = reduce(rtn, result);
+        return rtn;
+    }
+
+    unsigned int num_threads() const {
+        return num_workers;
+    }
+
+    /* total CUMULATIVE number of tasks ever posted to the pool (execute(), the strands, the timers' runs),
      * which also include those tasks that are already finished
      * */
-    unsigned int num_posted_funcs() {
-        return num_tasks;
+    uint64_t num_posted_funcs() const {
+        return num_tasks.load(boost::memory_order_relaxed);
+    }
+
+    // tasks posted but not started yet, those waiting in a Strand included
+    unsigned int queue_depth() const {
+        return num_queued.load(boost::memory_order_relaxed);
+    }
+
+    // pool threads running a task, e.g. a module's loop
+    unsigned int num_active() const {
+        return num_running.load(boost::memory_order_relaxed);
+    }
+
+    // posted => started, of every task
+    const ITPS::DurationHistogram& wait_time() const {
+        return task_wait_time;
+    }
+
+    // of the completed tasks, the ones still running (module loops...) aren't in there yet
+    const ITPS::DurationHistogram& run_time() const {
+        return task_run_time;
+    }
+
+    std::string dump_stats() const {
+        std::ostringstream os;
+        os << "threads=" << num_workers
+           << " active=" << num_active()
+           << " queued=" << queue_depth()
+           << " posted=" << num_posted_funcs()
+           << " wait_p50<" << task_wait_time.percentile(0.5) / 1000 << "us"
+           << " wait_p99<" << task_wait_time.percentile(0.99) / 1000 << "us"
+           << " run_mean=" << task_run_time.mean() / 1000 << "us"
+           << " run_p99<" << task_run_time.percentile(0.99) / 1000 << "us";
+        return os.str();
+    }
+
+    /* scheduling attributes of the pool threads, a task changing its thread's
+     * (check Module::set_sched()) restores them before returning the thread to the pool
+     */
+    const ThreadSched& sched() const {
+        return worker_sched;
+    }
+
+    /* Handle of a timer, check schedule_after()/schedule_every(), must not outlive the pool.
+     * Dropping the handle doesn't cancel the timer.
+     */
+    class Timer {
+    public:
+        Timer() {}
+
+        /* no more runs, then wait for a run in progress to complete, unless called from it,
+         * e.g. before the objects the function uses go away
+         */
+        void cancel() {
+            if(state) state->pool.cancel_timer(state.get());
+        }
+
+        // false once cancelled, or once a schedule_after() one has run
+        bool active() const {
+            return state && !state->done.load();
+        }
+
+    private:
+        friend class ThreadPool;
+
+        struct State {
+            State(ThreadPool& pool, boost::function<void()> func, uint64_t period_ticks)
+                : pool(pool), func(func), period_ticks(period_ticks), expiry_tick(0), running(false), done(false) {}
+
+            ThreadPool& pool;
+            boost::function<void()> func;
+            const uint64_t period_ticks; // 0: runs once
+            uint64_t expiry_tick;        // with timer_mutex, as running
+            bool running;
+            boost::atomic<bool> done;
+        };
+
+        Timer(boost::shared_ptr<State> state) : state(state) {}
+
+        boost::shared_ptr<State> state;
+    };
+
+    // resolution of the timers, their delays & periods are rounded up to it
+    static const unsigned int TIMER_TICK_MS = 1;
+
+    /* run func once on the pool's threads, delay_ms from now.
+     * The timers are kept in a TimerWheel driven by a single asio timer of the pool, so a waiting
+     * timer doesn't hold any thread, unlike a module looping on delay(). Measured on the steady clock,
+     * i.e. real time even while a SimulatedClock is set (check Clock.hpp)
+     */
+    template<class Function>
+    Timer schedule_after(unsigned int delay_ms, Function func) {
+        return add_timer(delay_ms, 0, boost::function<void()>(func));
     }
 
+    /* run func every period_ms on the pool's threads, the first time one period from now, until cancelled.
+     * Runs are on absolute deadlines (no drift), never concurrent with each other: a run that takes longer
+     * than the period skips the deadlines it missed, as PeriodicTimer does.
+     * Keep the runs short, they share the threads of the pool with everything else
+     */
+    template<class Function>
+    Timer schedule_every(unsigned int period_ms, Function func) {
+        if(period_ms == 0) throw std::runtime_error("ThreadPool: the period of a timer must be positive");
+        return add_timer(period_ms, period_ms, boost::function<void()>(func));
+    }
+
+    /* Serializes the functions executed through it: they still run on the pool's threads,
+     * but never concurrently with each other, and in the order they were posted.
+     * Typically one per module, so its callback subscriptions (check ITPS::Subscription)
+     * don't need any locking among themselves. Must not outlive the pool.
+     */
+    class Strand {
+    public:
+        Strand(ThreadPool& thread_pool) : pool(thread_pool), state(new State()) {}
+
+        template<class Function>
+        void execute(Function func) {
+            bool idle;
+            {
+                boost::lock_guard<boost::mutex> lock(state->mutex);
+                state->funcs.push_back(pool.instrument(func));
+                idle = !state->scheduled;
+                state->scheduled = true;
+            }
+            if(idle) schedule(pool, state);
+        }
+
+        /* block until the functions posted so far have run, e.g. after cancelling the subscriptions
+         * posting to it, no-op when called from the strand itself
+         */
+        void drain() {
+            if(running_strand() == state.get()) return;
+            boost::mutex mu;
+            boost::condition_variable_any cond;
+            bool done = false;
+            execute([&]() {
+                boost::lock_guard<boost::mutex> lock(mu);
+                done = true;
+                cond.notify_all();
+            });
+            boost::unique_lock<boost::mutex> lock(mu);
+            while(!done) cond.wait(lock);
+        }
+
+    private:
+        // shared with the pool task running it, which may outlive the Strand
+        struct State {
+            boost::mutex mutex;
+            std::deque< boost::function<void()> > funcs; // with mutex, as scheduled
+            bool scheduled = false; // a pool task is on its way to run funcs
+        };
+
+        static void schedule(ThreadPool& pool, boost::shared_ptr<State> state) {
+            pool.post([&pool, state]() { run(pool, state); });
+        }
+
+        // the functions queued so far, then back to the end of the pool's queue if more came meanwhile
+        static void run(ThreadPool& pool, const boost::shared_ptr<State>& state) {
+            std::deque< boost::function<void()> > funcs;
+            {
+                boost::lock_guard<boost::mutex> lock(state->mutex);
+                funcs.swap(state->funcs);
+            }
+            running_strand() = state.get();
+            for(auto& func: funcs) func();
+            running_strand() = nullptr;
+            bool more;
+            {
+                boost::lock_guard<boost::mutex> lock(state->mutex);
+                more = !state->funcs.empty();
+                state->scheduled = more;
+            }
+            if(more) schedule(pool, state);
+        }
+
+        // the strand the calling thread is running the functions of
+        static State*& running_strand() {
+            static thread_local State* strand = nullptr;
+            return strand;
+        }
+
+        ThreadPool& pool;
+        boost::shared_ptr<State> state;
+    };
+
 private:
+    typedef boost::shared_ptr<Timer::State> timer_ptr;
+
+    void run_worker() {
+        worker_sched.apply();
+        ios.run();
+    }
+
+    // to the backend, as is
+    void post(boost::function<void()> func) {
+        if(stealing) stealing->execute(func);
+        else ios.post(func);
+    }
+
+    static uint64_t steady_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // func wrapped to keep the metrics, to be posted right away
+    template<class Function>
+    boost::function<void()> instrument(Function func) {
+        num_tasks.fetch_add(1, boost::memory_order_relaxed);
+        num_queued.fetch_add(1, boost::memory_order_relaxed);
+        uint64_t posted_ns = steady_ns();
+        return [this, func, posted_ns]() mutable {
+            uint64_t start_ns = steady_ns();
+            num_queued.fetch_sub(1, boost::memory_order_relaxed);
+            task_wait_time.record(start_ns - posted_ns);
+            RunningTask running(*this, start_ns); // also when func throws, which ends its thread
+            func();
+        };
+    }
+
+    struct RunningTask {
+        RunningTask(ThreadPool& pool, uint64_t start_ns) : pool(pool), start_ns(start_ns) {
+            pool.num_running.fetch_add(1, boost::memory_order_relaxed);
+        }
+        ~RunningTask() {
+            pool.task_run_time.record(steady_ns() - start_ns);
+            pool.num_running.fetch_sub(1, boost::memory_order_relaxed);
+        }
+        ThreadPool& pool;
+        const uint64_t start_ns;
+    };
+
+    // a parallel_for(), shared with the pool tasks helping with it, which may start after it returned
+    struct ParallelJob {
+        ParallelJob(std::size_t num_chunks) : num_chunks(num_chunks), next_chunk(0), num_done(0), failed(false) {}
+
+        // take & run chunks until there's none left
+        void work() {
+            std::size_t chunk;
+            while((chunk = next_chunk.fetch_add(1)) < num_chunks) {
+                if(!failed.load()) {
+                    try {
+                        run_chunk(chunk);
+                    }
+                    catch(...) {
+                        boost::lock_guard<boost::mutex> lock(mutex);
+                        if(!error) error = std::current_exception();
+                        failed.store(true);
+                    }
+                }
+                if(num_done.fetch_add(1) + 1 == num_chunks) {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+
+        const std::size_t num_chunks;
+        boost::function<void(std::size_t)> run_chunk; // only called before the parallel_for() returns
+        boost::atomic<std::size_t> next_chunk, num_done;
+        boost::atomic<bool> failed;
+        boost::mutex mutex;
+        boost::condition_variable_any done; // with mutex
+        std::exception_ptr error;           // with mutex
+    };
+
+    /* run_chunk(chunk, first, last) for the chunks of [begin, end) as described in parallel_for(),
+     * with prepare(num_chunks) called before any
+     */
+    void for_chunks(std::size_t begin, std::size_t end, std::size_t grain,
+                    boost::function<void(std::size_t, std::size_t, std::size_t)> run_chunk,
+                    boost::function<void(std::size_t)> prepare = boost::function<void(std::size_t)>()) {
+        if(end <= begin) {
+            if(prepare) prepare(0);
+            return;
+        }
+        std::size_t n = end - begin;
+        if(grain == 0) grain = std::max<std::size_t>(1, n / (4 * (num_workers + 1)));
+        std::size_t num_chunks = (n + grain - 1) / grain;
+        if(prepare) prepare(num_chunks);
+
+        boost::shared_ptr<ParallelJob> job(new ParallelJob(num_chunks));
+        job->run_chunk = [&run_chunk, begin, end, grain](std::size_t chunk) {
+            std::size_t first = begin + chunk * grain;
+            run_chunk(chunk, first, std::min(end, first + grain));
+        };
+        std::size_t num_helpers = std::min<std::size_t>(num_chunks - 1, num_workers);
+        for(std::size_t i = 0; i < num_helpers; i++) {
+            execute([job]() { job->work(); });
+        }
+        job->work();
+
+        boost::unique_lock<boost::mutex> lock(job->mutex);
+        while(job->num_done.load() < num_chunks) job->done.wait(lock);
+        if(job->error) std::rethrow_exception(job->error);
+    }
+
+    // ticks since the construction of the pool
+    uint64_t current_tick() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                    boost::asio::steady_timer::clock_type::now() - timer_start).count() / TIMER_TICK_MS;
+    }
+
+    Timer add_timer(unsigned int delay_ms, unsigned int period_ms, boost::function<void()> func) {
+        timer_ptr timer(new Timer::State(*this, func, (period_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS));
+        boost::lock_guard<boost::mutex> lock(timer_mutex);
+        // + 1: the current tick is partly elapsed already, never early
+        timer->expiry_tick = current_tick() + (delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS + 1;
+        wheel.add(timer->expiry_tick, timer);
+        arm_tick_timer();
+        return Timer(timer);
+    }
+
+    // wake up a worker at the wheel's next tick if not already armed earlier, with timer_mutex held
+    void arm_tick_timer() {
+        uint64_t next = wheel.next_tick();
+        if(next >= armed_tick) return; // also when the wheel is empty
+        armed_tick = next;
+        tick_timer.expires_at(timer_start + std::chrono::milliseconds(next * TIMER_TICK_MS)); // cancels the previous wait
+        tick_timer.async_wait(boost::bind(&ThreadPool::on_tick, this, boost::asio::placeholders::error));
+    }
+
+    void on_tick(const boost::system::error_code& ec) {
+        if(ec == boost::asio::error::operation_aborted) return; // re-armed earlier
+        std::vector<timer_ptr> expired;
+        {
+            boost::lock_guard<boost::mutex> lock(timer_mutex);
+            armed_tick = TimerWheel<timer_ptr>::NO_TICK;
+            wheel.advance(current_tick(), expired);
+            arm_tick_timer();
+        }
+        for(timer_ptr& timer: expired) {
+            if(!timer->done.load()) post(instrument(boost::bind(&ThreadPool::run_timer, this, timer)));
+        }
+    }
+
+    void run_timer(timer_ptr timer) {
+        {
+            boost::lock_guard<boost::mutex> lock(timer_mutex);
+            if(timer->done.load()) return;
+            timer->running = true;
+        }
+        running_timer() = timer.get();
+        timer->func();
+        running_timer() = nullptr;
+
+        boost::lock_guard<boost::mutex> lock(timer_mutex);
+        timer->running = false;
+        if(timer->done.load()) { // cancelled during the run
+            timer_done.notify_all();
+            return;
+        }
+        if(timer->period_ticks == 0) {
+            timer->done.store(true);
+            return;
+        }
+        uint64_t now = current_tick();
+        timer->expiry_tick += timer->period_ticks;
+        if(timer->expiry_tick <= now) { // overran, skip the missed deadlines
+            timer->expiry_tick += ((now - timer->expiry_tick) / timer->period_ticks + 1) * timer->period_ticks;
+        }
+        wheel.add(timer->expiry_tick, timer);
+        arm_tick_timer();
+    }
+
+    void cancel_timer(Timer::State* timer) {
+        boost::unique_lock<boost::mutex> lock(timer_mutex);
+        timer->done.store(true); // stays in the wheel until it expires, then dropped
+        if(running_timer() == timer) return; // cancelled by its own run
+        while(timer->running) timer_done.wait(lock);
+    }
+
+    // the timer whose function the calling thread is running
+    static Timer::State*& running_timer() {
+        static thread_local Timer::State* timer = nullptr;
+        return timer;
+    }
+
     boost::thread_group threads;
     boost::asio::io_service ios;
     boost::asio::io_service::work io_work;
-    unsigned int num_tasks = 0; // this includes those tasks that finished early and got dequeued,
-                            // this measurement can't deduce anything about the
-                            // the current available free threads
+    const ThreadSched worker_sched;
+    const unsigned int num_workers;
+    boost::atomic<uint64_t> num_tasks{0}; // this includes those tasks that finished early and got dequeued
+    boost::atomic<unsigned int> num_queued{0}, num_running{0};
+    ITPS::DurationHistogram task_wait_time, task_run_time;
+
+    const boost::asio::steady_timer::time_point timer_start; // tick 0
+    boost::mutex timer_mutex; // the wheel, tick_timer, armed_tick and the timers' running flags
+    boost::condition_variable_any timer_done; // a cancelled timer's run completed, with timer_mutex
+    TimerWheel<timer_ptr> wheel;
+    boost::asio::steady_timer tick_timer;
+    uint64_t armed_tick; // when tick_timer expires, NO_TICK if not waiting
+
+    boost::shared_ptr<WorkStealingExecutor> stealing; // Backend::WorkStealing, null with IoService
 
 };
 
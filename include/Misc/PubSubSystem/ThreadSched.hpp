@@ -0,0 +1,120 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
+
+/*
+ * Scheduling attributes of a thread: its name (as shown by top -H, ps -L, gdb), the CPUs it may run on,
+ * and its policy & priority, e.g. to keep the control path on a CPU of its own at a real-time priority:
+ *
+ *      ThreadSched("PID", SCHED_FIFO, 80, {3}).apply(); // the calling thread
+ *
+ * The real-time policies (SCHED_FIFO/SCHED_RR) need CAP_SYS_NICE or an rtprio rlimit; when refused,
+ * or when a CPU doesn't exist, the thread keeps running as best it can (SCHED_OTHER, any CPU)
+ * and the reason is kept for dump_sched_failures().
+ */
+class ThreadSched {
+    public:
+        static const std::size_t MAX_NAME_LEN = 15; // pthread_setname_np() limit, longer names are truncated
+
+        ThreadSched(const std::string& name = "", int policy = SCHED_OTHER, int priority = 0,
+                    const std::vector<int>& cpus = std::vector<int>())
+            : name(name), policy(policy), priority(priority), cpus(cpus) {}
+
+        std::string name;      // "": leave it
+        int policy;            // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+        int priority;          // clamped to the policy's range, ignored by SCHED_OTHER
+        std::vector<int> cpus; // empty: any
+
+        // to the calling thread, return false if some attribute had to fall back
+        bool apply() const {
+            bool ok = true;
+            pthread_t self = pthread_self();
+
+            if(!name.empty()) {
+                pthread_setname_np(self, name.substr(0, MAX_NAME_LEN).c_str());
+            }
+
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            if(cpus.empty()) {
+                for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &cpu_set);
+            }
+            for(int cpu: cpus) {
+                if(cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+            }
+            int err = pthread_setaffinity_np(self, sizeof(cpu_set), &cpu_set);
+            if(err != 0 && !cpus.empty()) {
+                ok = false;
+                failure("affinity " + cpu_list() + " refused (" + std::strerror(err) + "), runs on any CPU");
+                CPU_ZERO(&cpu_set);
+                for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &cpu_set);
+                pthread_setaffinity_np(self, sizeof(cpu_set), &cpu_set);
+            }
+
+            sched_param param;
+            param.sched_priority = (policy == SCHED_OTHER) ? 0 : std::max(sched_get_priority_min(policy),
+                                                                          std::min(priority, sched_get_priority_max(policy)));
+            err = pthread_setschedparam(self, policy, &param);
+            if(err != 0) {
+                ok = false;
+                failure(policy_name() + " " + std::to_string(param.sched_priority) + " refused (" + std::strerror(err)
+                        + (err == EPERM ? ", needs CAP_SYS_NICE or an rtprio limit" : "") + "), runs as SCHED_OTHER");
+                param.sched_priority = 0;
+                pthread_setschedparam(self, SCHED_OTHER, &param);
+            }
+            return ok;
+        }
+
+        std::string policy_name() const {
+            switch(policy) {
+                case SCHED_FIFO: return "SCHED_FIFO";
+                case SCHED_RR: return "SCHED_RR";
+                default: return "SCHED_OTHER";
+            }
+        }
+
+        std::string cpu_list() const {
+            std::ostringstream os;
+            for(std::size_t i = 0; i < cpus.size(); i++) os << (i ? "," : "") << cpus[i];
+            return "{" + os.str() + "}";
+        }
+
+        // what apply() couldn't do so far, one line per thread & attribute
+        static std::string dump_failures() {
+            boost::lock_guard<boost::mutex> lock(failures_mutex());
+            std::string out;
+            for(auto& f: failures()) out += f + "\n";
+            return out;
+        }
+
+    private:
+        static const std::size_t MAX_FAILURES = 64;
+
+        void failure(const std::string& what) const {
+            boost::lock_guard<boost::mutex> lock(failures_mutex());
+            if(failures().size() >= MAX_FAILURES) return; // e.g. a module restarted over and over
+            failures().push_back("thread \"" + name + "\": " + what);
+        }
+
+        static std::vector<std::string>& failures() {
+            static std::vector<std::string> list;
+            return list;
+        }
+
+        static boost::mutex& failures_mutex() {
+            static boost::mutex mutex;
+            return mutex;
+        }
+};
+
+inline std::string dump_sched_failures() {
+    return ThreadSched::dump_failures();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * Hierarchical timer wheel: LEVELS wheels of SLOTS slots each, a slot of level l spans SLOTS^l ticks.
+ * An item goes into the coarsest level its expiry needs and moves one level down (cascades) each time
+ * the time enters its slot, so adding is O(1) and advancing by one tick is O(1) amortized, whatever
+ * the number of pending items. Expiries beyond SLOTS^LEVELS ticks just cascade a few more times.
+ *
+ *      TimerWheel<Job> wheel;
+ *      wheel.add(wheel.now_tick() + 500, job);
+ *      std::vector<Job> expired;
+ *      wheel.advance(ticks_elapsed, expired);   // appends job once 500 ticks passed
+ *
+ * Only the data structure: no time source and no locking, check ThreadPool::schedule_after() for its use.
+ * Items can't be removed, the owner skips those it cancelled when they expire.
+ */
+template <typename T>
+class TimerWheel {
+    public:
+        static constexpr unsigned int SLOT_BITS = 6;
+        static constexpr unsigned int SLOTS = 1u << SLOT_BITS;
+        static constexpr unsigned int LEVELS = 4;
+        static constexpr uint64_t NO_TICK = UINT64_MAX;
+
+        TimerWheel(uint64_t start_tick = 0) : current(start_tick), num_items(0), slots(LEVELS * SLOTS) {}
+
+        // the last tick advanced to, everything expiring until then has been returned
+        uint64_t now_tick() const {
+            return current;
+        }
+
+        std::size_t size() const {
+            return num_items;
+        }
+
+        // item expires at expiry_tick, or at the next tick if that one already passed
+        void add(uint64_t expiry_tick, const T& item) {
+            if(expiry_tick <= current) expiry_tick = current + 1;
+            insert(Entry{expiry_tick, item});
+            num_items++;
+        }
+
+        // move the time forward to tick, appending the items expiring on the way to expired, in expiry order
+        void advance(uint64_t tick, std::vector<T>& expired) {
+            while(current < tick) {
+                current++;
+                cascade();
+                std::vector<Entry>& slot = slots[current & MASK];
+                for(Entry& e: slot) expired.push_back(e.item);
+                num_items -= slot.size();
+                slot.clear();
+            }
+        }
+
+        /* the first tick advance() has to reach for some item to expire or to cascade, NO_TICK if the wheel
+         * is empty. At most SLOTS ticks ahead, the owner simply checks again then
+         */
+        uint64_t next_tick() const {
+            if(num_items == 0) return NO_TICK;
+            for(uint64_t tick = current + 1; ; tick++) {
+                if((tick & MASK) == 0 || !slots[tick & MASK].empty()) return tick;
+            }
+        }
+
+    private:
+        static constexpr uint64_t MASK = SLOTS - 1;
+
+        struct Entry {
+            uint64_t expiry_tick;
+            T item;
+        };
+
+        std::vector<Entry>& slot(unsigned int level, uint64_t tick) {
+            return slots[level * SLOTS + ((tick >> (level * SLOT_BITS)) & MASK)];
+        }
+
+        // expiry_tick >= current
+        void insert(const Entry& e) {
+            uint64_t delta = e.expiry_tick - current;
+            for(unsigned int level = 0; level < LEVELS; level++) {
+                if(delta < (1ULL << ((level + 1) * SLOT_BITS))) {
+                    slot(level, e.expiry_tick).push_back(e);
+                    return;
+                }
+            }
+            // beyond the top level: parked in its furthest slot, re-inserted from there when it cascades
+            slot(LEVELS - 1, current + (1ULL << (LEVELS * SLOT_BITS)) - 1).push_back(e);
+        }
+
+        // on entering a new slot of the upper levels, spread its items over the levels below
+        void cascade() {
+            for(unsigned int level = 1; level < LEVELS; level++) {
+                if((current & ((1ULL << (level * SLOT_BITS)) - 1)) != 0) return;
+                std::vector<Entry> entries;
+                entries.swap(slot(level, current));
+                for(Entry& e: entries) insert(e);
+            }
+        }
+
+        uint64_t current;
+        std::size_t num_items;
+        std::vector< std::vector<Entry> > slots; // level l: [l * SLOTS, (l + 1) * SLOTS)
+};
@@ -0,0 +1,98 @@
+/*
+ * Compile-time topic descriptors for the Inter-Thread Publisher Subscriber System (ITPS)
+ */
+
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include <boost/atomic.hpp>
+#include "Namespace.hpp"
+
+namespace ITPS {
+
+    template<typename Msg>
+    class MsgChannel;
+
+    /* common base of all descriptors, used to tell descriptors apart from strings in overloads */
+    struct TopicTag {};
+
+    template <typename T>
+    struct is_topic : std::is_base_of<TopicTag, T> {};
+
+    /*
+     * A topic descriptor binds a (topic_name, msg_name) pair to a message type and a mode at compile time:
+     *
+     *      ITPS_NONBLOCKING_TOPIC(MotionDataTopic, MotionData, "MotionEKF", "MotionData");
+     *
+     *      ITPS::NonBlockingPublisher<MotionData> pub(MotionDataTopic{}, default_data);
+     *      ITPS::NonBlockingSubscriber<MotionData> sub(MotionDataTopic{});
+     *
+     *  * The names are written once, so a typo can't silently break the connection at runtime anymore
+     *  * Constructing a publisher/subscriber of the wrong message type or mode is a compile error
+     *  * The first publisher stores its channel in a static slot owned by the descriptor (one per
+     *    namespace, check Namespace.hpp), subscribers resolve the channel with a single atomic load,
+     *    without building/hashing the key string or locking the channel table.
+     *
+     * Descriptors still register the usual "topic_name.msg_name.mode" key, so they interoperate
+     * with publishers/subscribers constructed from plain strings.
+     *
+     * Shared topics (ITPS_SHARED_*_TOPIC) ignore the current namespace and always live in the global one.
+     */
+    template <typename Descriptor, typename MsgType, bool blocking, bool shared = false>
+    struct TopicDescriptor : public TopicTag {
+        typedef MsgType Msg;
+        static constexpr bool is_blocking = blocking;
+        static constexpr bool is_shared = shared;
+
+        static const char* mode() {
+            return blocking ? "B" : "NB";
+        }
+
+        // the namespace a publisher/subscriber of this topic constructed right now binds to
+        static Namespace topic_namespace() {
+            return shared ? Namespace::global() : current_namespace();
+        }
+
+        // nullptr if the namespace id is beyond the slot array
+        static boost::atomic<MsgChannel<Msg>*>* channel_slot(unsigned int ns_id) {
+            static boost::atomic<MsgChannel<Msg>*> slots[Namespace::MAX_NAMESPACES] = {};
+            return ns_id < Namespace::MAX_NAMESPACES ? &slots[ns_id] : nullptr;
+        }
+    };
+
+    /* the "topic_name.msg_name.mode" key a publisher/subscriber of Topic constructed right now
+     * registers/looks up (check MsgChannel)
+     */
+    template <typename Topic>
+    std::string topic_key() {
+        return Topic::topic_namespace().qualify(Topic::topic_name) + "." + Topic::msg_name + "." + Topic::mode();
+    }
+
+}
+
+/* declare a descriptor type named Name, to be used in a namespace or class scope */
+#define ITPS_NONBLOCKING_TOPIC(Name, MsgType, topic_str, msg_str) \
+    struct Name : public ITPS::TopicDescriptor<Name, MsgType, false> { \
+        static constexpr const char* topic_name = topic_str; \
+        static constexpr const char* msg_name = msg_str; \
+    }
+
+#define ITPS_BLOCKING_TOPIC(Name, MsgType, topic_str, msg_str) \
+    struct Name : public ITPS::TopicDescriptor<Name, MsgType, true> { \
+        static constexpr const char* topic_name = topic_str; \
+        static constexpr const char* msg_name = msg_str; \
+    }
+
+/* same as above, for the topics shared by all the namespaces of the process (check Namespace.hpp) */
+#define ITPS_SHARED_NONBLOCKING_TOPIC(Name, MsgType, topic_str, msg_str) \
+    struct Name : public ITPS::TopicDescriptor<Name, MsgType, false, true> { \
+        static constexpr const char* topic_name = topic_str; \
+        static constexpr const char* msg_name = msg_str; \
+    }
+
+#define ITPS_SHARED_BLOCKING_TOPIC(Name, MsgType, topic_str, msg_str) \
+    struct Name : public ITPS::TopicDescriptor<Name, MsgType, true, true> { \
+        static constexpr const char* topic_name = topic_str; \
+        static constexpr const char* msg_name = msg_str; \
+    }
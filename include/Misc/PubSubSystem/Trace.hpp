@@ -0,0 +1,197 @@
+/*
+ * End-to-end latency tracing across ITPS hops
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include "HistoryBuffer.hpp"
+#include "ChannelStats.hpp"
+
+namespace ITPS {
+
+    /*
+     * A trace starts where an external input enters the system (e.g. a UDP packet in CMDServer::task),
+     * with begin_trace(). From there it follows the data implicitly:
+     *
+     *  * every thread has a "current" trace context
+     *  * publishing a msg attaches the current context to it (stored next to the msg in the channel)
+     *  * reading a msg (latest_msg(), pop_msg(), callbacks) makes its context the reader's current one,
+     *    if it's a newer trace than the one the reader already follows
+     *
+     * Each channel a trace goes through records, the first time it sees that trace, the time since the
+     * previous hop and the time since the origin. trace_point() does the same for the places where the
+     * data leaves the system (e.g. the VF_Commands written to the vfirm socket). dump_trace_stats()
+     * lists the hops sorted by their mean time since origin, i.e. in pipeline order.
+     *
+     * Disabled by default (set_tracing()), which costs a relaxed load per publish/read.
+     */
+    struct TraceContext {
+        timestamp_t origin = 0;   // when the input entered the system
+        timestamp_t last_hop = 0; // when the msg carrying this context got published
+        uint64_t seq = 0;         // 0: not traced
+
+        bool valid() const {
+            return seq != 0;
+        }
+    };
+
+    // a msg together with the trace context it was published with
+    template <typename Msg>
+    struct Traced {
+        Msg data;
+        TraceContext trace;
+    };
+
+    namespace trace_detail {
+        inline boost::atomic<bool>& enabled_flag() {
+            static boost::atomic<bool> flag(false);
+            return flag;
+        }
+
+        inline boost::atomic<uint64_t>& seq_counter() {
+            static boost::atomic<uint64_t> counter(0);
+            return counter;
+        }
+
+        inline TraceContext& current() {
+            static thread_local TraceContext ctx;
+            return ctx;
+        }
+    }
+
+    inline bool tracing_enabled() {
+        return trace_detail::enabled_flag().load(boost::memory_order_relaxed);
+    }
+
+    inline void set_tracing(bool enable) {
+        trace_detail::enabled_flag().store(enable, boost::memory_order_relaxed);
+    }
+
+    // start a new trace on this thread, to be called where an external input is received
+    inline void begin_trace() {
+        if(!tracing_enabled()) return;
+        TraceContext& ctx = trace_detail::current();
+        ctx.origin = now_ns();
+        ctx.last_hop = ctx.origin;
+        ctx.seq = trace_detail::seq_counter().fetch_add(1, boost::memory_order_relaxed) + 1;
+    }
+
+    // the context attached to the msgs published by this thread
+    inline TraceContext current_trace() {
+        return tracing_enabled() ? trace_detail::current() : TraceContext();
+    }
+
+    // follow the trace of a msg just read, unless this thread already follows the same or a newer one
+    inline void adopt_trace(const TraceContext& ctx) {
+        if(!ctx.valid()) return;
+        TraceContext& current = trace_detail::current();
+        if(ctx.seq > current.seq) current = ctx;
+    }
+
+
+    // latency breakdown of one hop, each trace is only counted the first time it goes through
+    class TraceStats {
+        public:
+            TraceStats() : last_seq(0) {}
+
+            /* record ctx passing through this hop at time now, return the context to pass on */
+            TraceContext record(TraceContext ctx, timestamp_t now) {
+                uint64_t prev = last_seq.load(boost::memory_order_relaxed);
+                do {
+                    if(ctx.seq <= prev) {
+                        ctx.last_hop = now;
+                        return ctx; // already counted (e.g. a module re-publishing from the same input)
+                    }
+                } while(!last_seq.compare_exchange_weak(prev, ctx.seq, boost::memory_order_relaxed));
+
+                since_prev_hop.record(now > ctx.last_hop ? now - ctx.last_hop : 0);
+                since_origin.record(now > ctx.origin ? now - ctx.origin : 0);
+                ctx.last_hop = now;
+                return ctx;
+            }
+
+            DurationHistogram since_prev_hop;
+            DurationHistogram since_origin;
+
+        private:
+            boost::atomic<uint64_t> last_seq;
+    };
+
+
+    // name => hop stats, the mutex is only taken when a hop is registered and when dumping
+    class TraceRegistry {
+        public:
+            static TraceRegistry& instance() {
+                static TraceRegistry registry;
+                return registry;
+            }
+
+            // the returned reference stays valid for the lifetime of the program
+            TraceStats& hop(const std::string& name) {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                TraceStats*& stats = hops[name];
+                if(stats == nullptr) stats = new TraceStats(); // never freed, hops live as long as the program
+                return *stats;
+            }
+
+            std::string dump() {
+                std::vector< std::pair<std::string, TraceStats*> > current;
+                {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    current.assign(hops.begin(), hops.end());
+                }
+                current.erase(std::remove_if(current.begin(), current.end(),
+                    [](const std::pair<std::string, TraceStats*>& h) { return h.second->since_origin.count() == 0; }),
+                    current.end());
+                std::sort(current.begin(), current.end(),
+                    [](const std::pair<std::string, TraceStats*>& a, const std::pair<std::string, TraceStats*>& b) {
+                        return a.second->since_origin.mean() < b.second->since_origin.mean();
+                    });
+
+                std::ostringstream os;
+                for(auto& h: current) {
+                    TraceStats& s = *h.second;
+                    os << h.first << " traces=" << s.since_origin.count()
+                       << " hop_mean=" << s.since_prev_hop.mean() / 1000 << "us"
+                       << " hop_p50<" << s.since_prev_hop.percentile(0.5) / 1000 << "us"
+                       << " hop_p99<" << s.since_prev_hop.percentile(0.99) / 1000 << "us"
+                       << " total_mean=" << s.since_origin.mean() / 1000 << "us"
+                       << " total_p50<" << s.since_origin.percentile(0.5) / 1000 << "us"
+                       << " total_p99<" << s.since_origin.percentile(0.99) / 1000 << "us\n";
+                }
+                return os.str();
+            }
+
+        private:
+            TraceRegistry() {}
+
+            boost::mutex mutex;
+            std::map<std::string, TraceStats*> hops;
+    };
+
+    /* record the current trace of this thread at a named point, typically where the data leaves
+     * the system, e.g. ITPS::trace_point("VFirmClient.SendCommand");
+     */
+    inline void trace_point(const char* name) {
+        if(!tracing_enabled()) return;
+        TraceContext& ctx = trace_detail::current();
+        if(!ctx.valid()) return;
+        static thread_local std::map<const char*, TraceStats*> cache; // skip the registry lock next time
+        TraceStats*& stats = cache[name];
+        if(stats == nullptr) stats = &TraceRegistry::instance().hop(name);
+        ctx = stats->record(ctx, now_ns());
+    }
+
+    inline std::string dump_trace_stats() {
+        return TraceRegistry::instance().dump();
+    }
+
+}
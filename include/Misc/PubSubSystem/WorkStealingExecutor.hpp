@@ -0,0 +1,134 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "ThreadSched.hpp"
+
+/*
+ * Work-stealing backend of ThreadPool (check ThreadPool::Backend): every worker has its own queue
+ * instead of all of them sharing the io_service's one.
+ *
+ *  * a function posted from a worker goes to that worker's queue, one posted from any other thread
+ *    to the next queue round robin, so the posters rarely contend on the same lock
+ *  * a worker runs its own queue in order, and once it's empty takes the oldest function of another
+ *    worker's queue, so a worker held by a long task (a module's loop) doesn't hold back its queue
+ *  * a worker only sleeps when no queue has anything left, a post wakes up one sleeper
+ *
+ * The queues are deques under a mutex each rather than lock-free (Chase-Lev) deques: the posted functions
+ * are boost::function objects, and an uncontended mutex costs little next to them.
+ * Like io_service::stop(), destruction drops the functions not started yet.
+ */
+class WorkStealingExecutor {
+    public:
+        // sched: of every worker, check ThreadSched
+        WorkStealingExecutor(unsigned int num_workers, const ThreadSched& sched = ThreadSched("pool"))
+            : next_queue(0), num_pending(0), num_sleeping(0), stopping(false) {
+            if(num_workers == 0) throw std::runtime_error("WorkStealingExecutor: needs at least one worker thread");
+            for(unsigned int i = 0; i < num_workers; i++) queues.push_back(boost::shared_ptr<WorkerQueue>(new WorkerQueue()));
+            for(unsigned int i = 0; i < num_workers; i++) {
+                workers.create_thread(boost::bind(&WorkStealingExecutor::work, this, i, sched));
+            }
+        }
+
+        // a function in progress completes, the pending ones are dropped
+        ~WorkStealingExecutor() {
+            {
+                boost::lock_guard<boost::mutex> lock(park_mutex);
+                stopping.store(true);
+            }
+            park_cond.notify_all();
+            workers.join_all();
+        }
+
+        void execute(boost::function<void()> func) {
+            const Worker& self = current_worker();
+            std::size_t i = self.executor == this ? self.index
+                                                  : next_queue.fetch_add(1, boost::memory_order_relaxed) % queues.size();
+            {
+                boost::lock_guard<boost::mutex> lock(queues[i]->mutex);
+                queues[i]->funcs.push_back(boost::function<void()>());
+                queues[i]->funcs.back().swap(func);
+            }
+            // seq_cst, against the same two in work(): either the sleeper sees this one pending, or it's seen sleeping
+            num_pending.fetch_add(1);
+            if(num_sleeping.load() > 0) {
+                boost::lock_guard<boost::mutex> lock(park_mutex);
+                park_cond.notify_one();
+            }
+        }
+
+        unsigned int num_workers() const {
+            return queues.size();
+        }
+
+    private:
+        // own cache lines, the workers' queues are locked independently
+        struct alignas(64) WorkerQueue {
+            boost::mutex mutex;
+            std::deque< boost::function<void()> > funcs;
+        };
+
+        struct Worker {
+            const WorkStealingExecutor* executor;
+            std::size_t index;
+        };
+
+        // the executor & the queue of the calling thread, if one of the workers
+        static Worker& current_worker() {
+            static thread_local Worker worker = {nullptr, 0};
+            return worker;
+        }
+
+        bool pop(std::size_t i, boost::function<void()>& func) {
+            WorkerQueue& queue = *queues[i];
+            boost::lock_guard<boost::mutex> lock(queue.mutex);
+            if(queue.funcs.empty()) return false;
+            func.swap(queue.funcs.front());
+            queue.funcs.pop_front();
+            return true;
+        }
+
+        // the oldest function of the first other queue having some, from the next one on
+        bool steal(std::size_t self, boost::function<void()>& func) {
+            for(std::size_t n = 1; n < queues.size(); n++) {
+                if(pop((self + n) % queues.size(), func)) return true;
+            }
+            return false;
+        }
+
+        void work(std::size_t index, const ThreadSched& sched) {
+            sched.apply();
+            current_worker() = Worker{this, index};
+            boost::function<void()> func;
+            while(!stopping.load(boost::memory_order_relaxed)) {
+                if(pop(index, func) || steal(index, func)) {
+                    num_pending.fetch_sub(1, boost::memory_order_relaxed);
+                    func();
+                    func.clear(); // what it captured goes away now, not at the next one
+                    continue;
+                }
+                boost::unique_lock<boost::mutex> lock(park_mutex);
+                if(stopping.load()) return;
+                num_sleeping.fetch_add(1);
+                if(num_pending.load() == 0) park_cond.wait(lock);
+                num_sleeping.fetch_sub(1);
+            }
+        }
+
+        std::vector< boost::shared_ptr<WorkerQueue> > queues;
+        boost::atomic<std::size_t> next_queue;   // round robin of the posts from outside of the workers
+        boost::atomic<std::size_t> num_pending;  // in all the queues
+        boost::atomic<unsigned int> num_sleeping;
+        boost::atomic<bool> stopping;
+        boost::mutex park_mutex;
+        boost::condition_variable_any park_cond; // with park_mutex
+        boost::thread_group workers;
+};
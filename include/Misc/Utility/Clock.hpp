@@ -0,0 +1,205 @@
+/*
+ * Pluggable time source of the whole stack: Systime, the ITPS timestamps & timed waits, the PID controllers
+ */
+
+#pragma once
+
+#include <vector>
+#include <set>
+#include <cstdint>
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/*
+ * Everything that reads the time or waits for some time goes through the current clock:
+ *
+ *  * SystemClock (the default): the monotonic steady clock and real sleeps
+ *  * SimulatedClock: a time that only moves when a driver advances it, so the modules can run
+ *    lockstep at whatever pace the driver sets, e.g. much faster than real time
+ *
+ *      SimulatedClock sim;
+ *      set_clock(&sim);          // from now on millis(), delay(), ITPS::now_ns(), timeouts... follow sim
+ *      ...
+ *      sim.advance_ns(1000000);  // 1 ms later: the sleepers whose deadline passed wake up
+ *      set_clock(nullptr);       // back to the system clock
+ *
+ * Timestamps are 64-bit nanoseconds from an arbitrary origin, unrelated to the wall clock.
+ * Switch clocks while nothing is waiting on the previous one.
+ */
+class Clock {
+    public:
+        // a thread in wait_until(), registered so a simulated clock can wake it up when advanced
+        struct Waiter {
+            boost::condition_variable_any* cond;
+        };
+
+        virtual ~Clock() {}
+
+        // monotonic
+        virtual uint64_t now_ns() = 0;
+
+        // return once now_ns() >= deadline_ns
+        virtual void sleep_until_ns(uint64_t deadline_ns) = 0;
+
+        void sleep_for_ns(uint64_t duration_ns) {
+            sleep_until_ns(now_ns() + duration_ns);
+        }
+
+        uint64_t deadline_after_ms(unsigned int timeout_ms) {
+            return now_ns() + (uint64_t) timeout_ms * 1000000ULL;
+        }
+
+        /* cond.wait_for() against this clock, to be called with lock held, in a loop re-checking the
+         * awaited condition: wait until notified or until deadline_ns, return false once the deadline passed.
+         * Spurious wake-ups are possible, as with any condition variable.
+         * The real wait is a relative one (steady clock), so a step of the wall clock doesn't stretch or cut it.
+         */
+        template <typename Lock>
+        bool wait_until(boost::condition_variable_any& cond, Lock& lock, uint64_t deadline_ns) {
+            uint64_t now = now_ns();
+            if(now >= deadline_ns) return false;
+            Waiter waiter{&cond};
+            add_waiter(&waiter);
+            cond.wait_for(lock, boost::chrono::microseconds(real_wait_us(deadline_ns - now)));
+            remove_waiter(&waiter);
+            return now_ns() < deadline_ns;
+        }
+
+    protected:
+        // how long (real time) wait_until() blocks at most for a remaining time on this clock
+        virtual uint64_t real_wait_us(uint64_t remaining_ns) = 0;
+
+        virtual void add_waiter(Waiter* /*waiter*/) {}
+        virtual void remove_waiter(Waiter* /*waiter*/) {}
+};
+
+
+class SystemClock : public Clock {
+    public:
+        uint64_t now_ns() override {
+            return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                        boost::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void sleep_until_ns(uint64_t deadline_ns) override {
+            uint64_t now = now_ns();
+            if(deadline_ns > now) boost::this_thread::sleep_for(boost::chrono::nanoseconds(deadline_ns - now));
+        }
+
+    protected:
+        uint64_t real_wait_us(uint64_t remaining_ns) override {
+            return (remaining_ns + 999) / 1000;
+        }
+};
+
+
+/*
+ * Manually stepped: set_ns()/advance_ns() move the time forward and wake up the threads whose deadline passed.
+ * A driver can jump straight to the next wake-up with next_deadline_ns() and tell when all the threads it
+ * expects are asleep with num_sleeping().
+ *
+ * Unlike a virtual delay() that simply moves the time forward by itself, a sleeper here blocks until the
+ * driver calls set_ns()/advance_ns(): with no driver, delay() never returns.
+ */
+class SimulatedClock : public Clock {
+    public:
+        // a timed condition variable wait re-checks the simulated time at least this often (real time)
+        static const uint64_t WAIT_SLICE_US = 1000;
+
+        SimulatedClock(uint64_t start_ns = 0) : time_ns(start_ns) {}
+
+        uint64_t now_ns() override {
+            return time_ns.load(boost::memory_order_acquire);
+        }
+
+        void sleep_until_ns(uint64_t deadline_ns) override {
+            boost::unique_lock<boost::mutex> lock(sleep_mutex);
+            if(time_ns.load(boost::memory_order_acquire) >= deadline_ns) return;
+            std::multiset<uint64_t>::iterator it = deadlines.insert(deadline_ns);
+            while(time_ns.load(boost::memory_order_acquire) < deadline_ns) {
+                sleep_cond.wait(lock);
+            }
+            deadlines.erase(it);
+        }
+
+        // the time never goes backward, earlier values are ignored
+        void set_ns(uint64_t new_time_ns) {
+            {
+                boost::lock_guard<boost::mutex> lock(sleep_mutex);
+                if(new_time_ns <= time_ns.load(boost::memory_order_relaxed)) return;
+                time_ns.store(new_time_ns, boost::memory_order_release);
+            }
+            sleep_cond.notify_all();
+            boost::lock_guard<boost::mutex> lock(waiters_mutex);
+            for(Waiter* waiter: waiters) {
+                waiter->cond->notify_all();
+            }
+        }
+
+        void advance_ns(uint64_t duration_ns) {
+            set_ns(now_ns() + duration_ns);
+        }
+
+        // earliest deadline of the threads in sleep_until_ns(), UINT64_MAX if none
+        uint64_t next_deadline_ns() {
+            boost::lock_guard<boost::mutex> lock(sleep_mutex);
+            return deadlines.empty() ? UINT64_MAX : *deadlines.begin();
+        }
+
+        // threads in sleep_until_ns()
+        unsigned int num_sleeping() {
+            boost::lock_guard<boost::mutex> lock(sleep_mutex);
+            return deadlines.size();
+        }
+
+    protected:
+        uint64_t real_wait_us(uint64_t /*remaining_ns*/) override {
+            return WAIT_SLICE_US; // set_ns() wakes the waiter up anyway, this only bounds a missed notification
+        }
+
+        void add_waiter(Waiter* waiter) override {
+            boost::lock_guard<boost::mutex> lock(waiters_mutex);
+            waiters.push_back(waiter);
+        }
+
+        void remove_waiter(Waiter* waiter) override {
+            boost::lock_guard<boost::mutex> lock(waiters_mutex);
+            waiters.erase(std::find(waiters.begin(), waiters.end(), waiter));
+        }
+
+    private:
+        boost::atomic<uint64_t> time_ns;
+
+        boost::mutex sleep_mutex;
+        boost::condition_variable sleep_cond;
+        std::multiset<uint64_t> deadlines; // of the sleepers
+
+        boost::mutex waiters_mutex;
+        std::vector<Waiter*> waiters;
+};
+
+
+namespace clock_detail {
+    inline SystemClock& system_clock() {
+        static SystemClock clock;
+        return clock;
+    }
+
+    inline boost::atomic<Clock*>& current() {
+        static boost::atomic<Clock*> clock(&system_clock());
+        return clock;
+    }
+}
+
+inline Clock& current_clock() {
+    return *clock_detail::current().load(boost::memory_order_acquire);
+}
+
+// make clock the time source of the whole process (it must outlive its use), nullptr: the system clock
+inline void set_clock(Clock* clock) {
+    clock_detail::current().store(clock != nullptr ? clock : &clock_detail::system_clock(), boost::memory_order_release);
+}
@@ -29,11 +29,10 @@
 
 /* Synchronization for Reader/Writer problems */
 typedef boost::shared_mutex reader_writer_mutex; 
-// get exclusive access
-#define writer_lock(mutex) do { \
+// get exclusive access (no do{}while(0) here, the locks must live until the end of the caller's scope)
+#define writer_lock(mutex) \
     boost::upgrade_lock<reader_writer_mutex> __writer_lock(mutex); \
-    boost::upgrade_to_unique_lock<reader_writer_mutex> __unique_writer_lock( __writer_lock ); \
-}while(0)
+    boost::upgrade_to_unique_lock<reader_writer_mutex> __unique_writer_lock( __writer_lock );
 // get shared access
 #define reader_lock(mutex) boost::shared_lock<reader_writer_mutex>  __reader_lock(mutex); 
 
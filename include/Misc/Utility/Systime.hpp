@@ -1,14 +1,22 @@
 #ifndef __SYSTIME_H
 #define __SYSTIME_H
 
+#include <cstdint>
 
-unsigned int millis(void);
+/* All of these follow the current clock (check Clock.hpp): the system's monotonic clock by default,
+ * a simulated clock when one is installed with set_clock(), e.g. by the replay tool.
+ * The timestamps are 64 bits, they don't wrap around.
+ */
 
-unsigned int micros(void);
+uint64_t nanos(void);
+
+uint64_t micros(void);
+
+uint64_t millis(void);
 
 void delay_us(unsigned int microseconds);
 
 void delay(unsigned int milliseconds);
 
 
-#endif 
\ No newline at end of file
+#endif 
@@ -1,9 +1,14 @@
 #pragma once
 #include "Misc/PubSubSystem/Module.hpp"
+#include "ProtoGenerated/vFirmware_API.pb.h"
 
 
 class FirmClientModule : public Module {
     public:
+        // ITPS topics published / consumed by this module
+        ITPS_BLOCKING_TOPIC(SensorDataTopic, ITPS::ConstMsgPtr<VF_Data>, "FirmClient", "InternalSensorData"); // zero-copy
+        ITPS_BLOCKING_TOPIC(CommandsTopic, VF_Commands, "FirmClient", "Commands");
+        ITPS_NONBLOCKING_TOPIC(InitSensorsTopic, bool, "vfirm-client", "re/init sensors");
         
         virtual void task(ThreadPool& thread_pool) = 0;
 
@@ -12,6 +17,7 @@ class FirmClientModule : public Module {
 
 class VFirmClient : public FirmClientModule {
 public:
+    VFirmClient(); // the publisher is created by task()
     void task() {}
     void task(ThreadPool& thread_pool);
 };
\ No newline at end of file
@@ -1,9 +1,16 @@
 #pragma once
 #include "Misc/PubSubSystem/Module.hpp"
+#include <armadillo>
 
 
 class TcpReceiveModule : public Module {
     public:
+        // ITPS topics published by this module
+        ITPS_NONBLOCKING_TOPIC(SafetyEnableTopic, bool, "AI Connection", "SafetyEnable");
+        ITPS_NONBLOCKING_TOPIC(RobotOriginTopic, arma::vec, "ConnectionInit", "RobotOrigin(WorldFrame)");
+
+        TcpReceiveModule(); // the publishers are created by task()
+
         virtual void task() {}
         virtual void task(ThreadPool& thread_pool);
 
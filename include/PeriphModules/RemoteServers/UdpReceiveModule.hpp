@@ -1,16 +1,30 @@
 #pragma once
 #include "Misc/PubSubSystem/Module.hpp"
-#include "Misc/PubSubSystem/Module.hpp"
+#include <armadillo>
+#include "CoreModules/MotionModule/MotionModule.hpp"
 
 class UdpReceiveModule : public Module {
     public:
+        // ITPS topics published by this module, vision data are converted to the body frame
+        ITPS_NONBLOCKING_TOPIC(BotPosTopic, arma::vec, "GVision Server", "BotPos(BodyFrame)");
+        ITPS_NONBLOCKING_TOPIC(BotVelTopic, arma::vec, "GVision Server", "BotVel(BodyFrame)");
+        ITPS_NONBLOCKING_TOPIC(BotAngTopic, float, "GVision Server", "BotAng(BodyFrame)");
+        ITPS_NONBLOCKING_TOPIC(BotAngVelTopic, float, "GVision Server", "BotAngVel(BodyFrame)");
+        ITPS_NONBLOCKING_TOPIC(BallPosTopic, arma::vec, "GVision Server", "BallPos(BodyFrame)");
+        ITPS_NONBLOCKING_TOPIC(BallVelTopic, arma::vec, "GVision Server", "BallVel(BodyFrame)");
+        ITPS_NONBLOCKING_TOPIC(MotionCMDTopic, Motion::MotionCMD, "CMD Server", "MotionCMD");
+        ITPS_NONBLOCKING_TOPIC(EnableAutoCapTopic, bool, "CMD Server", "EnableAutoCap");
+        ITPS_NONBLOCKING_TOPIC(KickerSetPointTopic, arma::vec, "Kicker", "KickingSetPoint");
+
+        UdpReceiveModule(); // the publishers are created by task()
+
         virtual void task() {}
 
-    [[noreturn]] virtual void task(ThreadPool& thread_pool);
+    virtual void task(ThreadPool& thread_pool);
 
         virtual ~UdpReceiveModule() {}
 
 
 };
 
-using CMDServer = UdpReceiveModule;
+using CMDServer = UdpReceiveModule;
\ No newline at end of file
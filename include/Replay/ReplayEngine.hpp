@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include "Misc/Utility/Clock.hpp"
+#include "Misc/PubSubSystem/Recorder.hpp"
+#include "ProtoGenerated/vFirmware_API.pb.h"
+#include "CoreModules/EKF-Module/MotionEkfModule.hpp"
+#include "CoreModules/EKF-Module/BallEkfModule.hpp"
+#include "CoreModules/MotionModule/MotionModule.hpp"
+#include "CoreModules/ControlModule/ControlModule.hpp"
+#include "CoreModules/BallCaptureModule/BallCaptureModule.hpp"
+
+class ReplayInput;
+
+/*
+ * Offline, deterministic re-run of the core modules of one robot on a recording (check ITPS::Recorder):
+ *
+ *      ReplayEngine replay("session.itpsrec");
+ *      replay.run([](uint64_t time_us, const VF_Commands& cmd) { ... });
+ *
+ * The inputs of the pipeline, i.e. what the peripheral modules published (firmware frames, vision data,
+ * AI commands, safety enable, PID constants), are published again in the order of their stamps, and
+ * MotionEKF, BallEKF, Motion, PID_System and BallCapture are stepped by the calling thread on simulated
+ * time, without any thread pool or sleeping:
+ *
+ *  * the process runs on a SimulatedClock (check Clock.hpp) jumping from one input's stamp to the next
+ *  * every input runs the module steps it triggers live: a firmware frame runs MotionEKF then BallCapture,
+ *    a ball velocity runs BallEKF, an AI command runs Motion, an auto-capture toggle runs BallCapture
+ *  * the periodic work runs on simulated ticks in between: PID_System every 1/CTRL_FREQUENCY,
+ *    Motion every 1 ms while its command is in the world frame, both starting once their inputs are ready
+ *
+ * The same recording always gives the same sequence of output commands, bit for bit, at whatever speed
+ * the machine runs it, digest() fingerprints that sequence for regression checks.
+ * The modules' publishers/subscribers are created in the global namespace, and the channels outlive the
+ * engine with the last msgs of its run, so only one engine should run per process.
+ */
+class ReplayEngine {
+    public:
+        typedef boost::function<void(uint64_t time_us, const VF_Commands& cmd)> output_callback_t;
+
+        /* robot_ns: the namespace the recorded robot's topics lived in, "" for a process running a single
+         * robot, "robot<id>" otherwise. Throw std::runtime_error if the recording can't be read
+         */
+        ReplayEngine(const std::string& record_path, const std::string& robot_ns = "");
+        ~ReplayEngine();
+
+        // replay the whole recording, on_output gets every command PID_System sends to the firmware
+        void run(output_callback_t on_output = output_callback_t());
+
+        uint64_t num_inputs() const {
+            return inputs_replayed;
+        }
+
+        // recorded input msgs that couldn't be decoded, plus the input topics recorded with another msg type
+        uint64_t num_skipped() const {
+            return inputs_skipped;
+        }
+
+        uint64_t num_outputs() const {
+            return outputs;
+        }
+
+        // simulated time covered by the recording
+        uint64_t duration_us() const {
+            return sim_time_us;
+        }
+
+        // FNV-1a hash of the time & content of all the output commands
+        uint64_t digest() const {
+            return output_digest;
+        }
+
+    private:
+        struct PendingInput {
+            uint64_t time_us;
+            ReplayInput* input;
+            ITPS::RecordFile::Record record;
+        };
+
+        void load();
+        void advance_to(uint64_t time_us);
+        void start_ready_loops();
+        void run_control_tick();
+        void trigger(ReplayInput& input);
+        void collect_outputs();
+
+        SimulatedClock sim_clock; // the clock of the process while running
+        ITPS::RecordFile file;
+        std::string robot_ns;
+        std::vector< boost::shared_ptr<ReplayInput> > input_topics;
+        std::vector<PendingInput> pending;
+
+        // in pipeline order
+        boost::shared_ptr<VirtualMotionEKF> motion_ekf;
+        boost::shared_ptr<VirtualBallEKF> ball_ekf;
+        boost::shared_ptr<MotionModule> motion;
+        boost::shared_ptr<PID_System> control;
+        boost::shared_ptr<BallCaptureModule> ball_capture;
+
+        boost::shared_ptr< ITPS::NonBlockingSubscriber<Motion::MotionCMD> > command_sub;
+        boost::shared_ptr< ITPS::BlockingSubscriber<VF_Commands> > output_sub;
+        output_callback_t on_output;
+
+        bool motion_started, control_started; // the loops run once ready
+        uint64_t next_motion_tick, next_control_tick;
+        uint64_t sim_time_us, inputs_replayed, inputs_skipped, outputs, output_digest;
+};
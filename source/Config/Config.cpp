@@ -3,15 +3,25 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <algorithm>
 
 #include "Misc/Utility/BoostLogger.hpp"
 #include "Misc/Utility/Common.hpp"
 #include "Config/Config.hpp"
 
-unsigned int THREAD_POOL_SIZE = 30;
+unsigned int THREAD_POOL_SIZE = 10;
+unsigned int EXECUTOR_THREADS = 1; // run the steps of the core modules of all the robots, check Executor.hpp
 
-unsigned int INIT_DELAY = 1000; // 1 sec
-unsigned int DEFAULT_SUBSCRIBER_TIMEOUT = 3000; // 3 sec
+/* The control path (the executor & the vfirm clients) runs at SCHED_FIFO priorities on the ctrl CPUs, one per executor
+ * worker from CTRL_CPU on, the other pool threads on the remaining CPUs. A worker only holds its CPU for the length of a
+ * step, the vfirm I/O threads, below the executor's priority, run there in between.
+ * Without the privilege for SCHED_FIFO, everything stays SCHED_OTHER (logged at startup) */
+int CTRL_CPU = -1; // -1: the last EXECUTOR_THREADS CPUs, no pinning unless that leaves a CPU for the rest
+int CTRL_RT_PRIORITY = 80; // executor workers, 1 (lowest) - 99
+int FIRM_IO_RT_PRIORITY = 70; // vfirm client I/O threads, below the executor: a step is never preempted by I/O
+
+unsigned int STARTUP_LOG_PERIOD_MS = 1000; // how often a module waiting for its first inputs logs the missing ones
+unsigned int MODULE_STOP_TIMEOUT_MS = 2000; // on shutdown (SIGINT/SIGTERM) or restart (SIGHUP), the longest wait for a module to stop
 
 std::string VFIRM_IP_ADDR = "127.0.0.1"; // juts an example default val, will be reset in another code file
 unsigned int VFIRM_IP_PORT = 8888; // juts an example default val, will be reset in another code file
@@ -23,6 +33,25 @@ std::string GRSIM_VISION_IP = "224.5.23.2"; // juts an example default val, will
 int TCP_PORT = 6000; // juts an example default val, will be reset in another code file
 int UDP_PORT = 6001; // juts an example default val, will be reset in another code file
 
+/* Several robots can be hosted by one process (-n option), robot i listens on the ports above 
+ * + i * ROBOT_PORT_STRIDE, and connects to the vfirm on VFIRM_IP_PORT + i */
+unsigned int NUM_ROBOTS = 1;
+unsigned int ROBOT_PORT_STRIDE = 4; // each robot owns 4 ports from its port base, check help_print()
+unsigned int THREADS_PER_ROBOT = 8; // pool threads the modules of one robot may block at the same time: 3 socket loops,
+                                    // plus the core modules waiting for their publishers at startup
+
+int robot_tcp_port(unsigned int robot_id) {
+    return TCP_PORT + robot_id * ROBOT_PORT_STRIDE;
+}
+
+int robot_udp_port(unsigned int robot_id) {
+    return UDP_PORT + robot_id * ROBOT_PORT_STRIDE;
+}
+
+unsigned int robot_vfirm_port(unsigned int robot_id) {
+    return VFIRM_IP_PORT + robot_id;
+}
+
 unsigned int FIRM_CMD_MQ_SIZE = 1;
 unsigned int FIRM_DATA_MQ_SIZE = 10;
 
@@ -36,6 +65,15 @@ unsigned int SAFETY_EN_TIMEOUT = 500; // 500 ms
 unsigned int CTRL_FREQUENCY = 500; // Hz
 
 
+unsigned int MOTION_HISTORY_SIZE = 256; // number of past MotionData kept for time-aligned lookups
+unsigned int VISION_LATENCY_MS = 0; // camera capture => vision packet received, the packets carry no capture time
+
+unsigned int ITPS_STATS_LOG_PERIOD_MS = 0; // periodically log the ITPS channel metrics, 0: disabled (still available via the "stats" TCP command)
+bool ITPS_TRACING = false; // trace the latency from a UDP packet to the resulting vfirm commands, check Trace.hpp
+std::string ITPS_RECORD_PATH = ""; // record every ITPS publish into this file from startup (-r option), "": disabled, check Recorder.hpp
+unsigned int ITPS_RECORD_FILE_MB = 256; // preallocated size of the record file, publishes beyond it are dropped
+
+
 float NS_PID_AMP = 2.5; // for no-slowdown mode, pid const is multiplied by NS_PID_AMP
 
 // Translational PID consts
@@ -64,8 +102,11 @@ static void help_print(B_Log& logger) {
     std::stringstream ss;
     ss << "\nCommand: \n"
        << "For Virtual Robots on the Simulator: \n"
-       << "\t./TritonBot.exe (-v) <port_base> (<vfirm_ip>) <vfirm_port> \n\n"
+       << "\t./TritonBot.exe (-v) (-t) (-n <num_robots>) (-r <record_file>) <port_base> (<vfirm_ip>) <vfirm_port> \n\n"
        << "\t\t-v: For controlling virtual robots in the simulator\n"
+       << "\t\t-t: Trace the latency from the remote commands to the vfirm (\"trace\" TCP command)\n"
+       << "\t\t-n <num_robots>: Host several robots in this process, robot i uses (port_base + 4i) and (vfirm_port + i)\n"
+       << "\t\t-r <record_file>: Record all the ITPS traffic into record_file (\"record\" TCP command)\n"
        << "\t\t<port_base>: specify the port base number to host the servers of THIS program on (port_base), (port_base+1), (port_base+2), and (port_base+3) \n"
        << "\t\t<vfirm_ip>: specify the ip address (in string) for the vfirm.exe program that virtualize robot's firmware layer. Default to LocalHost if not specified \n"
        << "\t\t<vfirm_port>: specify the port of the particular vfirm.exe program to connect\n"
@@ -81,11 +122,20 @@ bool process_args(int argc, char *argv[]) {
 
     bool is_virtual = false;
     char option;
-    while ( (option = getopt(argc, argv,":v")) != -1 ) {
+    while ( (option = getopt(argc, argv,":vtn:r:")) != -1 ) {
         switch(option) {
             case 'v':
                 is_virtual = true;
                 break;
+            case 't':
+                ITPS_TRACING = true;
+                break;
+            case 'n':
+                NUM_ROBOTS = std::max(1, std::stoi(std::string(optarg), nullptr, 10));
+                break;
+            case 'r':
+                ITPS_RECORD_PATH = std::string(optarg);
+                break;
             case '?':
                 B_Log err_logger;
                 err_logger.add_tag("[setting.cpp]");
@@ -131,6 +181,10 @@ bool process_args(int argc, char *argv[]) {
            << "Connecting to the Virtual Robot on grSim claimed by vfirm.exe listening on: \n"
            << "\t" + VFIRM_IP_ADDR + " " + repr(VFIRM_IP_PORT)
            << std::endl;
+        if(NUM_ROBOTS > 1) {
+            ss << "Hosting " << NUM_ROBOTS << " robots, robot i uses the ports above + " 
+               << ROBOT_PORT_STRIDE << "*i and vfirm port + i" << std::endl;
+        }
         logger.log(Info, ss.str());
         return true;
 
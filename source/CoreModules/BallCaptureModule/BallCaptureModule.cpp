@@ -4,7 +4,7 @@
 #include "CoreModules/BallCaptureModule/BallCaptureModule.hpp"
 #include "CoreModules/EKF-Module/BallEkfModule.hpp"
 #include "Config/Config.hpp"
-
+#include "PeriphModules/RemoteServers/UdpReceiveModule.hpp"
 
 // Note: rotational data are all in world frame
 static Motion::MotionCMD default_cmd() {
@@ -16,46 +16,69 @@ static Motion::MotionCMD default_cmd() {
 }
 
 
-BallCaptureModule::BallCaptureModule() : enable_sub("CMD Server", "EnableAutoCap"),
-                                         ball_data_sub("BallEKF", "BallData"),
-                                         bot_data_sub("MotionEKF", "MotionData"),
-                                         command_pub("Ball Capture Module", "MotionCMD", default_cmd()),
-                                         ballcap_status_pub("Ball Capture Module", "isDribbled", false),
-                                         drib_enable_pub("BallCapture", "EnableDribbler", false),
+BallCaptureModule::BallCaptureModule() : enable_sub(CMDServer::EnableAutoCapTopic{}),
+                                         ball_data_sub(BallEKF::BallDataTopic{}),
+                                         bot_data_sub(MotionEKF::MotionDataTopic{}),
+                                         command_pub(BallCapture::MotionCMDTopic{}, default_cmd()),
+                                         ballcap_status_pub(BallCapture::IsDribbledTopic{}, false),
+                                         drib_enable_pub(BallCapture::EnableDribblerTopic{}, false),
                                          logger()
                                          
 {
     logger.add_tag("BallCapture Module");
+
+    writes<BallCapture::MotionCMDTopic>();
+    writes<BallCapture::IsDribbledTopic>();
+    writes<BallCapture::EnableDribblerTopic>();
+    reads<CMDServer::EnableAutoCapTopic>();
+    reads<BallEKF::BallDataTopic>();
+    reads<MotionEKF::MotionDataTopic>();
+
+    on_stop([this]() {
+        bot_data_subscription.cancel();
+        enable_subscription.cancel();
+        if(strand) strand->drain(); // a step() in progress completes first
+        if(exec_task != nullptr) exec_task->cancel();
+    });
 }
 
 BallCaptureModule::~BallCaptureModule() = default;
 
 
 void BallCaptureModule::init_subscribers() {
+    ball_data_sub.subscribe();
+    bot_data_sub.subscribe();
+    enable_sub.subscribe();
+}
 
-    try {
-        ball_data_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        bot_data_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        enable_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
 
-    }
-    catch(std::exception& e) {
-        B_Log logger;
-        logger.add_tag("[ball_capture_module.cpp]");
-        logger.log(Error, std::string(e.what()));
-        std::exit(0);
-    }
+void BallCaptureModule::task(ThreadPool& thread_pool) {
+    init_subscribers();
 
+    // motion data is the fastest input of this module, re-evaluate whenever it changes,
+    // and whenever the enable signal changes even without motion data
+    setup_unless_stopped([&]() {
+        strand.reset(new ThreadPool::Strand(thread_pool));
+        bot_data_subscription = bot_data_sub.on_message(boost::bind(&BallCaptureModule::step, this), *strand);
+        enable_subscription = enable_sub.on_message(boost::bind(&BallCaptureModule::step, this), *strand);
+        strand->execute(boost::bind(&BallCaptureModule::step, this)); // initial state
+    });
 }
 
-
-// [[noreturn]] 
-void BallCaptureModule::task(ThreadPool& thread_pool) {
-    UNUSED(thread_pool);
+bool BallCaptureModule::schedule(Executor& executor) {
     init_subscribers();
 
-    while(true){ // has delay (good for reducing high CPU usage)
+    // priority: driven by the motion data, up to one firmware frame per ms
+    setup_unless_stopped([&]() {
+        exec_task = &executor.add_event(qualified_name("BallCapture"), 1000);
+        bot_data_subscription = bot_data_sub.on_message(boost::bind(&BallCaptureModule::step, this), *exec_task);
+        enable_subscription = enable_sub.on_message(boost::bind(&BallCaptureModule::step, this), *exec_task);
+        exec_task->execute(boost::bind(&BallCaptureModule::step, this)); // initial state
+    });
+    return true;
+}
 
+void BallCaptureModule::step() {
 //         if(false){
 //             logger.log(Info, "Ball displacement (x, y): ( " + std::to_string(ball_pos_sub.latest_msg()(0)) + " , "
 //                              + std::to_string(ball_pos_sub.latest_msg()(1)) + " )\n");
@@ -72,63 +95,59 @@ void BallCaptureModule::task(ThreadPool& thread_pool) {
 //             delay(100);
 //         }
 
-        arma::vec ball_pos = ball_data_sub.latest_msg().disp;
-        MotionEKF_Module::MotionData latest_motion_data = bot_data_sub.latest_msg();
+    arma::vec ball_pos = ball_data_sub.latest_msg().disp;
+    MotionEKF_Module::MotionData latest_motion_data = bot_data_sub.latest_msg();
 
-        if(arma::norm(ball_pos - latest_motion_data.trans_disp) < 300.00) {
-            drib_enable_pub.publish(true);
-        }
-        else {
-            drib_enable_pub.publish(false);
-        }
+    if(arma::norm(ball_pos - latest_motion_data.trans_disp) < 300.00) {
+        drib_enable_pub.publish(true);
+    }
+    else {
+        drib_enable_pub.publish(false);
+    }
 
 
-        if(!check_ball_captured_V(ball_pos, latest_motion_data)){
-            ballcap_status_pub.publish(false);
-        }
-        else{
-            ballcap_status_pub.publish(true);
-        }
+    if(!check_ball_captured_V(ball_pos, latest_motion_data)){
+        ballcap_status_pub.publish(false);
+    }
+    else{
+        ballcap_status_pub.publish(true);
+    }
 
 
-        if(enable_sub.latest_msg()){
+    if(enable_sub.latest_msg()){
 
-            // if(false){
-            //     logger.log(Info, "[ball capture] dribble status: " + std::to_string(check_ball_captured_V(ball_data_sub.latest_msg().disp, bot_data_sub.latest_msg())));
-            //     delay(100);
-            // }
+        // if(false){
+        //     logger.log(Info, "[ball capture] dribble status: " + std::to_string(check_ball_captured_V(ball_data_sub.latest_msg().disp, bot_data_sub.latest_msg())));
+        //     delay(100);
+        // }
 
 
-            double delta_x = ball_pos(0) - latest_motion_data.trans_disp(0);
-            double delta_y = ball_pos(1) - latest_motion_data.trans_disp(1);
-            double angle = calc_angle(delta_y, delta_x);
+        double delta_x = ball_pos(0) - latest_motion_data.trans_disp(0);
+        double delta_y = ball_pos(1) - latest_motion_data.trans_disp(1);
+        double angle = calc_angle(delta_y, delta_x);
 
-            Motion::MotionCMD command;
+        Motion::MotionCMD command;
 
 
-            if(!check_ball_captured_V(ball_pos, latest_motion_data)){
-                command.mode = Motion::CTRL_Mode::TDRD;
-                command.ref_frame = Motion::ReferenceFrame::BodyFrame;
-                command.setpoint_3d = {ball_pos(0), ball_pos(1), angle + latest_motion_data.rotat_disp};
-                command_pub.publish(command);
-            }
-            else{
-                command.mode = Motion::CTRL_Mode::TVRD;
-                command.ref_frame = Motion::ReferenceFrame::BodyFrame;
-                command.setpoint_3d = {0, 5.00, angle + latest_motion_data.rotat_disp};
-                command_pub.publish(command);
-            }
+        if(!check_ball_captured_V(ball_pos, latest_motion_data)){
+            command.mode = Motion::CTRL_Mode::TDRD;
+            command.ref_frame = Motion::ReferenceFrame::BodyFrame;
+            command.setpoint_3d = {ball_pos(0), ball_pos(1), angle + latest_motion_data.rotat_disp};
+            command_pub.publish(command);
+        }
+        else{
+            command.mode = Motion::CTRL_Mode::TVRD;
+            command.ref_frame = Motion::ReferenceFrame::BodyFrame;
+            command.setpoint_3d = {0, 5.00, angle + latest_motion_data.rotat_disp};
+            command_pub.publish(command);
+        }
 
-            // if(true){
-            //     logger.log(Info, "[ball capture] capture command (x, y, O) " + std::to_string(command.mode) + " : (" + std::to_string(delta_x) + ", " + std::to_string(delta_y) +
-            //     ", " + std::to_string(angle + bot_data_sub.latest_msg().rotat_disp) + ")\n");
-            // }
+        // if(true){
+        //     logger.log(Info, "[ball capture] capture command (x, y, O) " + std::to_string(command.mode) + " : (" + std::to_string(delta_x) + ", " + std::to_string(delta_y) +
+        //     ", " + std::to_string(angle + bot_data_sub.latest_msg().rotat_disp) + ")\n");
+        // }
 
-        }
-        
-        delay(1); 
     }
-        
 }
 
 bool BallCaptureModule::check_ball_captured_V(arma::vec ball_pos, MotionEKF_Module::MotionData latest_motion_data){
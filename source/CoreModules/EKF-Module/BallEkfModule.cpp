@@ -10,6 +10,7 @@
 #include "ProtoGenerated/messages_robocup_ssl_geometry.pb.h"
 #include "Misc/Utility/Common.hpp"
 #include "Misc/Utility/Systime.hpp"
+#include "PeriphModules/RemoteServers/UdpReceiveModule.hpp"
 
 
 using namespace boost;
@@ -26,26 +27,21 @@ static BallEKF::BallData dft_bd() {
 } 
 
 
-BallEKF_Module::BallEKF_Module() : ball_data_pub("BallEKF", "BallData", dft_bd()),
-                                   ball_loc_sub("GVision Server", "BallPos(BodyFrame)"),
-                                   ball_vel_sub("GVision Server", "BallVel(BodyFrame)")
-{}
+BallEKF_Module::BallEKF_Module() : ball_data_pub(BallEKF::BallDataTopic{}, dft_bd()),
+                                   ball_loc_sub(CMDServer::BallPosTopic{}),
+                                   ball_vel_sub(CMDServer::BallVelTopic{})
+{
+    writes<BallEKF::BallDataTopic>();
+    reads<CMDServer::BallPosTopic>();
+    reads<CMDServer::BallVelTopic>();
+}
 
 BallEKF_Module::~BallEKF_Module() {} 
 
 
 void BallEKF_Module::init_subscribers() {
-    try {
-        ball_loc_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        ball_vel_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-    }
-    catch(std::exception& e) {
-        B_Log logger;
-        logger.add_tag("[ball_ekf_module.cpp]");
-        logger.log(Error, e.what());
-        std::exit(0);
-    }
-
+    ball_loc_sub.subscribe();
+    ball_vel_sub.subscribe();
 }
 
 
@@ -65,7 +61,15 @@ arma::vec BallEKF_Module::get_ball_vel() {
 
 /*   */
 
-VirtualBallEKF::VirtualBallEKF() : BallEKF_Module() {}
+const double VISION_FRAME_RATE = 60; // Hz, the ssl vision frames driving this module
+
+VirtualBallEKF::VirtualBallEKF() : BallEKF_Module() {
+    on_stop([this]() {
+        ball_vel_subscription.cancel();
+        if(strand) strand->drain(); // a run in progress completes first
+        if(exec_task != nullptr) exec_task->cancel();
+    });
+}
 
 
 VirtualBallEKF::~VirtualBallEKF() {}
@@ -77,18 +81,35 @@ void VirtualBallEKF::task(ThreadPool& thread_pool) {
     init_subscribers();
     logger(Info) << "\033[0;32m Initialized \033[0m";
 
+    // react to vision updates on the pool instead of holding a thread,
+    // the vision server publishes velocity after position, so a new velocity means a complete new frame
+    setup_unless_stopped([&]() {
+        strand.reset(new ThreadPool::Strand(thread_pool));
+        ball_vel_subscription = ball_vel_sub.on_message(boost::bind(&VirtualBallEKF::on_ball_vel, this, _1), *strand);
+    });
+}
+
+bool VirtualBallEKF::schedule(Executor& executor) {
+    logger.add_tag("PseudoBallEKF Module");
+    init_subscribers();
 
-    BallData ball_data;
+    setup_unless_stopped([&]() {
+        exec_task = &executor.add_event(qualified_name("BallEKF"), VISION_FRAME_RATE);
+        ball_vel_subscription = ball_vel_sub.on_message(boost::bind(&VirtualBallEKF::on_ball_vel, this, _1), *exec_task);
+    });
+    return true;
+}
 
-    while(true) { // has delay (good for reducing high CPU usage)
-        ball_data.disp = get_ball_loc();
-        ball_data.vel = get_ball_vel();
+void VirtualBallEKF::step() {
+    on_ball_vel(get_ball_vel());
+}
 
-        // logger.log(Info, "<" + repr(ball_data.disp(0)) + ", " + repr(ball_data.disp(1)) + ">");
-        publish_ball_data(ball_data);
+void VirtualBallEKF::on_ball_vel(const arma::vec& ball_vel) {
+    ball_data.vel = ball_vel;
+    ball_data.disp = get_ball_loc();
 
-        delay(1);
-    }
+    // logger.log(Info, "<" + repr(ball_data.disp(0)) + ", " + repr(ball_data.disp(1)) + ">");
+    publish_ball_data(ball_data);
 }
 
 /*   */
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "Misc/Utility/BoostLogger.hpp"
 #include "Config/Config.hpp"
 #include "Misc/Utility/Systime.hpp"
+#include "PeriphModules/FirmClientModule/FirmClientModule.hpp"
 
 using namespace boost;
 using namespace boost::asio;
@@ -22,26 +23,27 @@ static MotionEKF::MotionData default_md() {
     return rtn;
 } 
 
-MotionEKF_Module::MotionEKF_Module() : motion_data_pub("MotionEKF", "MotionData", default_md()),
-                        firm_data_sub("FirmClient", "InternalSensorData", FIRM_DATA_MQ_SIZE) //construct with blocking mode
+MotionEKF_Module::MotionEKF_Module() : motion_data_pub(MotionEKF::MotionDataTopic{}, default_md()),
+                        firm_data_sub(FirmClientModule::SensorDataTopic{}, FIRM_DATA_MQ_SIZE, 
+                                      ITPS::QueueBackend::LockFree) //construct with blocking mode
                         // ssl_data_sub("CMDListener", "GlobalSSLVisionData") // construct with nonblocking mode
-{}
+{
+    // let vision consumers look up the robot state at the (past) time a camera frame was captured
+    motion_data_pub.keep_history(MOTION_HISTORY_SIZE);
+
+    writes<MotionEKF::MotionDataTopic>();
+    reads<FirmClientModule::SensorDataTopic>();
+
+    // a stopped module doesn't hold the firmware client back, a pop_msg() in progress throws ITPS::QueueClosed
+    on_stop([this]() { firm_data_sub.unsubscribe(); });
+}
 
 MotionEKF_Module::~MotionEKF_Module() {} 
 
 
 void MotionEKF_Module::init_subscribers() {
-    try {
-        firm_data_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        // sslvison....
-    }
-    catch(std::exception& e) {
-        B_Log logger;
-        logger.add_tag("[motion_ekf_module.cpp]");
-        logger.log(Error, e.what());
-        std::exit(0);
-    }
-
+    firm_data_sub.subscribe();
+    // sslvison....
 }
 
 
@@ -50,10 +52,15 @@ void MotionEKF_Module::init_subscribers() {
 
 
 
-VF_Data MotionEKF_Module::get_firmware_data() {
+ITPS::ConstMsgPtr<VF_Data> MotionEKF_Module::get_firmware_data() {
     return firm_data_sub.pop_msg();
 }
 
+ITPS::Subscription MotionEKF_Module::on_firmware_data(boost::function<void(const ITPS::ConstMsgPtr<VF_Data>&)> callback,
+                                                      Executor::Task& exec_task) {
+    return firm_data_sub.on_message(callback, exec_task);
+}
+
 void MotionEKF_Module::publish_motion_data(MotionData data) {
     motion_data_pub.publish(data);
 }
@@ -64,14 +71,18 @@ const bool is_blue_team_side = true;
 const int vel_sample_period_ms = 50; // 50 ms
 const double vel_max_thresh = 10000.00; // 1000
 
-VirtualMotionEKF::VirtualMotionEKF() : MotionEKF_Module() {}
+VirtualMotionEKF::VirtualMotionEKF() : MotionEKF_Module() {
+    on_stop([this]() {
+        firm_data_subscription.cancel();
+        if(exec_task != nullptr) exec_task->cancel();
+    });
+}
 
 
 VirtualMotionEKF::~VirtualMotionEKF() = default;
 
 
-[[noreturn]] void VirtualMotionEKF::task(ThreadPool& thread_pool){
-    B_Log logger;
+void VirtualMotionEKF::task(ThreadPool& thread_pool){
     logger.add_tag("PseudoMotionEKF Module");
 
     logger(Info) << "\033[0;32m Thread Started \033[0m";
@@ -79,32 +90,52 @@ VirtualMotionEKF::~VirtualMotionEKF() = default;
     init_subscribers();
     logger(Info) << "\033[0;32m Initialized \033[0m";
 
-    VF_Data vf_data;
-    MotionEKF::MotionData m_data;
-
-    while(true) { // has delay (good for reducing high CPU usage)
-        // firm data is in body(not global) frame!
-        vf_data = get_firmware_data();
-
-        if(false){
-            logger.log(Info, "[virtual_motion_ekf] trans_disp_x_y: (" + std::to_string(vf_data.translational_displacement().x()) + ", " + std::to_string(vf_data.translational_displacement().y()) + ")");
-            logger.log(Info, "[virtual_motion_ekf] trans_vel_x_y: (" + std::to_string(vf_data.translational_velocity().x()) + ", " + std::to_string(vf_data.translational_velocity().y()) + ")");
-            logger.log(Info, "[virtual_motion_ekf] rotate_disp: (" + std::to_string(vf_data.rotational_displacement()) + ")");
-            logger.log(Info, "[virtual_motion_ekf] rotate_vel: (" + std::to_string(vf_data.rotational_velocity()) + ")");
+    while(!stop_requested()) { // paced by the firmware frames, step() blocks until the next one
+        try {
+            step();
         }
+        catch(ITPS::QueueClosed& e) {
+            break; // unsubscribed by request_stop()
+        }
+    }
+    logger(Info) << "\033[0;32m Stopped \033[0m";
+}
 
-        m_data.trans_disp = {vf_data.translational_displacement().x(),
-                             vf_data.translational_displacement().y()};
+bool VirtualMotionEKF::schedule(Executor& executor) {
+    logger.add_tag("PseudoMotionEKF Module");
+    init_subscribers();
 
-        m_data.trans_vel = {vf_data.translational_velocity().x(),
-                            vf_data.translational_velocity().y()};
+    // priority: up to one firmware frame per ms
+    setup_unless_stopped([&]() {
+        exec_task = &executor.add_event(qualified_name("MotionEKF"), 1000);
+        firm_data_subscription = on_firmware_data(boost::bind(&VirtualMotionEKF::on_firm_data, this, _1), *exec_task);
+    });
+    return true;
+}
 
-        // Rotational data are all in world frame
-        m_data.rotat_disp = vf_data.rotational_displacement();
-        m_data.rotat_vel = vf_data.rotational_velocity();
+void VirtualMotionEKF::step() {
+    on_firm_data(get_firmware_data());
+}
 
-        publish_motion_data(m_data);
+void VirtualMotionEKF::on_firm_data(const ITPS::ConstMsgPtr<VF_Data>& vf_data) {
+    // firm data is in body(not global) frame!
 
-        delay(1);
+    if(false){
+        logger.log(Info, "[virtual_motion_ekf] trans_disp_x_y: (" + std::to_string(vf_data->translational_displacement().x()) + ", " + std::to_string(vf_data->translational_displacement().y()) + ")");
+        logger.log(Info, "[virtual_motion_ekf] trans_vel_x_y: (" + std::to_string(vf_data->translational_velocity().x()) + ", " + std::to_string(vf_data->translational_velocity().y()) + ")");
+        logger.log(Info, "[virtual_motion_ekf] rotate_disp: (" + std::to_string(vf_data->rotational_displacement()) + ")");
+        logger.log(Info, "[virtual_motion_ekf] rotate_vel: (" + std::to_string(vf_data->rotational_velocity()) + ")");
     }
+
+    motion_data.trans_disp = {vf_data->translational_displacement().x(),
+                              vf_data->translational_displacement().y()};
+
+    motion_data.trans_vel = {vf_data->translational_velocity().x(),
+                             vf_data->translational_velocity().y()};
+
+    // Rotational data are all in world frame
+    motion_data.rotat_disp = vf_data->rotational_displacement();
+    motion_data.rotat_vel = vf_data->rotational_velocity();
+
+    publish_motion_data(motion_data);
 }
@@ -3,9 +3,13 @@
 #include "Misc/Utility/Common.hpp"
 #include "Misc/Utility/Systime.hpp"
 #include "Misc/Utility/BoostLogger.hpp"
+#include "PeriphModules/RemoteServers/TcpReceiveModule.hpp"
+#include "PeriphModules/RemoteServers/UdpReceiveModule.hpp"
 
 
 
+const unsigned int CMD_IDLE_TIMEOUT = 100; // ms, upper bound of sleeping without a new command
+const unsigned int WORLD_FRAME_RATE = 1000; // Hz, world frame setpoints are re-transformed every 1 ms
 
 static CTRL::SetPoint<arma::vec> default_trans_sp() {
     CTRL::SetPoint<arma::vec> rtn;
@@ -22,31 +26,41 @@ static CTRL::SetPoint<float> default_rot_sp() {
     return rtn;
 }
 
-MotionModule::MotionModule() : trans_setpoint_pub("AI CMD", "Trans", default_trans_sp()), 
-                               rotat_setpoint_pub("AI CMD", "Rotat", default_rot_sp()),
-                               sensor_sub("MotionEKF", "MotionData"), // NonBlocking Mode
-                               robot_origin_w_sub("ConnectionInit", "RobotOrigin(WorldFrame)"), // NonBlocking Mode
-                               command_sub("CMD Server", "MotionCMD"), // NonBlocking Mode because this module needs to keep the loop running 
+MotionModule::MotionModule() : trans_setpoint_pub(Motion::TransSetPointTopic{}, default_trans_sp()), 
+                               rotat_setpoint_pub(Motion::RotatSetPointTopic{}, default_rot_sp()),
+                               sensor_sub(MotionEKF::MotionDataTopic{}), // NonBlocking Mode
+                               robot_origin_w_sub(ConnectionServer::RobotOriginTopic{}), // NonBlocking Mode
+                               command_sub(CMDServer::MotionCMDTopic{}), // NonBlocking Mode because this module needs to keep the loop running 
                                                                        // non-blocking to calculate transformation matrix that changes along
                                                                        // the orientation of a moving robot
-                               no_slowdown_pub("AI CMD", "NoSlowdown", false)
-{}
+                               no_slowdown_pub(Motion::NoSlowdownTopic{}, false)
+{
+    trans_setpoint_pub.join_group(Motion::SetPointGroup{});
+    rotat_setpoint_pub.join_group(Motion::SetPointGroup{});
+    no_slowdown_pub.join_group(Motion::SetPointGroup{});
+
+    writes<Motion::TransSetPointTopic>();
+    writes<Motion::RotatSetPointTopic>();
+    writes<Motion::NoSlowdownTopic>();
+    reads<MotionEKF::MotionDataTopic>();
+    reads<ConnectionServer::RobotOriginTopic>();
+    reads<CMDServer::MotionCMDTopic>();
+
+    // world frame setpoints are transformed with the robot's orientation, the default one is made up
+    await_first_publish(sensor_sub);
+
+    on_stop([this]() {
+        command_subscription.cancel();
+        if(exec_task != nullptr) exec_task->cancel();
+    });
+}
 
 MotionModule::~MotionModule() {}
 
 void MotionModule::init_subscribers(void) {
-    try {
-        sensor_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        robot_origin_w_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        command_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-    }
-    catch(std::exception& e) {
-        B_Log logger;
-        logger.add_tag("[motion_module.cpp]");
-        logger.log(Error, e.what());
-        std::exit(0);
-    }
-
+    sensor_sub.subscribe();
+    robot_origin_w_sub.subscribe();
+    command_sub.subscribe();
 }
 
 
@@ -57,18 +71,53 @@ void MotionModule::task(ThreadPool& thread_pool) {
     logger(Info) << "\033[0;32m Thread Started \033[0m";
     init_subscribers();
     logger(Info) << "\033[0;32m Initialized \033[0m";
-    delay(INIT_DELAY);
+    if(!wait_ready(logger, STARTUP_LOG_PERIOD_MS)) return;
     logger(Info) << "\033[0;32m Loop Started \033[0m";
     
-    while(1) { // has delay (good for reducing high CPU usage)
-        auto cmd = command_sub.latest_msg();
+    uint64_t cmd_version = 0;
+    MotionCMD cmd = command_sub.latest_msg(cmd_version);
+    while(!stop_requested()) { // blocks on command updates (good for reducing high CPU usage)
         move(cmd.setpoint_3d, cmd.mode, cmd.ref_frame);       
 
-        delay(1); 
+        /* World frame setpoints depend on the robot's orientation, so they have to be re-transformed
+         * every 1 ms even without a new command, body frame setpoints only change with a new command */
+        unsigned int timeout_ms = (cmd.ref_frame == WorldFrame) ? 1000 / WORLD_FRAME_RATE : CMD_IDLE_TIMEOUT;
+        command_sub.wait_for_update(cmd_version, timeout_ms);
+        command_sub.try_get_if_newer(cmd, cmd_version);
     }
 }
 
 
+void MotionModule::step() {
+    MotionCMD cmd = command_sub.latest_msg();
+    move(cmd.setpoint_3d, cmd.mode, cmd.ref_frame);
+}
+
+
+bool MotionModule::schedule(Executor& executor) {
+    B_Log logger;
+    logger.add_tag("Motion Module");
+    init_subscribers();
+    if(!wait_ready(logger, STARTUP_LOG_PERIOD_MS)) return true; // stopped before it got scheduled
+    loop_started = false;
+    setup_unless_stopped([&]() {
+        exec_task = &executor.add_periodic(qualified_name("Motion"), WORLD_FRAME_RATE,
+                                           boost::bind(&MotionModule::on_tick, this));
+        command_subscription = command_sub.on_message(boost::bind(&MotionModule::on_command, this, _1), *exec_task);
+    });
+    return true;
+}
+
+void MotionModule::on_command(const MotionCMD& cmd) {
+    if(loop_started) move(cmd.setpoint_3d, cmd.mode, cmd.ref_frame);
+}
+
+// body frame setpoints only change with a new command, world frame ones with the robot's orientation as well
+void MotionModule::on_tick() {
+    MotionCMD cmd = command_sub.latest_msg();
+    if(!loop_started || cmd.ref_frame == WorldFrame) move(cmd.setpoint_3d, cmd.mode, cmd.ref_frame);
+    loop_started = true;
+}
 
 
 void MotionModule::move(arma::vec setpoint_3d, CTRL_Mode mode, ReferenceFrame setpoint_ref_frame) { // default: setpoint frame is world frame
@@ -144,6 +193,9 @@ void MotionModule::move(arma::vec setpoint_3d, CTRL_Mode mode, ReferenceFrame se
         }
     }
 
+    // the control module's snapshot reads never see a half-published setpoint
+    ITPS::GroupPublish group_publish(Motion::SetPointGroup{}, module_namespace());
+
     trans_setpoint_pub.publish(trans_setpoint);
     rotat_setpoint_pub.publish(rotat_setpoint);
 
@@ -1,23 +1,22 @@
-#include <boost/chrono.hpp>
-#include <boost/chrono/system_clocks.hpp>
-#include <boost/thread.hpp> 
-
+#include "Misc/Utility/Clock.hpp"
 #include "Misc/Utility/Systime.hpp"
 
-unsigned int millis(void) {
-    auto t = boost::chrono::high_resolution_clock::now();
-    return (unsigned int)(double(t.time_since_epoch().count()) / 1000000.00f);
+uint64_t nanos(void) {
+    return current_clock().now_ns();
+}
+
+uint64_t micros(void) {
+    return current_clock().now_ns() / 1000ULL;
 }
 
-unsigned int micros(void) {
-    auto t = boost::chrono::high_resolution_clock::now();
-    return (unsigned int)(double(t.time_since_epoch().count()) / 1000.00f);
+uint64_t millis(void) {
+    return current_clock().now_ns() / 1000000ULL;
 }
 
 void delay_us(unsigned int microseconds) {
-    boost::this_thread::sleep_for(boost::chrono::microseconds(microseconds));
+    current_clock().sleep_for_ns((uint64_t) microseconds * 1000ULL);
 }
 
 void delay(unsigned int milliseconds) {
-    boost::this_thread::sleep_for(boost::chrono::milliseconds(milliseconds));
+    current_clock().sleep_for_ns((uint64_t) milliseconds * 1000000ULL);
 }
@@ -35,7 +35,7 @@ static void init_sensors(asio::ip::tcp::socket& socket, B_Log& logger);
 static void on_socket_connected(asio::ip::tcp::socket& socket, 
                                 std::string& write_buf,
                                 asio::streambuf& read_buf, 
-                                ITPS::BlockingPublisher<VF_Data>& firm_data_pub, 
+                                ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>>& firm_data_pub, 
                                 ITPS::BlockingSubscriber<VF_Commands>& firm_cmd_sub,
                                 ITPS::NonBlockingSubscriber<bool>& init_sensors_sub,
                                 B_Log& logger,  
@@ -44,7 +44,7 @@ static void on_socket_connected(asio::ip::tcp::socket& socket,
 static void on_data_received(asio::ip::tcp::socket& socket, 
                              std::string& write_buf,
                              asio::streambuf& read_buf, 
-                             ITPS::BlockingPublisher<VF_Data>& firm_data_pub, 
+                             ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>>& firm_data_pub, 
                              ITPS::BlockingSubscriber<VF_Commands>& firm_cmd_sub,
                              ITPS::NonBlockingSubscriber<bool>& init_sensors_sub,
                              B_Log& logger,  
@@ -53,7 +53,7 @@ static void on_data_received(asio::ip::tcp::socket& socket,
 static void on_cmd_sent(asio::ip::tcp::socket& socket, 
                         std::string& write_buf,
                         asio::streambuf& read_buf, 
-                        ITPS::BlockingPublisher<VF_Data>& firm_data_pub, 
+                        ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>>& firm_data_pub, 
                         ITPS::BlockingSubscriber<VF_Commands>& firm_cmd_sub,
                         ITPS::NonBlockingSubscriber<bool>& init_sensors_sub,
                         B_Log& logger,  
@@ -64,6 +64,12 @@ static void on_cmd_sent(asio::ip::tcp::socket& socket,
 
 
 //====================================================================================//
+VFirmClient::VFirmClient() {
+    writes<FirmClientModule::SensorDataTopic>();
+    reads<FirmClientModule::CommandsTopic>();
+    reads<FirmClientModule::InitSensorsTopic>();
+}
+
 /* Main Task to be run on a new thread from the thread pool */
 void VFirmClient::task(ThreadPool& thread_pool) {
     UNUSED(thread_pool); // no child thread is needed in a async scheme
@@ -73,30 +79,24 @@ void VFirmClient::task(ThreadPool& thread_pool) {
     logger(Info) << "\033[0;32m Thread Started \033[0m";
 
     asio::io_service io_service;
-    asio::ip::tcp::endpoint ep(asio::ip::address::from_string(VFIRM_IP_ADDR), VFIRM_IP_PORT);
+    asio::ip::tcp::endpoint ep(asio::ip::address::from_string(VFIRM_IP_ADDR), robot_vfirm_port(robot_id()));
     asio::ip::tcp::socket socket(io_service);
     asio::streambuf read_buf;
     std::string write_buf;
 
     // publisher to publish data sent from vfirm: [vfirm socket] => [firm_data_pub] => [EKF module]
-    ITPS::BlockingPublisher<VF_Data> firm_data_pub("FirmClient", "InternalSensorData");
+    ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>> firm_data_pub(FirmClientModule::SensorDataTopic{});
 
     // subscriber to listen to commands to be sent to vfirm:  [control module] => [firm_cmd_sub] => vfirm socket
-    ITPS::BlockingSubscriber<VF_Commands> firm_cmd_sub("FirmClient", "Commands", FIRM_CMD_MQ_SIZE); //construct with a message queue as buffer
+    ITPS::BlockingSubscriber<VF_Commands> firm_cmd_sub(FirmClientModule::CommandsTopic{}, FIRM_CMD_MQ_SIZE, 
+                                                         ITPS::QueueBackend::LockFree,
+                                                         ITPS::OverflowPolicy::DropOldest); //construct with a message queue as buffer, keep the latest cmds
 
     // subscriber to listen to a signal to trigger sensor re/initilization sequence 
-    ITPS::NonBlockingSubscriber<bool> init_sensors_sub("vfirm-client", "re/init sensors");
+    ITPS::NonBlockingSubscriber<bool> init_sensors_sub(FirmClientModule::InitSensorsTopic{});
 
-    try {
-        firm_cmd_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        init_sensors_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-    }
-    catch(std::exception& e) {
-        B_Log logger;
-        logger.add_tag("[vfirm_client.cpp]");
-        logger.log(Error, e.what());
-        std::exit(0);
-    }
+    firm_cmd_sub.subscribe();
+    init_sensors_sub.subscribe();
 
     logger(Info) << "\033[0;32m Initialized \033[0m";
 
@@ -118,10 +118,12 @@ void VFirmClient::task(ThreadPool& thread_pool) {
         B_Log logger;
         logger.add_tag("[vfirm_client.cpp]");
         logger.log(Error, e.what());
-        std::exit(0);
+        return;
     }
 
-    io_service.run(); // this line blocks until the async tasks queue becomes empty
+    // the pending handlers are dropped, none of them runs after the locals they refer to are gone
+    Module::StopCallback stop_cb(*this, [&io_service]() { io_service.stop(); });
+    io_service.run(); // this line blocks until the async tasks queue becomes empty, or the stop
 }
 //====================================================================================//
 
@@ -133,7 +135,7 @@ void VFirmClient::task(ThreadPool& thread_pool) {
 static void on_socket_connected(asio::ip::tcp::socket& socket, 
                                 std::string& write_buf,
                                 asio::streambuf& read_buf, 
-                                ITPS::BlockingPublisher<VF_Data>& firm_data_pub, 
+                                ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>>& firm_data_pub, 
                                 ITPS::BlockingSubscriber<VF_Commands>& firm_cmd_sub,
                                 ITPS::NonBlockingSubscriber<bool>& init_sensors_sub,
                                 B_Log& logger,  
@@ -142,7 +144,7 @@ static void on_socket_connected(asio::ip::tcp::socket& socket,
         B_Log logger;
         logger.add_tag("[vfirm_client.cpp]");
         logger.log(Error, error.message());
-        std::exit(0);
+        return; // nothing else queued, io_service.run() returns and so does task()
     }
     logger(Info) << "\033[0;32m socket connected \033[0m";
 
@@ -167,7 +169,7 @@ static void on_socket_connected(asio::ip::tcp::socket& socket,
 static void on_data_received(asio::ip::tcp::socket& socket, 
                              std::string& write_buf,
                              asio::streambuf& read_buf, 
-                             ITPS::BlockingPublisher<VF_Data>& firm_data_pub, 
+                             ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>>& firm_data_pub, 
                              ITPS::BlockingSubscriber<VF_Commands>& firm_cmd_sub,
                              ITPS::NonBlockingSubscriber<bool>& init_sensors_sub,
                              B_Log& logger,  
@@ -176,22 +178,25 @@ static void on_data_received(asio::ip::tcp::socket& socket,
         B_Log logger;
         logger.add_tag("[vfirm_client.cpp]");
         logger.log(Error, error.message());
-        std::exit(0);
+        return; // nothing else queued, io_service.run() returns and so does task()
     }
-    VF_Data data;                             
+    // recycled buffers, this callback only ever runs on the io_service thread of its own client
+    static thread_local ITPS::MsgPool<VF_Data> vf_data_pool(FIRM_DATA_MQ_SIZE + 2);
+
+    boost::shared_ptr<VF_Data> data = vf_data_pool.acquire();
     std::istream input_stream(&read_buf); // check me
     std::string received;
 
     // where is read_buf used? checkout few lines above
     received = std::string(std::istreambuf_iterator<char>(input_stream), {});            
-    data.ParseFromString(received);
+    data->ParseFromString(received); // parsing in place reuses the buffer's storage
 
-    firm_data_pub.publish(data); // EKF module is subscribing to this module.
+    firm_data_pub.publish(data); // EKF module is subscribing to this module, it receives this very pointer
 
-    logger.log( Debug, "Trans_Dis: " + repr(data.translational_displacement().x()) + ' ' + repr(data.translational_displacement().y()));
-    logger.log( Debug, "Trans_Vel:" + repr(data.translational_velocity().x()) + ' ' + repr(data.translational_velocity().y()));
-    logger.log( Debug, "Rot_Dis:" + repr(data.rotational_displacement()));
-    logger.log( Debug, "Rot_Vel:" + repr(data.rotational_velocity()) + "\n :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) ");
+    logger.log( Debug, "Trans_Dis: " + repr(data->translational_displacement().x()) + ' ' + repr(data->translational_displacement().y()));
+    logger.log( Debug, "Trans_Vel:" + repr(data->translational_velocity().x()) + ' ' + repr(data->translational_velocity().y()));
+    logger.log( Debug, "Rot_Dis:" + repr(data->rotational_displacement()));
+    logger.log( Debug, "Rot_Vel:" + repr(data->rotational_velocity()) + "\n :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) :) ");
     
 
     bool re_init = init_sensors_sub.latest_msg(); // non blocking
@@ -216,6 +221,7 @@ static void on_data_received(asio::ip::tcp::socket& socket,
     VF_Commands cmd;
     // conditionally blocking (this method blocks when the message queue is empty)
     cmd = firm_cmd_sub.pop_msg(FIRM_CMD_SUB_TIMEOUT, default_cmd);
+    ITPS::trace_point("VFirmClient.SendCommand"); // end of the remote command => vfirm path
 
     write_buf.clear(); // clear the string (as a std buffer)
     cmd.set_init(false);
@@ -246,7 +252,7 @@ static void on_data_received(asio::ip::tcp::socket& socket,
 static void on_cmd_sent(asio::ip::tcp::socket& socket, 
                         std::string& write_buf,
                         asio::streambuf& read_buf, 
-                        ITPS::BlockingPublisher<VF_Data>& firm_data_pub, 
+                        ITPS::BlockingPublisher<ITPS::ConstMsgPtr<VF_Data>>& firm_data_pub, 
                         ITPS::BlockingSubscriber<VF_Commands>& firm_cmd_sub,
                         ITPS::NonBlockingSubscriber<bool>& init_sensors_sub,
                         B_Log& logger,  
@@ -255,7 +261,7 @@ static void on_cmd_sent(asio::ip::tcp::socket& socket,
         B_Log logger;
         logger.add_tag("[vfirm_client.cpp]");
         logger.log(Error, error.message());
-        std::exit(0);
+        return; // nothing else queued, io_service.run() returns and so does task()
     } 
 
     // set the next read event
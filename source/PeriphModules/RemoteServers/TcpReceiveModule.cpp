@@ -1,8 +1,11 @@
 #include "PeriphModules/RemoteServers/TcpReceiveModule.hpp"
+#include "CoreModules/BallCaptureModule/BallCaptureModule.hpp"
+#include "PeriphModules/FirmClientModule/FirmClientModule.hpp"
 
 #include <string>
 #include <thread>
 #include <iostream>
+#include <sys/socket.h>
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
 
@@ -15,38 +18,44 @@
 
 using namespace boost;
 
-boost::mutex mu;
-
 
+/* runs every 500 ms on a pool timer as long as the connection,
+ * a write error clears connected, the runs are then no-ops until the timer gets cancelled */
 static void backgnd_task(ITPS::NonBlockingSubscriber<bool>& ballcap_status_sub, 
-                         asio::ip::tcp::socket& socket) {
-    bool prev_ballcap_status = true; // deliberately set it true to have a extra socket send at the begining
-    while(1) { // has delay (good for reducing high CPU usage)
-
-        delay(500); // this delay is important now because EKF is not yet implemented, 
-                    // pseudo ekf doesn't handle the issue of botLoc & ballLoc data being received at different frequency 
-
-        std::string send_str;
-        bool ballcap_status;
-        ballcap_status = ballcap_status_sub.latest_msg(); 
-        if(ballcap_status != prev_ballcap_status) {
-            if(ballcap_status) {
-                send_str = "BallOnHold";
-            }
-            else {
-                send_str = "BallOffHold";
-            }
-            mu.lock();
-            asio::write(socket, asio::buffer(send_str + "\n"));
-            mu.unlock();
+                         asio::ip::tcp::socket& socket, boost::mutex& mu, boost::atomic<bool>& connected,
+                         bool& prev_ballcap_status) {
+    if(!connected) return;
+
+    // the period is important now because EKF is not yet implemented, 
+    // pseudo ekf doesn't handle the issue of botLoc & ballLoc data being received at different frequency 
+
+    std::string send_str;
+    bool ballcap_status;
+    ballcap_status = ballcap_status_sub.latest_msg(); 
+    if(ballcap_status != prev_ballcap_status) {
+        if(ballcap_status) {
+            send_str = "BallOnHold";
         }
-        prev_ballcap_status = ballcap_status;
-        
+        else {
+            send_str = "BallOffHold";
+        }
+        boost::system::error_code ec;
+        mu.lock();
+        asio::write(socket, asio::buffer(send_str + "\n"), ec);
+        mu.unlock();
+        if(ec) connected = false;
     }
-
+    prev_ballcap_status = ballcap_status;
 }
 
 
+ConnectionServer::TcpReceiveModule() {
+    writes<ConnectionServer::SafetyEnableTopic>();
+    writes<ConnectionServer::RobotOriginTopic>();
+    writes<FirmClientModule::InitSensorsTopic>();
+    reads<BallCapture::IsDribbledTopic>();
+}
+
 // Implementation of task to be run on this thread
 void ConnectionServer::task(ThreadPool& thread_pool) {
     UNUSED(thread_pool); // no child thread is needed in a async scheme
@@ -62,63 +71,64 @@ void ConnectionServer::task(ThreadPool& thread_pool) {
     int goal_width = 0;
 
     asio::io_service io_service;
-    asio::ip::tcp::endpoint endpoint_to_listen(asio::ip::tcp::v4(), TCP_PORT);
+    asio::ip::tcp::endpoint endpoint_to_listen(asio::ip::tcp::v4(), robot_tcp_port(robot_id()));
     asio::ip::tcp::acceptor acceptor(io_service, endpoint_to_listen);
     asio::ip::tcp::socket socket(io_service);
     asio::streambuf read_buf;
     std::string write_buf;
-
-    ITPS::NonBlockingPublisher<bool> safety_enable_pub("AI Connection", "SafetyEnable", true); // To-do: change it back to false after testing
-    ITPS::NonBlockingPublisher< arma::vec > robot_origin_w_pub("ConnectionInit", "RobotOrigin(WorldFrame)", zero_vec_2d());
-    ITPS::NonBlockingPublisher<bool> init_sensors_pub("vfirm-client", "re/init sensors", false);
-    ITPS::NonBlockingSubscriber<bool> ballcap_status_sub("Ball Capture Module", "isDribbled");
+    boost::mutex mu; // serializes the writes of this connection
+    boost::atomic<bool> connected{false};
+
+    // wake up the blocking accept()/read_until() below, a listening socket only wakes up on shutdown(), not close()
+    Module::StopCallback stop_cb(*this, [&]() {
+        boost::system::error_code ec;
+        ::shutdown(acceptor.native_handle(), SHUT_RDWR);
+        socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        connected = false;
+    });
+
+    ITPS::NonBlockingPublisher<bool> safety_enable_pub(ConnectionServer::SafetyEnableTopic{}, true); // To-do: change it back to false after testing
+    ITPS::NonBlockingPublisher< arma::vec > robot_origin_w_pub(ConnectionServer::RobotOriginTopic{}, zero_vec_2d());
+    ITPS::NonBlockingPublisher<bool> init_sensors_pub(FirmClientModule::InitSensorsTopic{}, false);
+    ITPS::NonBlockingSubscriber<bool> ballcap_status_sub(BallCapture::IsDribbledTopic{});
 
     
 
     
 
 
-    logger.log(Info, "Server Started on Port Number:" + repr(TCP_PORT)
+    logger.log(Info, "Server Started on Port Number:" + repr(robot_tcp_port(robot_id()))
                     + ", Awaiting Remote AI Connection...");
 
-    try 
-    {
-        ballcap_status_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        acceptor.accept(socket); // blocks until getting a connection request and accept the connection
-    }
-    catch(std::exception& e)
-    {
-        B_Log logger;
-        logger.add_tag("[connection_server_module.cpp]");
-        logger.log(Error, e.what());
+    ballcap_status_sub.subscribe();
+    boost::system::error_code ec;
+    acceptor.accept(socket, ec); // blocks until getting a connection request and accept the connection
+    if(ec || stop_requested()) {
+        if(!stop_requested()) logger.log(Error, "Accept failed: " + ec.message());
         safety_enable_pub.publish(false);
-        std::exit(0);
+        return;
     }
 
     logger.log(Info, "Connection Established");
-    asio::write(socket, asio::buffer("CONNECTION ESTABLISHED\n"));
+    asio::write(socket, asio::buffer("CONNECTION ESTABLISHED\n"), ec);
 
-    // enqueue the backgnd task of this module to the thread pool
-    thread_pool.execute(boost::bind(&backgnd_task, boost::ref(ballcap_status_sub), boost::ref(socket)));
+    // the backgnd task of this module runs on a pool timer, cancelled before its socket goes away
+    connected = !ec && !stop_requested();
+    bool prev_ballcap_status = true; // deliberately set it true to have a extra socket send at the begining
+    ThreadPool::Timer backgnd_timer = thread_pool.schedule_every(500, [&]() {
+        backgnd_task(ballcap_status_sub, socket, mu, connected, prev_ballcap_status);
+    });
 
 
-    while(1) { // No delay, blocking-socket-read is used, usually won't use too much CPU resources
+    while(connected) { // No delay, blocking-socket-read is used, usually won't use too much CPU resources
         // get first line seperated string from the receiving buffer
         std::istream input_stream(&read_buf);
 
-        try {
-            asio::read_until(socket, read_buf, "\n"); 
-        }
-        catch(std::exception& e) {
-            B_Log logger;
-            logger.add_tag("[connection_server_module.cpp]");
-            logger.log(Error, e.what());
+        asio::read_until(socket, read_buf, "\n", ec); 
+        if(ec || stop_requested()) {
+            if(!stop_requested()) logger.log(Error, "Connection lost: " + ec.message());
             safety_enable_pub.publish(false);
-
-            // To-do: handle disconnect
-            while(1) { // has delay (good for reducing high CPU usage)
-                delay(1000);
-            }
+            break; // To-do: handle disconnect
         }
     
         // Tokenize the received input
@@ -149,6 +159,38 @@ void ConnectionServer::task(ThreadPool& thread_pool) {
                 }
             }
 
+            // Format: stats     dump the live metrics of all the ITPS channels
+            else if(tokens[0] == "stats") {
+                rtn_str = ITPS::dump_channel_stats() + "END STATS";
+            }
+
+            // Format: trace     dump the per-hop latency breakdown (needs ITPS_TRACING)
+            else if(tokens[0] == "trace") {
+                rtn_str = ITPS::dump_trace_stats() + "END TRACE";
+            }
+
+            // Format: record                  recorder status
+            //         record <file>           start recording all the ITPS traffic into file
+            //         record stop             stop & close the file
+            else if(tokens[0] == "record") {
+                if(tokens.size() == 1) {
+                    rtn_str = ITPS::dump_recorder_stats() + "END RECORD";
+                }
+                else if(tokens[1] == "stop") {
+                    ITPS::Recorder::instance().stop();
+                    rtn_str = "Recording Stopped";
+                }
+                else {
+                    try {
+                        ITPS::Recorder::instance().start(tokens[1], (uint64_t) ITPS_RECORD_FILE_MB << 20);
+                        rtn_str = "Recording into " + tokens[1];
+                    }
+                    catch(std::exception& e) {
+                        rtn_str = e.what();
+                    }
+                }
+            }
+
             else if(tokens[0] == "anything") {
                 rtn_str = "bazinga";
             }
@@ -159,9 +201,11 @@ void ConnectionServer::task(ThreadPool& thread_pool) {
         }
 
         mu.lock();
-        asio::write(socket, asio::buffer(rtn_str + "\n"));
+        asio::write(socket, asio::buffer(rtn_str + "\n"), ec);
         mu.unlock();
     }
- 
+
+    connected = false;
+    backgnd_timer.cancel(); // waits for a run in progress
 }
 
@@ -9,6 +9,8 @@
 #include "CoreModules/MotionModule/MotionModule.hpp"
 #include "CoreModules/EKF-Module/MotionEkfModule.hpp"
 #include "CoreModules/EKF-Module/BallEkfModule.hpp"
+#include "CoreModules/BallCaptureModule/BallCaptureModule.hpp"
+#include "PeriphModules/RemoteServers/TcpReceiveModule.hpp"
 #include "Misc/Utility/Systime.hpp"
 #include "Misc/Utility/BoostLogger.hpp"
 #include "Misc/Utility/Common.hpp"
@@ -30,8 +32,23 @@ static Motion::MotionCMD default_cmd() {
     return dft_cmd;
 }
 
+CMDServer::UdpReceiveModule() {
+    writes<CMDServer::BotPosTopic>();
+    writes<CMDServer::BotVelTopic>();
+    writes<CMDServer::BotAngTopic>();
+    writes<CMDServer::BotAngVelTopic>();
+    writes<CMDServer::BallPosTopic>();
+    writes<CMDServer::BallVelTopic>();
+    writes<CMDServer::MotionCMDTopic>();
+    writes<CMDServer::EnableAutoCapTopic>();
+    writes<CMDServer::KickerSetPointTopic>();
+    reads<ConnectionServer::RobotOriginTopic>();
+    reads<MotionEKF::MotionDataTopic>();
+    reads<BallCapture::MotionCMDTopic>();
+}
+
 // Implementation of task to be run on this thread
-[[noreturn]] void CMDServer::task(ThreadPool& thread_pool) {
+void CMDServer::task(ThreadPool& thread_pool) {
     UNUSED(thread_pool); 
 
     B_Log logger;
@@ -39,9 +56,15 @@ static Motion::MotionCMD default_cmd() {
     logger(Info) << "\033[0;32m Thread Started \033[0m";
 
     io_service io_service;
-    udp::endpoint ep_listen(udp::v4(), UDP_PORT);
+    udp::endpoint ep_listen(udp::v4(), robot_udp_port(robot_id()));
     udp::socket socket(io_service, ep_listen);
 
+    // wakes up the blocking receive_from() below, which then returns an empty packet
+    Module::StopCallback stop_cb(*this, [&socket]() {
+        boost::system::error_code ec; // ENOTCONN on a UDP socket, the receiver is woken up anyway
+        socket.shutdown(udp::socket::shutdown_receive, ec);
+    });
+
     size_t num_received;
     std::string packet_received;
     boost::array<char, UDP_RBUF_SIZE> receive_buffer;
@@ -50,34 +73,26 @@ static Motion::MotionCMD default_cmd() {
     /*** Publisher Setup ***/
 
     // Note: will convert received worldframe data to body frame in which bot position is relative to the bot origin
-    ITPS::NonBlockingPublisher<arma::vec> trans_disp_pub("GVision Server", "BotPos(BodyFrame)", zero_vec_2d());
-    ITPS::NonBlockingPublisher<arma::vec> trans_vel_pub("GVision Server", "BotVel(BodyFrame)", zero_vec_2d());
-    ITPS::NonBlockingPublisher<float> rot_disp_pub("GVision Server", "BotAng(BodyFrame)", 0.00);
-    ITPS::NonBlockingPublisher<float> rot_vel_pub("GVision Server", "BotAngVel(BodyFrame)", 0.00);
-    ITPS::NonBlockingPublisher<arma::vec> ball_loc_pub("GVision Server", "BallPos(BodyFrame)", zero_vec_2d());
-    ITPS::NonBlockingPublisher<arma::vec> ball_vel_pub("GVision Server", "BallVel(BodyFrame)", zero_vec_2d());
-    ITPS::NonBlockingPublisher< Motion::MotionCMD > m_cmd_pub("CMD Server", "MotionCMD", default_cmd());
-    ITPS::NonBlockingPublisher< bool > en_autocap_pub("CMD Server", "EnableAutoCap", false);
-    ITPS::NonBlockingPublisher<arma::vec> kicker_pub("Kicker", "KickingSetPoint", zero_vec_2d());
+    ITPS::NonBlockingPublisher<arma::vec> trans_disp_pub(CMDServer::BotPosTopic{}, zero_vec_2d());
+    ITPS::NonBlockingPublisher<arma::vec> trans_vel_pub(CMDServer::BotVelTopic{}, zero_vec_2d());
+    ITPS::NonBlockingPublisher<float> rot_disp_pub(CMDServer::BotAngTopic{}, 0.00);
+    ITPS::NonBlockingPublisher<float> rot_vel_pub(CMDServer::BotAngVelTopic{}, 0.00);
+    ITPS::NonBlockingPublisher<arma::vec> ball_loc_pub(CMDServer::BallPosTopic{}, zero_vec_2d());
+    ITPS::NonBlockingPublisher<arma::vec> ball_vel_pub(CMDServer::BallVelTopic{}, zero_vec_2d());
+    ITPS::NonBlockingPublisher< Motion::MotionCMD > m_cmd_pub(CMDServer::MotionCMDTopic{}, default_cmd());
+    ITPS::NonBlockingPublisher< bool > en_autocap_pub(CMDServer::EnableAutoCapTopic{}, false);
+    ITPS::NonBlockingPublisher<arma::vec> kicker_pub(CMDServer::KickerSetPointTopic{}, zero_vec_2d());
 
     /*** Subscriber setup ***/
-    ITPS::NonBlockingSubscriber<arma::vec> robot_origin_w_sub("ConnectionInit", "RobotOrigin(WorldFrame)");
-    ITPS::NonBlockingSubscriber<MotionEKF::MotionData> sensor_sub("MotionEKF", "MotionData");
-    ITPS::NonBlockingSubscriber< Motion::MotionCMD > capture_cmd_sub("Ball Capture Module", "MotionCMD");
-
-    try {
-        capture_cmd_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        robot_origin_w_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-        sensor_sub.subscribe(DEFAULT_SUBSCRIBER_TIMEOUT);
-    }
-    catch(std::exception& e) {
-        B_Log logger;
-        logger.add_tag("[UdpReceiveModule.cpp]");
-        logger.log(Error, std::string(e.what()));
-        std::exit(0);
-    }
+    ITPS::NonBlockingSubscriber<arma::vec> robot_origin_w_sub(ConnectionServer::RobotOriginTopic{});
+    ITPS::NonBlockingSubscriber<MotionEKF::MotionData> sensor_sub(MotionEKF::MotionDataTopic{});
+    ITPS::NonBlockingSubscriber< Motion::MotionCMD > capture_cmd_sub(BallCapture::MotionCMDTopic{});
 
-    logger.log(Info, "UDP Receiver Started on Port Number:" + repr(UDP_PORT)
+    capture_cmd_sub.subscribe();
+    robot_origin_w_sub.subscribe();
+    sensor_sub.subscribe();
+
+    logger.log(Info, "UDP Receiver Started on Port Number:" + repr(robot_udp_port(robot_id()))
                 + ", Listening to Remote AI Commands... ");
 
     UDPData udpData;
@@ -88,8 +103,16 @@ static Motion::MotionCMD default_cmd() {
     arma::vec trans_disp, trans_vel, ball_loc, ball_vel;
     float rot_disp, rot_vel;
 
-    while(1) { // has delay (good for reducing high CPU usage)
-        num_received = socket.receive_from(asio::buffer(receive_buffer), ep_listen);
+    while(!stop_requested()) { // No delay, blocking-socket-read is used, usually won't use too much CPU resources
+        boost::system::error_code ec;
+        num_received = socket.receive_from(asio::buffer(receive_buffer), ep_listen, 0, ec);
+        if(stop_requested()) break;
+        if(ec) {
+            logger.log(Error, "UDP receive failed: " + ec.message());
+            break;
+        }
+        ITPS::begin_trace(); // everything published from this packet on is traced back to its arrival
+        ITPS::timestamp_t capture_time = ITPS::now_ns() - (ITPS::timestamp_t)VISION_LATENCY_MS * 1000000;
         packet_received = std::string(receive_buffer.begin(), receive_buffer.begin() + num_received);
         // logger.log(Info, packet_received);
         udpData.ParseFromString(packet_received);
@@ -105,7 +128,11 @@ static Motion::MotionCMD default_cmd() {
 
         // reference frame transformation math
         arma::vec bot_origin = robot_origin_w_sub.latest_msg();
-        float bot_orien = sensor_sub.latest_msg().rotat_disp;
+        // the orientation when the frame was captured rather than the current one, falls back to
+        // the closest available state if the history doesn't reach back that far
+        MotionEKF::MotionData bot_state;
+        sensor_sub.msg_at_time(capture_time, bot_state);
+        float bot_orien = bot_state.rotat_disp;
         trans_disp = transform(bot_origin, bot_orien, trans_disp);
         trans_vel = transform(bot_origin, bot_orien, trans_vel);
         ball_loc = transform(bot_origin, bot_orien, ball_loc);
@@ -157,9 +184,6 @@ static Motion::MotionCMD default_cmd() {
             // kicker_pub.publish(kick_vec2d);
 
         }
-
-        delay(1);
-
     }
 }
 
@@ -0,0 +1,307 @@
+#include "Replay/ReplayEngine.hpp"
+
+#include <algorithm>
+#include <typeinfo>
+#include <boost/core/demangle.hpp>
+
+#include "Config/Config.hpp"
+#include "Misc/Utility/Common.hpp"
+#include "Misc/Utility/Systime.hpp"
+#include "PeriphModules/RemoteServers/TcpReceiveModule.hpp"
+#include "PeriphModules/RemoteServers/UdpReceiveModule.hpp"
+#include "PeriphModules/FirmClientModule/FirmClientModule.hpp"
+
+
+// the module steps a recorded input runs once published again
+enum class Trigger {None, FirmData, BallVel, MotionCMD, AutoCapture};
+
+// one input topic of the pipeline: its key in the recording & a publisher standing in for the peripheral module
+class ReplayInput {
+    public:
+        ReplayInput(const std::string& key, const std::string& msg_type, Trigger trigger)
+            : key(key), msg_type(msg_type), trigger(trigger) {}
+        virtual ~ReplayInput() {}
+
+        // decode a recorded msg and publish it, false if it can't be decoded
+        virtual bool publish(ITPS::RecordReader& r) = 0;
+
+        const std::string key;
+        const std::string msg_type;
+        const Trigger trigger;
+};
+
+namespace {
+    template <typename Msg>
+    bool is_present(const Msg&) {
+        return true;
+    }
+
+    // a firmware frame recorded without any VF_Data behind it
+    template <typename T>
+    bool is_present(const boost::shared_ptr<const T>& msg) {
+        return (bool) msg;
+    }
+
+    // same as the key MsgChannel records for the topic within robot_ns
+    template <typename Topic>
+    std::string recorded_key(const std::string& robot_ns) {
+        std::string prefix = (Topic::is_shared || robot_ns.empty()) ? "" : robot_ns + "/";
+        return prefix + Topic::topic_name + "." + Topic::msg_name + "." + Topic::mode();
+    }
+
+    template <typename Msg>
+    std::string msg_type_name() {
+        return boost::core::demangle(typeid(Msg).name());
+    }
+
+    template <typename Topic>
+    class NonBlockingInput : public ReplayInput {
+        public:
+            typedef typename Topic::Msg Msg;
+
+            NonBlockingInput(const std::string& robot_ns, Msg default_msg, Trigger trigger = Trigger::None)
+                : ReplayInput(recorded_key<Topic>(robot_ns), msg_type_name<Msg>(), trigger),
+                  pub(Topic{}, default_msg) {}
+
+            bool publish(ITPS::RecordReader& r) override {
+                Msg msg;
+                r.get(msg);
+                if(!r.ok() || !is_present(msg)) return false;
+                pub.publish(msg);
+                return true;
+            }
+
+        private:
+            ITPS::NonBlockingPublisher<Msg> pub;
+    };
+
+    template <typename Topic>
+    class BlockingInput : public ReplayInput {
+        public:
+            typedef typename Topic::Msg Msg;
+
+            BlockingInput(const std::string& robot_ns, Trigger trigger = Trigger::None)
+                : ReplayInput(recorded_key<Topic>(robot_ns), msg_type_name<Msg>(), trigger),
+                  pub(Topic{}) {}
+
+            bool publish(ITPS::RecordReader& r) override {
+                Msg msg;
+                r.get(msg);
+                if(!r.ok() || !is_present(msg)) return false;
+                pub.publish(msg);
+                return true;
+            }
+
+        private:
+            ITPS::BlockingPublisher<Msg> pub;
+    };
+
+    // same defaults as the peripheral modules publish before their first input
+    Motion::MotionCMD default_cmd() {
+        Motion::MotionCMD dft_cmd;
+        dft_cmd.setpoint_3d = {0, 0, 0};
+        dft_cmd.mode = Motion::CTRL_Mode::TVRV;
+        dft_cmd.ref_frame = Motion::ReferenceFrame::BodyFrame;
+        return dft_cmd;
+    }
+
+    PID_System::PID_Constants default_pid_consts() {
+        PID_System::PID_Constants pid_consts;
+        pid_consts.RD_Kp = PID_RD_KP;   pid_consts.RD_Ki = PID_RD_KI;   pid_consts.RD_Kd = PID_RD_KD;
+        pid_consts.TD_Kp = PID_TD_KP;   pid_consts.TD_Ki = PID_TD_KI;   pid_consts.TD_Kd = PID_TD_KD;
+        return pid_consts;
+    }
+
+    const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+    const uint64_t FNV_PRIME = 1099511628211ULL;
+
+    uint64_t fnv1a(uint64_t hash, const void* data, std::size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for(std::size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * FNV_PRIME;
+        }
+        return hash;
+    }
+}
+
+
+ReplayEngine::ReplayEngine(const std::string& record_path, const std::string& robot_ns)
+    : file(record_path), robot_ns(robot_ns), motion_started(false), next_motion_tick(0), next_control_tick(0), sim_time_us(0),
+      inputs_replayed(0), inputs_skipped(0), outputs(0), output_digest(FNV_OFFSET)
+{
+    // the publishers of the peripheral modules
+    input_topics.emplace_back(new BlockingInput<FirmClientModule::SensorDataTopic>(robot_ns, Trigger::FirmData));
+    input_topics.emplace_back(new NonBlockingInput<CMDServer::BallPosTopic>(robot_ns, zero_vec_2d()));
+    input_topics.emplace_back(new NonBlockingInput<CMDServer::BallVelTopic>(robot_ns, zero_vec_2d(), Trigger::BallVel));
+    input_topics.emplace_back(new NonBlockingInput<CMDServer::MotionCMDTopic>(robot_ns, default_cmd(), Trigger::MotionCMD));
+    input_topics.emplace_back(new NonBlockingInput<CMDServer::EnableAutoCapTopic>(robot_ns, false, Trigger::AutoCapture));
+    input_topics.emplace_back(new NonBlockingInput<CMDServer::KickerSetPointTopic>(robot_ns, zero_vec_2d()));
+    input_topics.emplace_back(new NonBlockingInput<ConnectionServer::SafetyEnableTopic>(robot_ns, true));
+    input_topics.emplace_back(new NonBlockingInput<ConnectionServer::RobotOriginTopic>(robot_ns, zero_vec_2d()));
+    input_topics.emplace_back(new NonBlockingInput<PID_System::PID_ConstantsTopic>(robot_ns, default_pid_consts()));
+
+    motion_ekf.reset(new VirtualMotionEKF());
+    ball_ekf.reset(new VirtualBallEKF());
+    motion.reset(new MotionModule());
+    control.reset(new PID_System());
+    ball_capture.reset(new BallCaptureModule());
+
+    // every publisher exists by now, none of these waits
+    std::vector<Module*> modules = {motion_ekf.get(), ball_ekf.get(), motion.get(), control.get(), ball_capture.get()};
+    for(Module* module: modules) {
+        module->init_subscribers();
+    }
+
+    command_sub.reset(new ITPS::NonBlockingSubscriber<Motion::MotionCMD>(CMDServer::MotionCMDTopic{}));
+    command_sub->subscribe();
+    output_sub.reset(new ITPS::BlockingSubscriber<VF_Commands>(FirmClientModule::CommandsTopic{}, FIRM_CMD_MQ_SIZE));
+    output_sub->subscribe();
+
+    load();
+}
+
+// the channels outlive the engine: detach the modules' queues & the output queue from them, consumers first
+ReplayEngine::~ReplayEngine() {
+    std::vector<Module*> modules = {ball_capture.get(), control.get(), motion.get(), ball_ekf.get(), motion_ekf.get()};
+    for(Module* module: modules) {
+        module->request_stop();
+    }
+    output_sub.reset();
+    if(&current_clock() == &sim_clock) set_clock(nullptr);
+}
+
+// pick the msgs of the input topics out of the recording, in the order of their stamps
+void ReplayEngine::load() {
+    uint64_t start_stamp = file.header().start_stamp;
+    ITPS::RecordFile::Record rec;
+    std::vector<ReplayInput*> by_id; // topic id => input, nullptr for the other topics
+    while(file.next(rec)) {
+        uint16_t id = rec.header.topic;
+        if(rec.header.kind == ITPS::RECORD_TOPIC) {
+            if(by_id.size() <= id) by_id.resize(id + 1, nullptr);
+            by_id[id] = nullptr;
+            for(auto& input: input_topics) {
+                if(input->key != file.topic_key(id)) continue;
+                if(input->msg_type == file.topic_type(id)) by_id[id] = input.get();
+                else inputs_skipped++; // recorded by a build with another msg type, can't be decoded
+            }
+        }
+        else if(rec.header.kind == ITPS::RECORD_MSG && id < by_id.size() && by_id[id] != nullptr) {
+            uint64_t time_us = rec.header.stamp > start_stamp ? (rec.header.stamp - start_stamp) / 1000 : 0;
+            pending.push_back(PendingInput{time_us, by_id[id], rec});
+        }
+    }
+
+    // the publishers' threads commit their records in a slightly different order than their stamps
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingInput& a, const PendingInput& b) {
+        return a.time_us < b.time_us;
+    });
+}
+
+void ReplayEngine::run(output_callback_t on_output) {
+    this->on_output = on_output;
+    set_clock(&sim_clock);
+
+    // Motion & PID_System start their loops once ready (check start_ready_loops()), BallCapture evaluates its initial state right away
+    next_motion_tick = next_control_tick = UINT64_MAX;
+    motion_started = control_started = false;
+    ball_capture->step();
+
+    for(PendingInput& p: pending) {
+        advance_to(p.time_us);
+        ITPS::RecordReader r = p.record.reader();
+        if(!p.input->publish(r)) {
+            inputs_skipped++;
+            continue;
+        }
+        inputs_replayed++;
+        trigger(*p.input);
+        start_ready_loops();
+    }
+    collect_outputs();
+    set_clock(nullptr);
+}
+
+// run the periodic work due up to time_us, on simulated time
+void ReplayEngine::advance_to(uint64_t time_us) {
+    const uint64_t control_period_us = 1000000 / CTRL_FREQUENCY;
+    for(;;) {
+        /* World frame setpoints depend on the robot's orientation, Motion re-transforms them every 1 ms,
+         * body frame setpoints only change with a new command (check MotionModule::task) */
+        bool world_frame = command_sub->latest_msg().ref_frame == Motion::WorldFrame;
+        uint64_t motion_tick = world_frame ? next_motion_tick : UINT64_MAX;
+
+        uint64_t next_tick = std::min(motion_tick, next_control_tick);
+        if(next_tick > time_us) break;
+        sim_clock.set_ns(next_tick * 1000);
+        sim_time_us = next_tick;
+
+        // setpoints before the controller reading them when both are due
+        if(motion_tick == next_tick) {
+            motion->step();
+            next_motion_tick = next_tick + 1000;
+        }
+        if(next_control_tick == next_tick) {
+            run_control_tick();
+            next_control_tick += control_period_us;
+        }
+    }
+    sim_clock.set_ns(time_us * 1000);
+    sim_time_us = std::max(sim_time_us, time_us);
+}
+
+/* live, Motion & PID_System start right after their first inputs are published (check Module::wait_ready()):
+ * the first tick runs at the time of the input completing them
+ */
+void ReplayEngine::start_ready_loops() {
+    if(!motion_started && motion->inputs_ready()) {
+        motion_started = true;
+        motion->step();
+        next_motion_tick = sim_time_us + 1000;
+    }
+    if(!control_started && control->inputs_ready()) { // the setpoints come from Motion's first step
+        control_started = true;
+        run_control_tick();
+        next_control_tick = sim_time_us + 1000000 / CTRL_FREQUENCY;
+    }
+}
+
+void ReplayEngine::run_control_tick() {
+    control->step(); // publishes the halt command while disabled
+    collect_outputs();
+}
+
+void ReplayEngine::trigger(ReplayInput& input) {
+    switch(input.trigger) {
+        case Trigger::FirmData:
+            motion_ekf->step();   // pops the frame just published
+            ball_capture->step(); // reacts to the new motion data
+            break;
+        case Trigger::BallVel:
+            ball_ekf->step();
+            break;
+        case Trigger::MotionCMD:
+            if(motion_started) { // otherwise its loop picks the command up once it starts
+                motion->step();
+                next_motion_tick = sim_time_us + 1000;
+            }
+            break;
+        case Trigger::AutoCapture:
+            ball_capture->step();
+            break;
+        case Trigger::None:
+            break;
+    }
+}
+
+void ReplayEngine::collect_outputs() {
+    VF_Commands cmd;
+    uint64_t time_us = sim_clock.now_ns() / 1000;
+    while(output_sub->try_pop_msg(cmd)) {
+        std::string bytes = cmd.SerializeAsString();
+        output_digest = fnv1a(output_digest, &time_us, sizeof(time_us));
+        output_digest = fnv1a(output_digest, bytes.data(), bytes.size());
+        outputs++;
+        if(on_output) on_output(time_us, cmd);
+    }
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unistd.h>
+#include <boost/chrono.hpp>
+
+#include "Misc/Utility/BoostLogger.hpp"
+#include "Misc/Utility/Common.hpp"
+#include "Config/Config.hpp"
+#include "Replay/ReplayEngine.hpp"
+
+/* Re-runs the core modules of one robot on a recording made with "TritonBot.exe -r <record_file>",
+ * on simulated time and as fast as the CPU allows, check ReplayEngine.hpp
+ */
+
+static void help_print(B_Log& logger) {
+    std::stringstream ss;
+    ss << "\nCommand: \n"
+       << "\t./Replay.exe (-i <robot_id>) (-o <output_file>) <record_file> \n\n"
+       << "\t\t-i <robot_id>: Replay the robot_id-th robot of a recording made with -n <num_robots>\n"
+       << "\t\t-o <output_file>: Write every command sent to the firmware as a line of: time_us trans_x trans_y rotat kick_x kick_y dribbler\n"
+       << "\t\t<record_file>: the file recorded with TritonBot.exe -r <record_file>\n"
+       << "The digest printed at the end only changes when the commands do, to compare builds/tunings on the same inputs\n";
+    logger.log(Info, ss.str());
+}
+
+int main(int argc, char *argv[]) {
+    B_Log::static_init();
+    B_Log::set_shorter_format();
+    B_Log::sink->set_filter(severity >= Info);
+    B_Log logger;
+    logger.add_tag("Replay");
+
+    std::string robot_ns = "";
+    std::string output_path = "";
+    int option;
+    while( (option = getopt(argc, argv, ":i:o:")) != -1 ) {
+        switch(option) {
+            case 'i':
+                robot_ns = "robot" + std::string(optarg);
+                break;
+            case 'o':
+                output_path = std::string(optarg);
+                break;
+            default:
+                help_print(logger);
+                return 1;
+        }
+    }
+    if(optind + 1 != argc) {
+        help_print(logger);
+        return 1;
+    }
+    std::string record_path = argv[optind];
+
+    std::ofstream output;
+    if(!output_path.empty()) {
+        output.open(output_path);
+        if(!output) {
+            logger.log(Error, "Can't write " + output_path);
+            return 1;
+        }
+        output << std::setprecision(9);
+    }
+
+    try {
+        ReplayEngine replay(record_path, robot_ns);
+
+        auto start = boost::chrono::steady_clock::now();
+        replay.run([&output](uint64_t time_us, const VF_Commands& cmd) {
+            if(!output.is_open()) return;
+            output << time_us << " " << cmd.translational_output().x() << " " << cmd.translational_output().y()
+                   << " " << cmd.rotational_output() << " " << cmd.kicker().x() << " " << cmd.kicker().y()
+                   << " " << cmd.dribbler() << "\n";
+        });
+        double wall_s = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+        double sim_s = replay.duration_us() / 1e6;
+
+        std::stringstream digest;
+        digest << std::hex << std::setw(16) << std::setfill('0') << replay.digest();
+        logger.log(Info, "Replayed " + repr(replay.num_inputs()) + " inputs (" + repr(replay.num_skipped()) + " skipped) over "
+                         + repr(sim_s) + " s of simulated time in " + repr(wall_s) + " s ("
+                         + repr(wall_s > 0 ? sim_s / wall_s : 0.0) + "x real time)");
+        logger.log(Info, "Commands: " + repr(replay.num_outputs()) + ", digest: " + digest.str());
+    }
+    catch(std::exception& e) {
+        logger.log(Error, e.what());
+        return 1;
+    }
+    return 0;
+}
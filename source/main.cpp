@@ -1,7 +1,14 @@
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <csignal>
+#include <ctime>
 #include <armadillo>
+#include <boost/core/demangle.hpp>
 
 #include "Misc/PubSubSystem/ThreadPool.hpp"
+#include "Misc/PubSubSystem/Executor.hpp"
+#include "Misc/PubSubSystem/ModuleGraph.hpp"
 #include "Misc/Utility/BoostLogger.hpp"
 #include "Misc/Utility/Systime.hpp"
 #include "Misc/Utility/Common.hpp"
@@ -21,6 +28,41 @@
 
 std::ostream& operator<<(std::ostream& os, const arma::vec& v);
 
+// the pipeline of one robot, bound to the current RobotScope (if any), the vfirm I/O on ctrl_cpus
+static void construct_modules(std::vector< boost::shared_ptr<Module> >& modules, const std::vector<int>& ctrl_cpus) {
+    std::string robot = repr(RobotScope::current_robot());
+    
+    modules.push_back(boost::shared_ptr<FirmClientModule>(new VFirmClient()));
+    modules.back()->set_sched(ThreadSched("vfirm" + robot, SCHED_FIFO, FIRM_IO_RT_PRIORITY, ctrl_cpus));
+    modules.push_back(boost::shared_ptr<MotionEKF_Module>(new VirtualMotionEKF()));
+    modules.push_back(boost::shared_ptr<BallEKF_Module>(new VirtualBallEKF()));
+    modules.push_back(boost::shared_ptr<MotionModule>(new MotionModule()));
+    modules.push_back(boost::shared_ptr<ControlModule>(new PID_System()));
+    modules.push_back(boost::shared_ptr<UdpReceiveModule>(new CMDServer()));
+    modules.back()->set_sched(ThreadSched("udp-cmd" + robot));
+    modules.push_back(boost::shared_ptr<TcpReceiveModule>(new ConnectionServer()));
+    modules.back()->set_sched(ThreadSched("tcp-conn" + robot));
+    modules.push_back(boost::shared_ptr<BallCaptureModule>(new BallCaptureModule()));
+}
+
+/* request_stop() all of them, consumers first (the reverse of startup_order), then join them,
+ * return false if some module is still running after MODULE_STOP_TIMEOUT_MS
+ */
+static bool stop_modules(const std::vector< boost::shared_ptr<Module> >& startup_order, B_Log& logger) {
+    for(auto it = startup_order.rbegin(); it != startup_order.rend(); it++) {
+        (*it)->request_stop();
+    }
+    bool all_stopped = true;
+    for(auto& module: startup_order) {
+        if(!module->wait_stopped(MODULE_STOP_TIMEOUT_MS)) {
+            all_stopped = false;
+            logger.log(Error, boost::core::demangle(typeid(*module).name()) + " of robot " + repr(module->robot_id())
+                              + " didn't stop within " + repr(MODULE_STOP_TIMEOUT_MS) + " ms");
+        }
+    }
+    return all_stopped;
+}
+
 int main(int argc, char *argv[]) {
     // Logger Initialization
     B_Log::static_init();
@@ -36,43 +78,132 @@ int main(int argc, char *argv[]) {
     bool is_virtual = process_args(argc, argv);
 
 
-    // Preallocate Threads 
-    ThreadPool thread_pool(THREAD_POOL_SIZE); // pre-allocate # threads in a pool
+    ITPS::set_tracing(ITPS_TRACING);
+
+    // Record the ITPS traffic from the very first publish
+    if(!ITPS_RECORD_PATH.empty()) {
+        try {
+            ITPS::Recorder::instance().start(ITPS_RECORD_PATH, (uint64_t) ITPS_RECORD_FILE_MB << 20);
+            logger.log(Info, "Recording the ITPS traffic into " + ITPS_RECORD_PATH);
+        }
+        catch(std::exception& e) {
+            logger.log(Error, e.what());
+        }
+    }
+
+    /* Isolate the control path from the lower-priority work (servers, logging, other processes): a ctrl CPU per
+     * executor worker, so that its workers run in parallel, check CTRL_CPU */
+    std::vector<int> ctrl_cpus, other_cpus;
+    int num_cpus = boost::thread::hardware_concurrency();
+    int num_ctrl_cpus = EXECUTOR_THREADS;
+    if(num_cpus > num_ctrl_cpus) {
+        int first_ctrl_cpu = (CTRL_CPU >= 0) ? std::min(CTRL_CPU, num_cpus - num_ctrl_cpus) : num_cpus - num_ctrl_cpus;
+        for(int cpu = 0; cpu < num_cpus; cpu++) {
+            if(cpu >= first_ctrl_cpu && cpu < first_ctrl_cpu + num_ctrl_cpus) ctrl_cpus.push_back(cpu);
+            else other_cpus.push_back(cpu);
+        }
+    }
+    else if(num_cpus > 1) {
+        logger.log(Warning, "Not enough CPUs for " + repr(EXECUTOR_THREADS)
+                            + " executor threads and the rest, the control path isn't pinned");
+    }
 
-    // Construct module instances
-    boost::shared_ptr<FirmClientModule> firm_client_module(new VFirmClient());
-    boost::shared_ptr<MotionEKF_Module> motion_ekf_module(new VirtualMotionEKF());
-    boost::shared_ptr<BallEKF_Module> ball_ekf_module(new VirtualBallEKF());
-    boost::shared_ptr<MotionModule> motion_module(new MotionModule());
-    boost::shared_ptr<ControlModule> control_module(new PID_System());
-    boost::shared_ptr<UdpReceiveModule> udp_receive_module(new CMDServer());
-    boost::shared_ptr<TcpReceiveModule> tcp_receive_module(new ConnectionServer());
-    boost::shared_ptr<BallCaptureModule> ball_capture_module(new BallCaptureModule());
+    /* SIGINT/SIGTERM: stop, SIGHUP: restart the modules. Blocked here so that every thread created from now on
+     * inherits the mask, the loop at the bottom takes them with sigtimedwait() */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // Preallocate Threads, shared by all the robots
+    ThreadPool thread_pool(std::max(THREAD_POOL_SIZE, NUM_ROBOTS * THREADS_PER_ROBOT), // pre-allocate # threads in a pool
+                           ThreadSched("pool", SCHED_OTHER, 0, other_cpus));
+
+    // The core modules run as steps on a few threads, by rate-monotonic priority
+    Executor executor(EXECUTOR_THREADS, ThreadSched("exec", SCHED_FIFO, CTRL_RT_PRIORITY, ctrl_cpus));
+
+    // Construct module instances, a single robot keeps the global ITPS namespace
+    std::vector< boost::shared_ptr<Module> > modules;
+    for(unsigned int robot_id = 0; robot_id < NUM_ROBOTS; robot_id++) {
+        if(NUM_ROBOTS == 1) {
+            construct_modules(modules, ctrl_cpus);
+        }
+        else {
+            RobotScope robot_scope(robot_id); // topics of this robot live in "robot<id>/..."
+            construct_modules(modules, ctrl_cpus);
+        }
+    }
     
-    // Configs
+    // Configs, shared by all the robots
     PID_System::PID_Constants pid_consts;
     pid_consts.RD_Kp = PID_RD_KP;   pid_consts.RD_Ki = PID_RD_KI;   pid_consts.RD_Kd = PID_RD_KD;
     pid_consts.TD_Kp = PID_TD_KP;   pid_consts.TD_Ki = PID_TD_KI;   pid_consts.TD_Kd = PID_TD_KD;
-    ITPS::NonBlockingPublisher<PID_System::PID_Constants> pid_const_pub("PID", "Constants", pid_consts);
-
-    // Run the servers
-    firm_client_module->run(thread_pool);
-    motion_ekf_module->run(thread_pool);    
-    ball_ekf_module->run(thread_pool);
-    motion_module->run(thread_pool);
-    control_module->run(thread_pool);
-    udp_receive_module->run(thread_pool);
-    tcp_receive_module->run(thread_pool);
-    // intern_ekf_server_module->run(thread_pool);
-    ball_capture_module->run(thread_pool);
+    ITPS::NonBlockingPublisher<PID_System::PID_Constants> pid_const_pub(PID_System::PID_ConstantsTopic{}, pid_consts);
+
+    // Start the modules producers first (check ModuleGraph), the ones doing blocking I/O keep a pool thread.
+    // Each one waits for its publishers and its first inputs, then runs right away
+    std::vector< boost::shared_ptr<Module> > startup_order;
+    try {
+        startup_order = ModuleGraph(modules, {ITPS::topic_key<PID_System::PID_ConstantsTopic>()}).order();
+    }
+    catch(std::exception& e) {
+        logger.log(Error, e.what());
+        return 1;
+    }
+    for(auto& module: startup_order) {
+        module->run(thread_pool, executor);
+    }
     
 
-    while(1) { // has delay (good for reducing high CPU usage)
-        // this program should run forever 
-        delay(1000);
+    unsigned int ms_since_stats_log = 0;
+    bool sched_checked = false;
+    while(1) { // runs until SIGINT/SIGTERM, wakes up every second for the periodic logs
+        timespec timeout = {1, 0};
+        int sig = sigtimedwait(&signals, nullptr, &timeout);
+        if(sig == SIGINT || sig == SIGTERM) {
+            logger.log(Info, "Stopping the modules");
+            break;
+        }
+        if(sig == SIGHUP) { // same pool & executor threads, same ITPS channels
+            logger.log(Info, "Restarting the modules");
+            if(!stop_modules(startup_order, logger)) {
+                logger.log(Error, "Restart cancelled, some modules are still running");
+                continue;
+            }
+            for(auto& module: startup_order) {
+                module->run(thread_pool, executor);
+            }
+            continue;
+        }
+
+        if(!sched_checked) { // the modules' threads are running by then
+            sched_checked = true;
+            std::string sched_failures = dump_sched_failures();
+            if(!sched_failures.empty()) {
+                logger.log(Warning, "Thread scheduling fell back to defaults:\n" + sched_failures);
+            }
+        }
+
+        ms_since_stats_log += 1000;
+        if(ITPS_STATS_LOG_PERIOD_MS > 0 && ms_since_stats_log >= ITPS_STATS_LOG_PERIOD_MS) {
+            ms_since_stats_log = 0;
+            logger.log(Info, "ITPS channel stats:\n" + ITPS::dump_channel_stats());
+            logger.log(Info, "Module loop stats:\n" + dump_loop_stats());
+            logger.log(Info, "Thread pool stats: " + thread_pool.dump_stats());
+            if(ITPS_TRACING) logger.log(Info, "ITPS trace latency breakdown:\n" + ITPS::dump_trace_stats());
+            if(ITPS::recording()) logger.log(Info, "ITPS recorder: " + ITPS::dump_recorder_stats());
+        }
     }
 
-    return 0;
+    if(!stop_modules(startup_order, logger)) {
+        // the pool & executor can't join threads stuck in a module, don't hang in their destructors
+        std::_Exit(1);
+    }
+    ITPS::Recorder::instance().stop();
+    logger.log(Info, "Stopped");
+    return 0; // the executor & the pool join their idle threads
 }
 
 std::ostream& operator<<(std::ostream& os, const arma::vec& v)
@@ -0,0 +1,92 @@
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/Utility/Clock.hpp"
+#include "Misc/Utility/Systime.hpp"
+
+// waits (real time) until the clock has n sleepers
+static void wait_sleeping(SimulatedClock& clock, unsigned int n) {
+    while(clock.num_sleeping() < n) boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+}
+
+TEST(SimulatedClock, TimeOnlyMovesForward) {
+    SimulatedClock clock(1000);
+    EXPECT_EQ(clock.now_ns(), 1000u);
+    clock.advance_ns(500);
+    EXPECT_EQ(clock.now_ns(), 1500u);
+    clock.set_ns(1200); // ignored
+    EXPECT_EQ(clock.now_ns(), 1500u);
+}
+
+TEST(SimulatedClock, SleepersBlockUntilTheDriverAdvances) {
+    SimulatedClock clock;
+    boost::atomic<bool> woke{false};
+    boost::thread sleeper([&]() {
+        clock.sleep_for_ns(1000);
+        woke = true;
+    });
+    wait_sleeping(clock, 1);
+    EXPECT_EQ(clock.next_deadline_ns(), 1000u);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    EXPECT_FALSE(woke); // real time passing doesn't matter
+    clock.advance_ns(999);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    EXPECT_FALSE(woke);
+    clock.advance_ns(1);
+    sleeper.join();
+    EXPECT_TRUE(woke);
+    EXPECT_EQ(clock.num_sleeping(), 0u);
+    EXPECT_EQ(clock.next_deadline_ns(), UINT64_MAX);
+}
+
+TEST(SimulatedClock, WakesTheSleepersInDeadlineOrder) {
+    SimulatedClock clock;
+    boost::atomic<int> num_woke{0};
+    boost::thread early([&]() { clock.sleep_until_ns(100); num_woke++; });
+    boost::thread late([&]() { clock.sleep_until_ns(300); num_woke++; });
+    wait_sleeping(clock, 2);
+    EXPECT_EQ(clock.next_deadline_ns(), 100u);
+    clock.set_ns(200);
+    early.join();
+    EXPECT_EQ(num_woke, 1);
+    EXPECT_EQ(clock.next_deadline_ns(), 300u);
+    clock.set_ns(300);
+    late.join();
+    EXPECT_EQ(num_woke, 2);
+}
+
+TEST(SimulatedClock, TimedWaitsExpireOnSimulatedTime) {
+    SimulatedClock clock;
+    boost::mutex mutex;
+    boost::condition_variable_any cond;
+    boost::atomic<bool> expired{false};
+    boost::thread waiter([&]() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while(clock.wait_until(cond, lock, 5000)) {} // nobody notifies, only the deadline ends it
+        expired = true;
+    });
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    EXPECT_FALSE(expired);
+    clock.set_ns(5000);
+    waiter.join();
+    EXPECT_TRUE(expired);
+}
+
+TEST(SimulatedClock, DrivesSystimeOnceSet) {
+    SimulatedClock clock(42000000);
+    set_clock(&clock);
+    EXPECT_EQ(&current_clock(), &clock);
+    EXPECT_EQ(millis(), 42u);
+    boost::atomic<bool> woke{false};
+    boost::thread sleeper([&]() {
+        delay(10);
+        woke = true;
+    });
+    wait_sleeping(clock, 1);
+    clock.advance_ns(10000000);
+    sleeper.join();
+    EXPECT_TRUE(woke);
+    set_clock(nullptr);
+    EXPECT_NE(&current_clock(), &clock);
+}
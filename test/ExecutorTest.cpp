@@ -0,0 +1,139 @@
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/Executor.hpp"
+#include "Misc/Utility/Clock.hpp"
+
+static void sleep_ms(unsigned int ms) {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
+}
+
+static const uint64_t MS = 1000000ULL;
+
+// the executor releases its periodic steps on a simulated clock, moved by the test only
+class ExecutorTest : public ::testing::Test {
+    protected:
+        ExecutorTest() : clock(1000 * MS) {
+            set_clock(&clock);
+        }
+
+        ~ExecutorTest() {
+            set_clock(nullptr);
+        }
+
+        SimulatedClock clock;
+};
+
+TEST_F(ExecutorTest, HigherRateRunsFirst) {
+    Executor executor(1);
+    Executor::Task& busy = executor.add_event("busy", 1);
+    Executor::Task& slow = executor.add_event("slow", 10);
+    Executor::Task& fast = executor.add_event("fast", 100);
+    boost::mutex gate;
+    boost::atomic<bool> holding{false};
+    boost::atomic<int> done{0};
+    std::vector<std::string> order;
+
+    // hold the only worker while both become ready
+    gate.lock();
+    busy.execute([&]() {
+        holding = true;
+        boost::lock_guard<boost::mutex> lock(gate);
+        done++;
+    });
+    while(!holding) sleep_ms(1);
+    slow.execute([&]() { order.push_back("slow"); done++; });
+    fast.execute([&]() { order.push_back("fast"); done++; });
+    gate.unlock();
+
+    while(done < 3) sleep_ms(1);
+    ASSERT_EQ(order.size(), 2u);
+    EXPECT_EQ(order[0], "fast");
+    EXPECT_EQ(order[1], "slow");
+}
+
+TEST_F(ExecutorTest, OverrunSkipsPeriodsAndKeepsThePhase) {
+    Executor executor(1);
+    const uint64_t start = clock.now_ns();
+    uint64_t run_at[3];
+    boost::atomic<int> num_runs{0};
+    executor.add_periodic("ExecutorTest.Overrun", 100, [&]() { // 10 ms period
+        int n = num_runs;
+        if(n < 3) run_at[n] = clock.now_ns();
+        if(n == 0) clock.advance_ns(25 * MS); // the first step takes 2.5 periods
+        num_runs++;
+    });
+
+    // released at +20 ms, the last release before the step returned, +10 ms is skipped
+    while(num_runs < 2) sleep_ms(1);
+    LoopStats& stats = LoopStatsRegistry::instance().loop("ExecutorTest.Overrun", 10 * MS);
+    EXPECT_EQ(run_at[0], start);
+    EXPECT_EQ(run_at[1], start + 25 * MS);
+    EXPECT_EQ(stats.num_overruns.load(), 1u);
+    EXPECT_EQ(stats.num_skipped_periods.load(), 1u);
+
+    // the next release stays on the start + k * period grid
+    clock.set_ns(start + 29 * MS);
+    sleep_ms(20);
+    EXPECT_EQ(num_runs, 2);
+    clock.set_ns(start + 30 * MS);
+    while(num_runs < 3) sleep_ms(1);
+    EXPECT_EQ(run_at[2], start + 30 * MS);
+    EXPECT_EQ(stats.num_overruns.load(), 1u);
+    EXPECT_EQ(stats.num_cycles.load(), 3u);
+}
+
+TEST_F(ExecutorTest, StepsOfATaskNeverOverlap) {
+    Executor executor(3);
+    Executor::Task& task = executor.add_event("task", 100);
+    boost::atomic<int> inside{0}, done{0};
+    boost::atomic<bool> overlap{false};
+    std::vector<int> order;
+    for(int i = 0; i < 1000; i++) {
+        task.execute([&, i]() {
+            if(inside.fetch_add(1) != 0) overlap = true;
+            order.push_back(i);
+            inside.fetch_sub(1);
+            done++;
+        });
+    }
+    while(done < 1000) sleep_ms(1);
+    EXPECT_FALSE(overlap);
+    ASSERT_EQ(order.size(), 1000u);
+    for(int i = 0; i < 1000; i++) ASSERT_EQ(order[i], i);
+}
+
+TEST_F(ExecutorTest, CancelWaitsForTheStepAndDropsThePostedOnes) {
+    Executor executor(2);
+    Executor::Task& task = executor.add_event("task", 100);
+    boost::atomic<bool> started{false}, finished{false};
+    boost::atomic<int> later_runs{0};
+    task.execute([&]() {
+        started = true;
+        sleep_ms(40);
+        finished = true;
+    });
+    task.execute([&]() { later_runs++; });
+    while(!started) sleep_ms(1);
+    task.cancel();
+    EXPECT_TRUE(finished);
+    task.execute([&]() { later_runs++; }); // ignored
+    sleep_ms(20);
+    EXPECT_EQ(later_runs, 0);
+}
+
+TEST_F(ExecutorTest, CancelFromItsOwnStep) {
+    Executor executor(1);
+    Executor::Task& task = executor.add_event("task", 100);
+    boost::atomic<int> runs{0};
+    task.execute([&]() {
+        task.cancel(); // would wait for itself
+        runs++;
+    });
+    task.execute([&]() { runs++; });
+    while(executor.num_steps() < 1) sleep_ms(1);
+    sleep_ms(20);
+    EXPECT_EQ(runs, 1);
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/HistoryBuffer.hpp"
+
+using ITPS::HistoryBuffer;
+
+TEST(HistoryBuffer, EmptyHasNothingAtAnyTime) {
+    HistoryBuffer<double> history(4);
+    double out = -1;
+    EXPECT_TRUE(history.empty());
+    EXPECT_FALSE(history.at_time(100, out));
+    EXPECT_EQ(out, -1);
+}
+
+TEST(HistoryBuffer, InterpolatesLinearlyBetweenTheMsgsAroundT) {
+    HistoryBuffer<double> history(4);
+    history.append(100, 1.0);
+    history.append(200, 3.0);
+    double out;
+    ASSERT_TRUE(history.at_time(150, out));
+    EXPECT_DOUBLE_EQ(out, 2.0);
+    ASSERT_TRUE(history.at_time(125, out));
+    EXPECT_DOUBLE_EQ(out, 1.5);
+    ASSERT_TRUE(history.at_time(200, out));
+    EXPECT_DOUBLE_EQ(out, 3.0);
+}
+
+TEST(HistoryBuffer, NoExtrapolation) {
+    HistoryBuffer<double> history(4);
+    history.append(100, 1.0);
+    history.append(200, 3.0);
+    double out;
+    ASSERT_TRUE(history.at_time(1000, out)); // newer than the newest: the newest
+    EXPECT_DOUBLE_EQ(out, 3.0);
+    EXPECT_FALSE(history.at_time(50, out));  // older than the whole ring: the oldest
+    EXPECT_DOUBLE_EQ(out, 1.0);
+}
+
+// the default Interpolator picks the nearer msg for non arithmetic types
+struct Label {
+    int id;
+};
+
+TEST(HistoryBuffer, NonArithmeticMsgsTakeTheNearerOne) {
+    HistoryBuffer<Label> history(4);
+    history.append(100, Label{1});
+    history.append(200, Label{2});
+    Label out;
+    ASSERT_TRUE(history.at_time(140, out));
+    EXPECT_EQ(out.id, 1);
+    ASSERT_TRUE(history.at_time(160, out));
+    EXPECT_EQ(out.id, 2);
+}
+
+TEST(HistoryBuffer, OlderStampsAreClamped) {
+    HistoryBuffer<int> history(4);
+    history.append(200, 1);
+    history.append(100, 2); // clamped to 200
+    std::vector<HistoryBuffer<int>::Stamped> all = history.range(0, 1000);
+    ASSERT_EQ(all.size(), 2u);
+    EXPECT_EQ(all[1].stamp, 200u);
+}
+
+TEST(HistoryBuffer, KeepsTheLastCapacityMsgs) {
+    HistoryBuffer<int> history(3);
+    for(int i = 1; i <= 10; i++) history.append(i * 10, i);
+    std::vector<HistoryBuffer<int>::Stamped> all = history.range(0, 1000);
+    ASSERT_EQ(all.size(), 3u);
+    EXPECT_EQ(all[0].data, 8);
+    EXPECT_EQ(all[2].data, 10);
+
+    std::vector<HistoryBuffer<int>::Stamped> some = history.range(85, 95);
+    ASSERT_EQ(some.size(), 1u);
+    EXPECT_EQ(some[0].data, 9);
+
+    int out;
+    EXPECT_FALSE(history.at_time(20, out)); // overwritten long ago
+    EXPECT_EQ(out, 8);
+}
@@ -0,0 +1,67 @@
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/LatestValueBuffer.hpp"
+
+// a msg whose copy a torn read would show: every element equals the first
+typedef std::vector<uint64_t> Msg;
+
+static bool consistent(const Msg& msg) {
+    for(uint64_t x: msg) {
+        if(x != msg[0]) return false;
+    }
+    return true;
+}
+
+TEST(LatestValueBuffer, ReadsTheLatestWrite) {
+    LatestValueBuffer<int> buffer;
+    buffer.write(1);
+    EXPECT_EQ(buffer.read(), 1);
+    buffer.write(2);
+    buffer.write(3);
+    EXPECT_EQ(buffer.read(), 3);
+    EXPECT_EQ(buffer.read(), 3);
+}
+
+TEST(LatestValueBuffer, VersionsCountTheWrites) {
+    LatestValueBuffer<int> buffer;
+    buffer.reset(7);
+    uint64_t version;
+    EXPECT_EQ(buffer.read(version), 7);
+    EXPECT_EQ(version, 0u); // a default, nothing written yet
+    buffer.write(1);
+    buffer.write(2);
+    EXPECT_EQ(buffer.read(version), 2);
+    EXPECT_EQ(version, 2u);
+    EXPECT_EQ(buffer.version(), 2u);
+    buffer.reset(0);
+    EXPECT_EQ(buffer.version(), 0u);
+}
+
+TEST(LatestValueBuffer, ReadersNeverSeeATornMsg) {
+    LatestValueBuffer<Msg> buffer;
+    buffer.reset(Msg(64, 0));
+    boost::atomic<bool> done{false};
+    boost::atomic<bool> torn{false}, backward{false};
+
+    boost::thread_group readers;
+    for(int r = 0; r < 3; r++) {
+        readers.create_thread([&]() {
+            uint64_t prev_version = 0;
+            while(!done) {
+                uint64_t version;
+                Msg msg = buffer.read(version);
+                if(!consistent(msg) || msg[0] != version) torn = true;
+                if(version < prev_version) backward = true;
+                prev_version = version;
+            }
+        });
+    }
+    for(uint64_t i = 1; i <= 20000; i++) buffer.write(Msg(64, i));
+    done = true;
+    readers.join_all();
+    EXPECT_FALSE(torn);
+    EXPECT_FALSE(backward);
+}
@@ -0,0 +1,132 @@
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/CpQueue.hpp"
+#include "Misc/PubSubSystem/RingBufferQueue.hpp"
+#include "Misc/PubSubSystem/PubSub.hpp"
+
+// both backends of the Blocking ITPS channels, check MessageQueue in CpQueue.hpp
+template <typename Queue>
+class MessageQueueTest : public ::testing::Test {};
+
+typedef ::testing::Types< ConsumerProducerQueue<int>, RingBufferQueue<int> > QueueTypes;
+TYPED_TEST_SUITE(MessageQueueTest, QueueTypes);
+
+TYPED_TEST(MessageQueueTest, FifoAcrossWrapAround) {
+    TypeParam queue(3);
+    EXPECT_EQ(queue.capacity(), 3u);
+    int next_in = 0, next_out = 0;
+    for(int round = 0; round < 10; round++) {
+        while(!queue.is_full()) ASSERT_TRUE(queue.offer(next_in++));
+        EXPECT_EQ(queue.size(), 3u);
+        for(int i = 0; i < 2; i++) EXPECT_EQ(queue.consume(), next_out++);
+    }
+    int msg;
+    while(queue.try_consume(msg)) EXPECT_EQ(msg, next_out++);
+    EXPECT_EQ(next_out, next_in);
+    EXPECT_TRUE(queue.is_empty());
+}
+
+TYPED_TEST(MessageQueueTest, DropNewestRejectsTheIncomingMsg) {
+    TypeParam queue(2, OverflowPolicy::DropNewest);
+    EXPECT_TRUE(queue.offer(1));
+    EXPECT_TRUE(queue.offer(2));
+    EXPECT_FALSE(queue.offer(3));
+    EXPECT_EQ(queue.stats().num_dropped.load(), 1u);
+    EXPECT_EQ(queue.consume(), 1);
+    EXPECT_EQ(queue.consume(), 2);
+}
+
+TYPED_TEST(MessageQueueTest, DropOldestEvictsTheBacklog) {
+    TypeParam queue(2, OverflowPolicy::DropOldest);
+    for(int i = 1; i <= 5; i++) EXPECT_TRUE(queue.offer(i));
+    EXPECT_EQ(queue.stats().num_dropped.load(), 3u);
+    EXPECT_EQ(queue.consume(), 4);
+    EXPECT_EQ(queue.consume(), 5);
+}
+
+TYPED_TEST(MessageQueueTest, BlockTimesOutOnAFullQueue) {
+    TypeParam queue(1, OverflowPolicy::Block);
+    EXPECT_TRUE(queue.offer(1));
+    EXPECT_FALSE(queue.offer(2, 20));
+    EXPECT_EQ(queue.stats().num_publish_timeouts.load(), 1u);
+    EXPECT_EQ(queue.consume(20, -1), 1);
+    EXPECT_EQ(queue.consume(20, -1), -1); // empty, the default after the timeout
+}
+
+TYPED_TEST(MessageQueueTest, BlockWaitsForTheConsumer) {
+    TypeParam queue(1, OverflowPolicy::Block);
+    queue.produce(1);
+    boost::atomic<bool> produced{false};
+    boost::thread producer([&]() {
+        queue.produce(2);
+        produced = true;
+    });
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+    EXPECT_FALSE(produced);
+    EXPECT_EQ(queue.consume(), 1);
+    producer.join();
+    EXPECT_TRUE(produced);
+    EXPECT_EQ(queue.consume(), 2);
+}
+
+TYPED_TEST(MessageQueueTest, CloseWakesUpTheConsumer) {
+    TypeParam queue(2);
+    boost::atomic<bool> closed{false};
+    boost::thread consumer([&]() {
+        try {
+            queue.consume();
+        }
+        catch(QueueClosed&) {
+            closed = true;
+        }
+    });
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+    queue.close();
+    consumer.join();
+    EXPECT_TRUE(closed);
+    EXPECT_FALSE(queue.offer(1));
+}
+
+TYPED_TEST(MessageQueueTest, ConcurrentProducers) {
+    const int NUM_PRODUCERS = 3, NUM_MSGS = 20000;
+    TypeParam queue(8);
+    boost::thread_group producers;
+    for(int p = 0; p < NUM_PRODUCERS; p++) {
+        producers.create_thread([&queue, p]() {
+            for(int i = 0; i < NUM_MSGS; i++) queue.produce(p * NUM_MSGS + i);
+        });
+    }
+    std::vector<int> last_seen(NUM_PRODUCERS, -1);
+    for(int n = 0; n < NUM_PRODUCERS * NUM_MSGS; n++) {
+        int msg = queue.consume();
+        int& last = last_seen[msg / NUM_MSGS];
+        ASSERT_EQ(msg % NUM_MSGS, last + 1); // each producer's msgs come out in order, none lost
+        last = msg % NUM_MSGS;
+    }
+    producers.join_all();
+    EXPECT_TRUE(queue.is_empty());
+}
+
+TEST(RingBufferQueue, OverwriteLatestIsRejected) {
+    EXPECT_THROW(RingBufferQueue<int>(4, OverflowPolicy::OverwriteLatest), std::invalid_argument);
+    EXPECT_THROW(RingBufferQueue<int>(0), std::invalid_argument);
+}
+
+TEST(ConsumerProducerQueue, OverwriteLatestReplacesTheNewestMsg) {
+    ConsumerProducerQueue<int> queue(3, OverflowPolicy::OverwriteLatest);
+    for(int i = 1; i <= 5; i++) EXPECT_TRUE(queue.offer(i));
+    EXPECT_EQ(queue.stats().num_dropped.load(), 2u);
+    EXPECT_EQ(queue.consume(), 1);
+    EXPECT_EQ(queue.consume(), 2);
+    EXPECT_EQ(queue.consume(), 5);
+}
+
+TEST(BlockingSubscriber, LockFreeOverwriteLatestIsRejected) {
+    typedef ITPS::BlockingSubscriber<int> Sub;
+    EXPECT_THROW(Sub("MessageQueueTest", "msg", 4, ITPS::QueueBackend::LockFree, OverflowPolicy::OverwriteLatest),
+                 std::invalid_argument);
+    EXPECT_NO_THROW(Sub("MessageQueueTest", "msg", 4, ITPS::QueueBackend::Locking, OverflowPolicy::OverwriteLatest));
+}
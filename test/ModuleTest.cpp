@@ -0,0 +1,69 @@
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/Module.hpp"
+
+static void sleep_ms(unsigned int ms) {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
+}
+
+// a module whose schedule() waits at a gate before it sets up its periodic task, as one waiting for its inputs
+class GatedModule : public Module {
+    public:
+        GatedModule() {
+            on_stop([this]() {
+                if(exec_task != nullptr) exec_task->cancel();
+            });
+        }
+
+        bool schedule(Executor& executor) override {
+            scheduling = true;
+            boost::lock_guard<boost::mutex> lock(gate);
+            setup_unless_stopped([&]() {
+                exec_task = &executor.add_periodic("ModuleTest.Gated", 1000, [this]() { steps++; });
+            });
+            return true;
+        }
+
+        boost::mutex gate;
+        boost::atomic<bool> scheduling{false};
+        boost::atomic<int> steps{0};
+        Executor::Task* exec_task = nullptr;
+};
+
+TEST(Module, StopBeforeTheSetupLeavesNoTask) {
+    ThreadPool pool(2);
+    Executor executor(1);
+    GatedModule module;
+    module.gate.lock();
+    module.run(pool, executor);
+    while(!module.scheduling) sleep_ms(1);
+    module.request_stop();
+    module.gate.unlock();
+    ASSERT_TRUE(module.wait_stopped(1000));
+    EXPECT_EQ(module.exec_task, nullptr);
+    sleep_ms(20);
+    EXPECT_EQ(module.steps, 0);
+}
+
+TEST(Module, StopAfterTheSetupCancelsTheTask) {
+    ThreadPool pool(2);
+    Executor executor(1);
+    GatedModule module;
+    module.run(pool, executor);
+    while(module.steps < 3) sleep_ms(1);
+    module.request_stop();
+    ASSERT_TRUE(module.wait_stopped(1000));
+    int steps = module.steps;
+    sleep_ms(20);
+    EXPECT_EQ(module.steps, steps);
+
+    // a restart runs a task of its own, the cancelled one stays inert
+    Executor::Task* first_task = module.exec_task;
+    module.run(pool, executor);
+    while(module.steps < steps + 3) sleep_ms(1);
+    EXPECT_NE(module.exec_task, first_task);
+    module.request_stop();
+    ASSERT_TRUE(module.wait_stopped(1000));
+}
@@ -0,0 +1,58 @@
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/Observer.hpp"
+
+static void sleep_ms(unsigned int ms) {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
+}
+
+class SlowObserver : public Observer<int> {
+    public:
+        void on_update(int /*data*/) override {
+            inside = true;
+            sleep_ms(50);
+            inside = false;
+            calls++;
+        }
+
+        boost::atomic<bool> inside{false};
+        boost::atomic<int> calls{0};
+};
+
+TEST(Subject, RemoveWaitsForTheNotificationInProgress) {
+    Subject<int> subject;
+    SlowObserver obs;
+    subject.add_observer(obs);
+    boost::thread notifier([&]() { subject.notify_observers(1); });
+    while(!obs.inside) sleep_ms(1);
+    subject.remove_observer(obs);
+    EXPECT_FALSE(obs.inside);
+    EXPECT_EQ(obs.calls, 1);
+    notifier.join();
+    subject.notify_observers(2);
+    EXPECT_EQ(obs.calls, 1);
+}
+
+class SelfRemovingObserver : public Observer<int> {
+    public:
+        SelfRemovingObserver(Subject<int>& subject) : subject(subject) {}
+
+        void on_update(int /*data*/) override {
+            calls++;
+            subject.remove_observer(*this);
+        }
+
+        Subject<int>& subject;
+        int calls = 0;
+};
+
+TEST(Subject, RemoveFromOnUpdateDoesntWaitForItself) {
+    Subject<int> subject;
+    SelfRemovingObserver obs(subject);
+    subject.add_observer(obs);
+    subject.notify_observers(1);
+    subject.notify_observers(2);
+    EXPECT_EQ(obs.calls, 1);
+}
@@ -0,0 +1,117 @@
+#include <memory>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/LatestValueBuffer.hpp"
+#include "Misc/PubSubSystem/PubSub.hpp"
+#include "Misc/PubSubSystem/Snapshot.hpp"
+
+TEST(PublishGroup, ReadersRetryAcrossAGroupUpdate) {
+    ITPS::PublishGroup group;
+    uint64_t s = group.read_begin();
+    EXPECT_FALSE(group.read_retry(s));
+    group.begin_publish();
+    EXPECT_TRUE(group.read_retry(s));
+    group.end_publish();
+    EXPECT_TRUE(group.read_retry(s));
+    EXPECT_FALSE(group.read_retry(group.read_begin()));
+}
+
+TEST(PublishGroup, GroupUpdatesAreSeenAtomically) {
+    // 2 buffers updated together under the group's seqlock, as MotionModule publishes its setpoints
+    ITPS::PublishGroup group;
+    LatestValueBuffer<uint64_t> a, b;
+    a.reset(0);
+    b.reset(0);
+    boost::atomic<bool> done{false}, mixed{false};
+
+    boost::thread reader([&]() {
+        while(!done) {
+            uint64_t va, vb, s;
+            do {
+                s = group.read_begin();
+                va = a.read();
+                vb = b.read();
+            } while(group.read_retry(s));
+            if(va != vb) mixed = true;
+        }
+    });
+    for(uint64_t i = 1; i <= 50000; i++) {
+        group.begin_publish();
+        a.write(i);
+        b.write(i);
+        group.end_publish();
+    }
+    done = true;
+    reader.join();
+    EXPECT_FALSE(mixed);
+}
+
+ITPS_PUBLISH_GROUP(PoseGroup);
+
+// the x & y of a robot, published together within PoseGroup, as MotionModule does with its setpoints
+struct Pose {
+    // bound to the current namespace
+    Pose() : x_pub("PublishGroupTest", "x", 0),
+             y_pub("PublishGroupTest", "y", 0),
+             x_sub("PublishGroupTest", "x"),
+             y_sub("PublishGroupTest", "y"),
+             snapshot(x_sub, y_sub) {
+        x_pub.join_group(PoseGroup{});
+        y_pub.join_group(PoseGroup{});
+        x_sub.subscribe();
+        y_sub.subscribe();
+    }
+
+    ITPS::NonBlockingPublisher<int> x_pub, y_pub;
+    ITPS::NonBlockingSubscriber<int> x_sub, y_sub;
+    ITPS::Snapshot<int, int> snapshot;
+};
+
+static Pose* make_pose(const ITPS::Namespace& ns) {
+    ITPS::NamespaceScope scope(ns);
+    return new Pose();
+}
+
+TEST(PublishGroup, OnePerNamespace) {
+    ITPS::Namespace a("groupA"), b("groupB");
+    EXPECT_NE(&PoseGroup::group(a), &PoseGroup::group(b));
+    EXPECT_EQ(&PoseGroup::group(a), &PoseGroup::group(ITPS::Namespace("groupA")));
+    {
+        ITPS::NamespaceScope scope(a);
+        EXPECT_EQ(&PoseGroup::group(), &PoseGroup::group(a));
+    }
+}
+
+TEST(PublishGroup, OtherNamespacesNeverMakeASnapshotRetry) {
+    ITPS::Namespace a("robotA"), b("robotB");
+    std::unique_ptr<Pose> pose_a(make_pose(a)), pose_b(make_pose(b));
+    int x, y;
+
+    // robotA in the middle of a group update doesn't hold robotB's readers
+    {
+        ITPS::GroupPublish group_publish(PoseGroup{}, a);
+        pose_a->x_pub.publish(1);
+        pose_b->snapshot.read(x, y);
+        EXPECT_EQ(pose_b->snapshot.num_retries(), 0u);
+        pose_a->y_pub.publish(1);
+    }
+
+    boost::atomic<bool> done{false};
+    boost::thread publisher([&]() {
+        for(int i = 1; !done; i++) {
+            ITPS::GroupPublish group_publish(PoseGroup{}, a);
+            pose_a->x_pub.publish(i);
+            pose_a->y_pub.publish(i);
+        }
+    });
+    for(int i = 0; i < 100000; i++) pose_b->snapshot.read(x, y);
+    done = true;
+    publisher.join();
+    EXPECT_EQ(pose_b->snapshot.num_retries(), 0u);
+
+    // robotA's own readers still see its group updates whole
+    pose_a->snapshot.read(x, y);
+    EXPECT_EQ(x, y);
+}
@@ -0,0 +1,180 @@
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <gtest/gtest.h>
+
+#include "Misc/PubSubSystem/ThreadPool.hpp"
+#include "Misc/PubSubSystem/TimerWheel.hpp"
+
+static void sleep_ms(unsigned int ms) {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
+}
+
+TEST(TimerWheel, ExpiresEachItemAtItsTick) {
+    TimerWheel<int> wheel(1000);
+    // within level 0, across the upper levels, and beyond the top one
+    std::vector<uint64_t> delays = {1, 5, 63, 64, 65, 4095, 4096, 300000, 20000000, 40000000};
+    for(std::size_t i = 0; i < delays.size(); i++) wheel.add(1000 + delays[i], i);
+    wheel.add(10, -1); // already past: the next tick
+    EXPECT_EQ(wheel.size(), delays.size() + 1);
+
+    std::vector<int> expired;
+    wheel.advance(1001, expired);
+    ASSERT_EQ(expired.size(), 2u);
+    for(std::size_t i = 0; i < delays.size(); i++) {
+        expired.clear();
+        wheel.advance(1000 + delays[i] - 1, expired);
+        EXPECT_TRUE(expired.empty()) << "item " << i << " expired early";
+        wheel.advance(1000 + delays[i], expired);
+        if(delays[i] > 1) {
+            ASSERT_EQ(expired.size(), 1u) << "item " << i;
+            EXPECT_EQ(expired[0], (int)i);
+        }
+    }
+    EXPECT_EQ(wheel.size(), 0u);
+    EXPECT_EQ(wheel.next_tick(), TimerWheel<int>::NO_TICK);
+}
+
+TEST(TimerWheel, NextTickIsNeverPastAnExpiry) {
+    TimerWheel<int> wheel;
+    wheel.add(10, 0);
+    wheel.add(1000, 1);
+    std::vector<int> expired;
+    while(expired.size() < 2) {
+        uint64_t next = wheel.next_tick();
+        ASSERT_NE(next, TimerWheel<int>::NO_TICK);
+        ASSERT_LE(next, expired.empty() ? 10u : 1000u);
+        wheel.advance(next, expired);
+    }
+    EXPECT_EQ(wheel.now_tick(), 1000u);
+}
+
+
+// both backends
+class ThreadPoolTest : public ::testing::TestWithParam<ThreadPool::Backend> {
+    protected:
+        ThreadPoolTest() : pool(3, ThreadSched("pool"), GetParam()) {}
+
+        ThreadPool pool;
+};
+
+INSTANTIATE_TEST_SUITE_P(Backends, ThreadPoolTest,
+                         ::testing::Values(ThreadPool::Backend::IoService, ThreadPool::Backend::WorkStealing));
+
+TEST_P(ThreadPoolTest, ExecuteRunsEveryTask) {
+    boost::atomic<int> runs{0};
+    for(int i = 0; i < 100; i++) pool.execute([&]() { runs++; });
+    while(runs < 100) sleep_ms(1);
+    EXPECT_EQ(runs, 100);
+}
+
+TEST_P(ThreadPoolTest, SubmitReturnsTheResult) {
+    std::future<int> answer = pool.submit([]() { return 42; });
+    EXPECT_EQ(answer.get(), 42);
+    std::future<int> failure = pool.submit([]() -> int { throw std::runtime_error("failed"); });
+    EXPECT_THROW(failure.get(), std::runtime_error);
+}
+
+TEST_P(ThreadPoolTest, ParallelForCoversTheRangeOnce) {
+    std::vector< boost::atomic<int> > hits(10000);
+    for(auto& hit: hits) hit = 0;
+    pool.parallel_for(0, hits.size(), [&](std::size_t i) { hits[i]++; });
+    for(auto& hit: hits) ASSERT_EQ(hit, 1);
+    pool.parallel_for(5, 5, [&](std::size_t) { FAIL(); });
+}
+
+TEST_P(ThreadPoolTest, ParallelReduceFoldsInIndexOrder) {
+    std::string abc = pool.parallel_reduce(0, 260, std::string(),
+                                           [](std::size_t i) { return std::string(1, 'a' + i % 26); },
+                                           [](const std::string& a, const std::string& b) { return a + b; }, 7);
+    std::string expected;
+    for(int i = 0; i < 260; i++) expected += char('a' + i % 26);
+    EXPECT_EQ(abc, expected);
+}
+
+TEST_P(ThreadPoolTest, ParallelForRethrows) {
+    EXPECT_THROW(pool.parallel_for(0, 100, [](std::size_t i) { if(i == 50) throw std::runtime_error("50"); }, 1),
+                 std::runtime_error);
+}
+
+TEST_P(ThreadPoolTest, ParallelForCompletesWhileThePoolIsBusy) {
+    boost::mutex hold;
+    hold.lock();
+    for(int i = 0; i < 3; i++) pool.execute([&]() { boost::lock_guard<boost::mutex> lock(hold); });
+    sleep_ms(20);
+    EXPECT_EQ(pool.num_active(), 3u);
+    long sum = pool.parallel_reduce(0, 100, 0L, [](std::size_t i) { return (long)i; },
+                                    [](long a, long b) { return a + b; });
+    EXPECT_EQ(sum, 4950);
+    hold.unlock();
+    while(pool.num_active() > 0) sleep_ms(1); // they still use hold
+}
+
+TEST_P(ThreadPoolTest, MetricsCountEveryTask) {
+    for(int i = 0; i < 100; i++) pool.execute([]() {});
+    ThreadPool::Strand strand(pool);
+    strand.execute([]() {});
+    strand.drain();
+    while(pool.queue_depth() > 0 || pool.num_active() > 0) sleep_ms(1);
+    EXPECT_EQ(pool.num_posted_funcs(), 102u);
+    EXPECT_EQ(pool.wait_time().count(), 102u);
+    EXPECT_EQ(pool.run_time().count(), 102u);
+}
+
+TEST_P(ThreadPoolTest, StrandRunsInOrderOneAtATime) {
+    ThreadPool::Strand strand(pool);
+    boost::atomic<int> inside{0};
+    boost::atomic<bool> overlap{false};
+    std::vector<int> order;
+    for(int i = 0; i < 1000; i++) {
+        strand.execute([&, i]() {
+            if(inside.fetch_add(1) != 0) overlap = true;
+            order.push_back(i);
+            inside.fetch_sub(1);
+        });
+    }
+    strand.drain();
+    EXPECT_FALSE(overlap);
+    ASSERT_EQ(order.size(), 1000u);
+    for(int i = 0; i < 1000; i++) ASSERT_EQ(order[i], i);
+}
+
+TEST_P(ThreadPoolTest, ScheduleAfterRunsOnceNeverEarly) {
+    boost::atomic<int> runs{0};
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    boost::atomic<int64_t> elapsed_ms{0};
+    ThreadPool::Timer timer = pool.schedule_after(30, [&]() {
+        elapsed_ms = boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - start).count();
+        runs++;
+    });
+    sleep_ms(100);
+    EXPECT_EQ(runs, 1);
+    EXPECT_GE(elapsed_ms, 30);
+    EXPECT_FALSE(timer.active());
+}
+
+TEST_P(ThreadPoolTest, ScheduleEveryStopsOnCancel) {
+    boost::atomic<int> runs{0};
+    ThreadPool::Timer timer = pool.schedule_every(10, [&]() { runs++; });
+    sleep_ms(105);
+    timer.cancel();
+    int at_cancel = runs;
+    EXPECT_GE(at_cancel, 5);
+    EXPECT_LE(at_cancel, 11);
+    sleep_ms(40);
+    EXPECT_EQ(runs, at_cancel);
+    EXPECT_FALSE(timer.active());
+}
+
+TEST_P(ThreadPoolTest, CancelWaitsForTheRunInProgress) {
+    boost::atomic<bool> started{false}, finished{false};
+    ThreadPool::Timer timer = pool.schedule_after(1, [&]() {
+        started = true;
+        sleep_ms(40);
+        finished = true;
+    });
+    while(!started) sleep_ms(1);
+    timer.cancel();
+    EXPECT_TRUE(finished);
+}